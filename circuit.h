@@ -146,11 +146,11 @@ struct Circuit {
         return mul_gates.size();
     }
 
-    void GetMulShares(fmpz_t** shares0, fmpz_t** shares1) const {
+    void GetMulShares(fmpz_t* const shares0, fmpz_t* const shares1) const {
         unsigned int i = 0;
 
         for (Gate* gate : mul_gates) {
-            SplitShare(gate->WireValue, (*shares0)[i], (*shares1)[i]);
+            SplitShare(gate->WireValue, shares0[i], shares1[i]);
             i++;
         }
     }
@@ -23,9 +23,11 @@ x_op_invalid: For testing/debugging, does a basic run with intentionally invalid
 #include <string>
 
 #include "circuit.h"
+#include "dpf.h"
 #include "hash.h"
 #include "net_share.h"
 #include "ot.h"
+#include "packed.h"
 #include "types.h"
 #include "utils.h"
 
@@ -39,10 +41,20 @@ x_op_invalid: For testing/debugging, does a basic run with intentionally invalid
 #define DEBUG_INVALID false
 // Whether to have the client batch or not
 #define CLIENT_BATCH true
+// FREQ, COUNTMIN, HEAVY: send a DPF key per one-hot row instead of the bits
+#define USE_DPF false
+// MAX, MIN: send 1 + log B words, resolved a bit at a time, instead of B+1 words
+#define MAX_BIT_ENCODING false
+// INTSUM, VAR, STDDEV: give each client one of NUM_LABELS public labels, for
+// answers per label
+#define GROUP_BY false
+#define NUM_LABELS 8
 
 uint32_t num_bits;
 uint64_t max_int;
 uint32_t linreg_degree = 2;
+// Intsum vector length
+size_t intsum_len = 1;
 // Heavy
 double t = -1;  // default to not work
 size_t w, d;
@@ -62,11 +74,11 @@ std::string make_pk(emp::PRG prg) {
     return pub_key_to_hex((uint64_t*)&b);
 }
 
-int send_maxshare(const int server_num, const MaxShare& maxshare, const unsigned int B) {
+int send_maxshare(const int server_num, const MaxShare& maxshare, const unsigned int len) {
     const int sock = (server_num == 0) ? sockfd0 : sockfd1;
 
     int ret = send(sock, (void*)&(maxshare.pk[0]), PK_LENGTH, 0);
-    ret += send_uint64_batch(sock, maxshare.arr, B+1);
+    ret += send_uint64_batch(sock, maxshare.arr, len);
 
     return ret;
 }
@@ -74,7 +86,7 @@ int send_maxshare(const int server_num, const MaxShare& maxshare, const unsigned
 int send_freqshare(const int server_num, const FreqShare& freqshare, const uint64_t n) {
     const int sock = (server_num == 0) ? sockfd0 : sockfd1;
     int ret = send(sock, (void*)&(freqshare.pk[0]), PK_LENGTH, 0);
-    ret += send_bool_batch(sock, freqshare.arr, n);
+    ret += send_packed_bits(sock, freqshare.arr, n);
     return ret;
 }
 
@@ -102,6 +114,33 @@ int send_to_server(const int server, const void* const buffer, const size_t n, c
     return ret;
 }
 
+// One-hot rows as DPF keys, with the 1 of row j at pos[j].
+// Rows are w wide, except the last, which is last_w wide.
+int send_dpf_rows(const char* const pk, const size_t num_rows, const size_t w,
+                  const size_t last_w, const uint64_t* const pos) {
+    const uint64_t mod = fmpz_get_ui(Int_Modulus);
+    const size_t depth = dpf_depth(w), last_depth = dpf_depth(last_w);
+    const size_t key_len = (num_rows - 1) * dpf_key_words(depth) + dpf_key_words(last_depth);
+    uint64_t* const key0 = new uint64_t[key_len];
+    uint64_t* const key1 = new uint64_t[key_len];
+
+    size_t offset = 0;
+    for (unsigned int j = 0; j < num_rows; j++) {
+        const size_t row_depth = (j == num_rows - 1) ? last_depth : depth;
+        dpf_gen(row_depth, pos[j], 1, mod, &key0[offset], &key1[offset]);
+        offset += dpf_key_words(row_depth);
+    }
+
+    int num_bytes = 0;
+    num_bytes += send_to_server(0, pk, PK_LENGTH);
+    num_bytes += send_uint64_batch(sockfd0, key0, key_len);
+    num_bytes += send_to_server(1, pk, PK_LENGTH);
+    num_bytes += send_uint64_batch(sockfd1, key1, key_len);
+    delete[] key0;
+    delete[] key1;
+    return num_bytes;
+}
+
 int bit_sum_helper(const std::string protocol, const size_t numreqs,
                    unsigned int &ans, const initMsg* const msg_ptr = nullptr) {
     auto start = clock_start();
@@ -231,49 +270,81 @@ void bit_sum_invalid(const std::string protocol, const size_t numreqs) {
     delete[] b;
 }
 
+int send_intshare(const int server_num, const char* const pk,
+                  const uint64_t* const vals, const size_t num_values) {
+    const int sock = (server_num == 0) ? sockfd0 : sockfd1;
+    int ret = send(sock, (void*)&pk[0], PK_LENGTH, 0);
+    ret += send_uint64_batch(sock, vals, num_values);
+    return ret;
+}
+
+// Public, so the same to both servers
+int send_label(const uint64_t label) {
+    return send_uint64(sockfd0, label) + send_uint64(sockfd1, label);
+}
+
+// initMsg, then each value's bit width
+int send_intsum_init(const initMsg* const msg_ptr) {
+    int num_bytes = 0;
+    uint64_t* const bits = new uint64_t[msg_ptr->max_inp];
+    for (unsigned int j = 0; j < msg_ptr->max_inp; j++)
+        bits[j] = num_bits;
+    for (int server = 0; server < 2; server++) {
+        num_bytes += send_to_server(server, msg_ptr, sizeof(initMsg));
+        num_bytes += send_uint64_batch(server == 0 ? sockfd0 : sockfd1,
+                                       bits, msg_ptr->max_inp);
+    }
+    delete[] bits;
+    return num_bytes;
+}
+
 int int_sum_helper(const std::string protocol, const size_t numreqs,
-                   uint64_t &ans, const initMsg* const msg_ptr = nullptr) {
+                   uint64_t* const ans, const initMsg* const msg_ptr = nullptr) {
     auto start = clock_start();
     int num_bytes = 0;
-
-    uint64_t real_val, share0, share1;
+    const size_t k = intsum_len;
 
     emp::PRG prg;
 
-    IntShare* const intshare0 = new IntShare[numreqs];
-    IntShare* const intshare1 = new IntShare[numreqs];
+    uint64_t* const real_val = new uint64_t[k];
+    uint64_t* const share0 = new uint64_t[numreqs * k];
+    uint64_t* const share1 = new uint64_t[numreqs * k];
+    std::string* const pk = new std::string[numreqs];
+    uint64_t* const label = new uint64_t[numreqs];
 
     for (unsigned int i = 0; i < numreqs; i++) {
-        prg.random_data(&real_val, sizeof(uint64_t));
-        prg.random_data(&share0, sizeof(uint64_t));
-        real_val = real_val % max_int;
-        share0 = share0 % max_int;
-        share1 = share0 ^ real_val;
-        ans += real_val;
-
-        const std::string pk_s = make_pk(prg);
-        const char* const pk = pk_s.c_str();
-
-        memcpy(intshare0[i].pk, &pk[0], PK_LENGTH);
-        intshare0[i].val = share0;
-
-        memcpy(intshare1[i].pk, &pk[0], PK_LENGTH);
-        intshare1[i].val = share1;
+        prg.random_data(real_val, k * sizeof(uint64_t));
+        prg.random_data(&share0[i * k], k * sizeof(uint64_t));
+        label[i] = 0;
+        if (GROUP_BY) {
+            prg.random_data(&label[i], sizeof(uint64_t));
+            label[i] %= NUM_LABELS;
+        }
+        for (unsigned int j = 0; j < k; j++) {
+            real_val[j] = real_val[j] % max_int;
+            share0[i * k + j] = share0[i * k + j] % max_int;
+            share1[i * k + j] = share0[i * k + j] ^ real_val[j];
+            ans[j] += real_val[j];
+        }
+        pk[i] = make_pk(prg);
     }
+    delete[] real_val;
     if (numreqs > 1)
         std::cout << "batch make:\t" << sec_from(start) << std::endl;
 
     start = clock_start();
-    if (msg_ptr != nullptr) {
-        num_bytes += send_to_server(0, msg_ptr, sizeof(initMsg));
-        num_bytes += send_to_server(1, msg_ptr, sizeof(initMsg));
-    }
+    if (msg_ptr != nullptr)
+        num_bytes += send_intsum_init(msg_ptr);
     for (unsigned int i = 0; i < numreqs; i++) {
-        num_bytes += send_to_server(0, &intshare0[i], sizeof(IntShare));
-        num_bytes += send_to_server(1, &intshare1[i], sizeof(IntShare));
+        num_bytes += send_intshare(0, pk[i].c_str(), &share0[i * k], k);
+        num_bytes += send_intshare(1, pk[i].c_str(), &share1[i * k], k);
+        if (GROUP_BY)
+            num_bytes += send_label(label[i]);
     }
-    delete[] intshare0;
-    delete[] intshare1;
+    delete[] share0;
+    delete[] share1;
+    delete[] pk;
+    delete[] label;
 
     if (numreqs > 1)
         std::cout << "batch send:\t" << sec_from(start) << std::endl;
@@ -282,12 +353,15 @@ int int_sum_helper(const std::string protocol, const size_t numreqs,
 }
 
 void int_sum(const std::string protocol, const size_t numreqs) {
-    uint64_t ans = 0;
+    uint64_t* const ans = new uint64_t[intsum_len];
+    memset(ans, 0, intsum_len * sizeof(uint64_t));
     int num_bytes = 0;
     initMsg msg;
     msg.num_bits = num_bits;
     msg.num_of_inputs = numreqs;
+    msg.max_inp = intsum_len;
     msg.type = INT_SUM;
+    msg.group_by = GROUP_BY;
 
     if (fmpz_cmp_ui(Int_Modulus, (1ULL << num_bits) * numreqs) < 0 ) {
         std::cout << "Modulus should be at least " << (num_bits + LOG2(numreqs)) << " bits" << std::endl;
@@ -303,8 +377,12 @@ void int_sum(const std::string protocol, const size_t numreqs) {
         std::cout << "make+send:\t" << sec_from(start) << std::endl;
     }
 
-    std::cout << "Ans : " << ans << std::endl;
+    std::cout << "Ans :";
+    for (unsigned int j = 0; j < intsum_len; j++)
+        std::cout << " " << ans[j];
+    std::cout << std::endl;
     std::cout << "Total sent bytes: " << num_bytes << std::endl;
+    delete[] ans;
 }
 
 /* 0: x > max
@@ -315,10 +393,12 @@ void int_sum(const std::string protocol, const size_t numreqs) {
 */
 void int_sum_invalid(const std::string protocol, const size_t numreqs) {
     initMsg msg;
+    msg.num_bits = num_bits;
     msg.num_of_inputs = numreqs;
+    msg.max_inp = 1;
     msg.type = INT_SUM;
-    send_to_server(0, &msg, sizeof(initMsg));
-    send_to_server(1, &msg, sizeof(initMsg));
+    msg.group_by = false;
+    send_intsum_init(&msg);
 
     emp::block* const b = new emp::block[numreqs];
     uint64_t real_vals[numreqs];
@@ -363,8 +443,8 @@ void int_sum_invalid(const std::string protocol, const size_t numreqs) {
         if (i == 6)
             memcpy(share1.pk, &prev_pk[0], PK_LENGTH);
 
-        send_to_server(0, &share0, sizeof(IntShare));
-        send_to_server(1, &share1, sizeof(IntShare));
+        send_intshare(0, share0.pk, &share0.val, 1);
+        send_intshare(1, share1.pk, &share1.val, 1);
     }
 
     std::cout << "Ans : " << ans << std::endl;
@@ -558,9 +638,14 @@ int max_op_helper(const std::string protocol, const size_t numreqs,
     start = clock_start();
 
     uint64_t value;
-    uint64_t* const or_encoded_array = new uint64_t[B+1];
-    uint64_t* const share0 = new uint64_t[B+1];
-    uint64_t* const share1 = new uint64_t[B+1];
+    // Bit encoding: v, then a random nonzero word per set bit of v
+    unsigned int nbits = 1;
+    while (nbits < 64 and (B >> nbits))
+        nbits++;
+    const unsigned int len = MAX_BIT_ENCODING ? nbits + 1 : B + 1;
+    uint64_t* const or_encoded_array = new uint64_t[len];
+    uint64_t* const share0 = new uint64_t[len];
+    uint64_t* const share1 = new uint64_t[len];
 
     emp::PRG prg;
 
@@ -575,8 +660,8 @@ int max_op_helper(const std::string protocol, const size_t numreqs,
         if (protocol == "MINOP")
             ans = (value < ans ? value : ans);
 
-        prg.random_data(or_encoded_array, (B+1)*sizeof(uint64_t));
-        prg.random_data(share0, (B+1)*sizeof(uint64_t));
+        prg.random_data(or_encoded_array, len*sizeof(uint64_t));
+        prg.random_data(share0, len*sizeof(uint64_t));
 
         uint64_t v = 0;
         if (protocol == "MAXOP")
@@ -584,22 +669,28 @@ int max_op_helper(const std::string protocol, const size_t numreqs,
         if (protocol == "MINOP")
             v = B - value;
 
-        for (unsigned int j = v + 1; j <= B ; j++)
-            or_encoded_array[j] = 0;
+        if (MAX_BIT_ENCODING) {
+            or_encoded_array[0] = v;
+            for (unsigned int k = 0; k < nbits; k++)
+                or_encoded_array[1 + k] = ((v >> k) & 1) ? (or_encoded_array[1 + k] | 1) : 0;
+        } else {
+            for (unsigned int j = v + 1; j <= B ; j++)
+                or_encoded_array[j] = 0;
+        }
 
-        for (unsigned int j = 0; j <= B; j++)
+        for (unsigned int j = 0; j < len; j++)
             share1[j] = share0[j] ^ or_encoded_array[j];
 
         const std::string pk_s = make_pk(prg);
         const char* const pk = pk_s.c_str();
 
         memcpy(maxshare0[i].pk, &pk[0], PK_LENGTH);
-        maxshare0[i].arr = new uint64_t[B+1];
-        memcpy(maxshare0[i].arr, share0, (B+1)*sizeof(uint64_t));
+        maxshare0[i].arr = new uint64_t[len];
+        memcpy(maxshare0[i].arr, share0, len*sizeof(uint64_t));
 
         memcpy(maxshare1[i].pk, &pk[0], PK_LENGTH);
-        maxshare1[i].arr = new uint64_t[B+1];
-        memcpy(maxshare1[i].arr, share1, (B+1)*sizeof(uint64_t));
+        maxshare1[i].arr = new uint64_t[len];
+        memcpy(maxshare1[i].arr, share1, len*sizeof(uint64_t));
     }
     delete[] or_encoded_array;
     delete[] share0;
@@ -613,8 +704,8 @@ int max_op_helper(const std::string protocol, const size_t numreqs,
         num_bytes += send_to_server(1, msg_ptr, sizeof(initMsg));
     }
     for (unsigned int i = 0; i < numreqs; i++) {
-        num_bytes += send_maxshare(0, maxshare0[i], B);
-        num_bytes += send_maxshare(1, maxshare1[i], B);
+        num_bytes += send_maxshare(0, maxshare0[i], len);
+        num_bytes += send_maxshare(1, maxshare1[i], len);
 
         delete[] maxshare0[i].arr;
         delete[] maxshare1[i].arr;
@@ -637,6 +728,7 @@ void max_op(const std::string protocol, const size_t numreqs) {
     initMsg msg;
     msg.num_of_inputs = numreqs;
     msg.max_inp = B;
+    msg.use_bit_encoding = MAX_BIT_ENCODING;
     if (protocol == "MAXOP") {
         msg.type = MAX_OP;
         ans = 0;
@@ -669,6 +761,7 @@ void max_op_invalid(const std::string protocol, const size_t numreqs) {
     initMsg msg;
     msg.num_of_inputs = numreqs;
     msg.max_inp = B;
+    msg.use_bit_encoding = false;
     emp::PRG prg(emp::fix_key);
     uint64_t ans;
     if (protocol == "MAXOP") {
@@ -741,8 +834,8 @@ void max_op_invalid(const std::string protocol, const size_t numreqs) {
         if (i == 4)
             memcpy(share1.pk, &prev_pk[0], PK_LENGTH);
 
-        send_maxshare(0, share0, B);
-        send_maxshare(1, share1, B);
+        send_maxshare(0, share0, B+1);
+        send_maxshare(1, share1, B+1);
     }
 
     std::cout << "Ans : " << ans << std::endl;
@@ -768,12 +861,18 @@ int var_op_helper(const std::string protocol, const size_t numreqs,
     VarShare* const varshare1 = new VarShare[numreqs];
     ClientPacket** const packet0 = new ClientPacket*[numreqs];
     ClientPacket** const packet1 = new ClientPacket*[numreqs];
+    uint64_t* const label = new uint64_t[numreqs];
 
     Circuit* const mock_circuit = CheckVar();
     const size_t NMul = mock_circuit->NumMulGates();
     delete mock_circuit;
 
     for (unsigned int i = 0; i < numreqs; i++) {
+        label[i] = 0;
+        if (GROUP_BY) {
+            prg.random_data(&label[i], sizeof(uint64_t));
+            label[i] %= NUM_LABELS;
+        }
         prg.random_data(&real_val, sizeof(uint64_t));
         prg.random_data(&share0, sizeof(uint64_t));
         prg.random_data(&share0_2, sizeof(uint64_t));
@@ -818,6 +917,8 @@ int var_op_helper(const std::string protocol, const size_t numreqs,
     for (unsigned int i = 0; i < numreqs; i++) {
         num_bytes += send_to_server(0, &varshare0[i], sizeof(VarShare));
         num_bytes += send_to_server(1, &varshare1[i], sizeof(VarShare));
+        if (GROUP_BY)
+            num_bytes += send_label(label[i]);
 
         num_bytes += send_ClientPacket(sockfd0, packet0[i], NMul);
         num_bytes += send_ClientPacket(sockfd1, packet1[i], NMul);
@@ -828,6 +929,7 @@ int var_op_helper(const std::string protocol, const size_t numreqs,
 
     delete[] varshare0;
     delete[] varshare1;
+    delete[] label;
     delete[] packet0;
     delete[] packet1;
     fmpz_clear(inp[0]);
@@ -852,6 +954,7 @@ void var_op(const std::string protocol, const size_t numreqs) {
     initMsg msg;
     msg.num_bits = num_bits;
     msg.num_of_inputs = numreqs;
+    msg.group_by = GROUP_BY;
     if (protocol == "VAROP") {
         msg.type = VAR_OP;
     } else if (protocol == "STDDEVOP") {
@@ -895,6 +998,7 @@ void var_op(const std::string protocol, const size_t numreqs) {
 void var_op_invalid(const std::string protocol, const size_t numreqs) {
     initMsg msg;
     msg.num_of_inputs = numreqs;
+    msg.group_by = false;
     if (protocol == "VAROP") {
         msg.type = VAR_OP;
     } else if (protocol == "STDDEVOP") {
@@ -999,7 +1103,7 @@ void var_op_invalid(const std::string protocol, const size_t numreqs) {
         if (i == 7)
             fmpz_add_si(p0->MulShares[0], p0->MulShares[0], 1);
         if (i == 8)
-            fmpz_add_si(p1->triple_share->shareA, p1->triple_share->shareA, 1);
+            fmpz_add_si(p1->triple_a, p1->triple_a, 1);
         send_ClientPacket(sockfd0, p0, NMul);
         send_ClientPacket(sockfd1, p1, NMul);
         delete p0;
@@ -1363,7 +1467,7 @@ void lin_reg_invalid(const std::string protocol, const size_t numreqs) {
         if (i == 7)
             fmpz_add_si(packet0[i]->MulShares[0], packet0[i]->MulShares[0], 1);
         if (i == 8)
-            fmpz_add_si(packet1[i]->triple_share->shareA, packet1[i]->triple_share->shareA, 1);
+            fmpz_add_si(packet1[i]->triple_a, packet1[i]->triple_a, 1);
 
         // 10 vs 11, 12 vs 13 can be non-deterministic which ends up being right.
         if (i <= 9 or i == 11 or i == 13) {
@@ -1439,24 +1543,30 @@ int freq_helper(const std::string protocol, const size_t numreqs,
 
     FreqShare* const freqshare0 = new FreqShare[numreqs];
     FreqShare* const freqshare1 = new FreqShare[numreqs];
+    uint64_t* const pos = new uint64_t[numreqs];
     for (unsigned int i = 0; i < numreqs; i++) {
         prg.random_data(&real_val, sizeof(uint64_t));
         real_val %= max_int;
         counts[real_val] += 1;
+        pos[i] = real_val;
 
         // std::cout << "Value " << i << " = " << real_val << std::endl;
 
-        // Same everywhere exept at real_val
-        freqshare0[i].arr = new bool[max_int];
-        prg.random_bool(freqshare0[i].arr, max_int);
-        freqshare1[i].arr = new bool[max_int];
-        memcpy(freqshare1[i].arr, freqshare0[i].arr, max_int * sizeof(bool));
-        freqshare1[i].arr[real_val] ^= 1;
-
         const std::string pk_s = make_pk(prg);
         const char* const pk = pk_s.c_str();
         memcpy(freqshare0[i].pk, &pk[0], PK_LENGTH);
         memcpy(freqshare1[i].pk, &pk[0], PK_LENGTH);
+        if (USE_DPF)
+            continue;
+
+        // Same everywhere exept at real_val
+        const size_t words = words_for(max_int);
+        freqshare0[i].arr = new uint64_t[words];
+        prg.random_data(freqshare0[i].arr, words * sizeof(uint64_t));
+        clear_tail(freqshare0[i].arr, max_int);
+        freqshare1[i].arr = new uint64_t[words];
+        memcpy(freqshare1[i].arr, freqshare0[i].arr, words * sizeof(uint64_t));
+        freqshare1[i].arr[real_val / 64] ^= 1ULL << (real_val % 64);
     }
 
     if (numreqs > 1)
@@ -1468,6 +1578,10 @@ int freq_helper(const std::string protocol, const size_t numreqs,
         num_bytes += send_to_server(1, msg_ptr, sizeof(initMsg));
     }
     for (unsigned int i = 0; i < numreqs; i++) {
+        if (USE_DPF) {
+            num_bytes += send_dpf_rows(freqshare0[i].pk, 1, max_int, max_int, &pos[i]);
+            continue;
+        }
         num_bytes += send_freqshare(0, freqshare0[i], max_int);
         num_bytes += send_freqshare(1, freqshare1[i], max_int);
 
@@ -1477,6 +1591,7 @@ int freq_helper(const std::string protocol, const size_t numreqs,
 
     delete[] freqshare0;
     delete[] freqshare1;
+    delete[] pos;
 
     if (numreqs > 1)
         std::cout << "batch send:\t" << sec_from(start) << std::endl;
@@ -1493,6 +1608,7 @@ void freq_op(const std::string protocol, const size_t numreqs) {
     msg.num_of_inputs = numreqs;
     msg.max_inp = max_int;
     msg.type = FREQ_OP;
+    msg.use_dpf = USE_DPF;
 
     if (CLIENT_BATCH) {
         num_bytes += freq_helper(protocol, numreqs, count, &msg);
@@ -1521,7 +1637,6 @@ int countmin_helper(const std::string protocol, const size_t numreqs,
     emp::PRG prg;
 
     uint64_t real_val;
-    fmpz_t hashed; fmpz_init(hashed);
 
     uint64_t heavy, heavy2;
     prg.random_data(&heavy, sizeof(uint64_t));
@@ -1534,6 +1649,7 @@ int countmin_helper(const std::string protocol, const size_t numreqs,
 
     FreqShare* const freqshare0 = new FreqShare[numreqs];
     FreqShare* const freqshare1 = new FreqShare[numreqs];
+    uint64_t* const pos = new uint64_t[numreqs * d];
     for (unsigned int i = 0; i < numreqs; i++) {
         if (i <= t * numreqs) {  // first t fraction
             real_val = heavy;
@@ -1546,28 +1662,36 @@ int countmin_helper(const std::string protocol, const size_t numreqs,
         }
         counts[real_val] += 1;
 
-        freqshare0[i].arr = new bool[d * w];
-        freqshare1[i].arr = new bool[d * w];
-        prg.random_bool(freqshare0[i].arr, d * w);
-        memcpy(freqshare1[i].arr, freqshare0[i].arr, d * w * sizeof(bool));
-        for (unsigned int j = 0; j < d; j++) {
-            hash_store.eval(j, real_val, hashed);
-            int h = fmpz_get_si(hashed);
-            freqshare1[i].arr[j * w + h] ^= 1;
-        }
+        hash_store.eval_all(real_val, &pos[i * d]);
 
         const std::string pk_s = make_pk(prg);
         const char* const pk = pk_s.c_str();
         memcpy(freqshare0[i].pk, &pk[0], PK_LENGTH);
         memcpy(freqshare1[i].pk, &pk[0], PK_LENGTH);
+        if (USE_DPF)
+            continue;
+
+        const size_t words = words_for(d * w);
+        freqshare0[i].arr = new uint64_t[words];
+        freqshare1[i].arr = new uint64_t[words];
+        prg.random_data(freqshare0[i].arr, words * sizeof(uint64_t));
+        clear_tail(freqshare0[i].arr, d * w);
+        memcpy(freqshare1[i].arr, freqshare0[i].arr, words * sizeof(uint64_t));
+        for (unsigned int j = 0; j < d; j++) {
+            const size_t idx = j * w + pos[i * d + j];
+            freqshare1[i].arr[idx / 64] ^= 1ULL << (idx % 64);
+        }
     }
-    fmpz_clear(hashed);
 
     if (numreqs > 1)
         std::cout << "batch make:\t" << sec_from(start) << std::endl;
 
     start = clock_start();
     for (unsigned int i = 0; i < numreqs; i++) {
+        if (USE_DPF) {
+            num_bytes += send_dpf_rows(freqshare0[i].pk, d, w, w, &pos[i * d]);
+            continue;
+        }
         num_bytes += send_freqshare(0, freqshare0[i], d * w);
         num_bytes += send_freqshare(1, freqshare1[i], d * w);
 
@@ -1577,6 +1701,7 @@ int countmin_helper(const std::string protocol, const size_t numreqs,
 
     delete[] freqshare0;
     delete[] freqshare1;
+    delete[] pos;
 
     if (numreqs > 1)
         std::cout << "batch send:\t" << sec_from(start) << std::endl;
@@ -1593,6 +1718,7 @@ void countmin_op(const std::string protocol, const size_t numreqs) {
     msg.num_bits = num_bits;
     msg.num_of_inputs = numreqs;
     msg.type = COUNTMIN_OP;
+    msg.use_dpf = USE_DPF;
 
     if (t == -1)
         error_exit("provide t, w, d in params");
@@ -1651,7 +1777,6 @@ int heavy_helper(const std::string protocol, const size_t numreqs,
     emp::PRG prg;
 
     uint64_t real_val;
-    fmpz_t hashed; fmpz_init(hashed);
 
     uint64_t heavy;
     prg.random_data(&heavy, sizeof(uint64_t));
@@ -1660,6 +1785,9 @@ int heavy_helper(const std::string protocol, const size_t numreqs,
     std::cout << "Fixed heavy value: " << heavy << std::endl;
     FreqShare* const freqshare0 = new FreqShare[numreqs];
     FreqShare* const freqshare1 = new FreqShare[numreqs];
+    // Position of the 1 in each row: L layers of d, then freq
+    const size_t num_rows = L * d + 1;
+    uint64_t* const pos = new uint64_t[numreqs * num_rows];
     for (unsigned int i = 0; i < numreqs; i++) {
         if (i <= t * numreqs) {  // first t fraction
             real_val = heavy;
@@ -1670,33 +1798,35 @@ int heavy_helper(const std::string protocol, const size_t numreqs,
         }
         counts[real_val] += 1;
 
-        freqshare0[i].arr = new bool[share_size];
-        freqshare1[i].arr = new bool[share_size];
-        prg.random_bool(freqshare0[i].arr, share_size);
-        memcpy(freqshare1[i].arr, freqshare0[i].arr, share_size * sizeof(bool));
         for (unsigned int k = 0; k < L; k++) {
             // Hash last num-k bits of val in standard count-min
             const uint64_t offset_val = real_val >> (L - 1 - k);
-            for (unsigned int j = 0; j < d; j++) {
-                hash_stores[k]->eval(j, offset_val, hashed);
-                int h = fmpz_get_si(hashed);
-                // std::cout << "layer " << k << " hash_" << j << "(" << offset_val << ") = " << h << ", setting " << (k * d * w + j * w + h) << std::endl;
-                freqshare1[i].arr[k * d * w + j * w + h] ^= 1;
-            }
+            hash_stores[k]->eval_all(offset_val, &pos[i * num_rows + k * d]);
         }
         // Store final num-L in standard freq
-        // std::cout << "freq set " << L * d * w << " + " << (real_val >> L) << " = " << (L * d * w + (real_val >> L)) << std::endl;
-        freqshare1[i].arr[L * d * w + (real_val >> L)] ^= 1;
+        pos[i * num_rows + L * d] = real_val >> L;
 
         const std::string pk_s = make_pk(prg);
         const char* const pk = pk_s.c_str();
         memcpy(freqshare0[i].pk, &pk[0], PK_LENGTH);
         memcpy(freqshare1[i].pk, &pk[0], PK_LENGTH);
+        if (USE_DPF)
+            continue;
+
+        const size_t words = words_for(share_size);
+        freqshare0[i].arr = new uint64_t[words];
+        freqshare1[i].arr = new uint64_t[words];
+        prg.random_data(freqshare0[i].arr, words * sizeof(uint64_t));
+        clear_tail(freqshare0[i].arr, share_size);
+        memcpy(freqshare1[i].arr, freqshare0[i].arr, words * sizeof(uint64_t));
+        for (unsigned int j = 0; j < num_rows; j++) {
+            const size_t idx = j * w + pos[i * num_rows + j];
+            freqshare1[i].arr[idx / 64] ^= 1ULL << (idx % 64);
+        }
     }
-    fmpz_clear(hashed);
 
     // for (unsigned int j = 0; j < share_size; j++) {
-    //     std::cout << "0[" << j << "] " << freqshare0[0].arr[j] << " ^ " << freqshare1[0].arr[j] << " = " << (freqshare0[0].arr[j] ^ freqshare1[0].arr[j]) << std::endl;
+    //     std::cout << "0[" << j << "] " << get_bit(freqshare0[0].arr, j) << " ^ " << get_bit(freqshare1[0].arr, j) << " = " << (get_bit(freqshare0[0].arr, j) ^ get_bit(freqshare1[0].arr, j)) << std::endl;
     // }
 
     if (numreqs > 1)
@@ -1704,6 +1834,11 @@ int heavy_helper(const std::string protocol, const size_t numreqs,
 
     start = clock_start();
     for (unsigned int i = 0; i < numreqs; i++) {
+        if (USE_DPF) {
+            num_bytes += send_dpf_rows(freqshare0[i].pk, num_rows, w, first_size,
+                                       &pos[i * num_rows]);
+            continue;
+        }
         num_bytes += send_freqshare(0, freqshare0[i], share_size);
         num_bytes += send_freqshare(1, freqshare1[i], share_size);
 
@@ -1713,6 +1848,7 @@ int heavy_helper(const std::string protocol, const size_t numreqs,
 
     delete[] freqshare0;
     delete[] freqshare1;
+    delete[] pos;
 
     if (numreqs > 1)
         std::cout << "batch send:\t" << sec_from(start) << std::endl;
@@ -1729,6 +1865,7 @@ void heavy_op(const std::string protocol, const size_t numreqs) {
     msg.num_bits = num_bits;
     msg.num_of_inputs = numreqs;
     msg.type = HEAVY_OP;
+    msg.use_dpf = USE_DPF;
 
     if (t == -1)
         error_exit("provide t, w, d in params");
@@ -1780,9 +1917,39 @@ void heavy_op(const std::string protocol, const size_t numreqs) {
     std::cout << "Total sent bytes: " << num_bytes << std::endl;
 }
 
+// Ask both servers for a logged task's answer over epochs [first, last].
+// No shares, the servers already have theirs.
+void epoch_query(const std::string task, const uint64_t first, const uint64_t last) {
+    initMsg msg;
+    memset(&msg, 0, sizeof(initMsg));
+    msg.type = EPOCH_QUERY;
+    for (int server = 0; server < 2; server++) {
+        const int sockfd = (server == 0 ? sockfd0 : sockfd1);
+        send_to_server(server, &msg, sizeof(initMsg));
+        send_string(sockfd, task);
+        send_uint64(sockfd, first);
+        send_uint64(sockfd, last);
+    }
+}
+
+// Same, over the last length epochs logged
+void window_query(const std::string task, const uint64_t length) {
+    initMsg msg;
+    memset(&msg, 0, sizeof(initMsg));
+    msg.type = EPOCH_WINDOW;
+    for (int server = 0; server < 2; server++) {
+        const int sockfd = (server == 0 ? sockfd0 : sockfd1);
+        send_to_server(server, &msg, sizeof(initMsg));
+        send_string(sockfd, task);
+        send_uint64(sockfd, length);
+    }
+}
+
 int main(int argc, char** argv) {
-    if (argc < 4) {
-        std::cout << "Usage: ./bin/client num_submissions server0_port server1_port OPERATION num_bits (linreg_degree/heavy_t) heavy_w heavy_d heavy_L" << endl;
+    if (argc < 5) {
+        std::cout << "Usage: ./bin/client num_submissions server0_port server1_port OPERATION num_bits (intsum_len/linreg_degree/heavy_t) heavy_w heavy_d heavy_L" << endl;
+        std::cout << "   or: ./bin/client 0 server0_port server1_port QUERY task first_epoch last_epoch" << endl;
+        std::cout << "   or: ./bin/client 0 server0_port server1_port WINDOW task num_epochs" << endl;
         return 1;
     }
 
@@ -1791,8 +1958,13 @@ int main(int argc, char** argv) {
     const int port1 = atoi(argv[3]);
 
     const std::string protocol(argv[4]);
+    const bool query = (protocol == "QUERY" or protocol == "WINDOW");
+    if (protocol == "QUERY" and argc != 8)
+        error_exit("Query needs task, first_epoch, last_epoch");
+    if (protocol == "WINDOW" and argc != 7)
+        error_exit("Window needs task, num_epochs");
 
-    if (argc >= 6) {
+    if (argc >= 6 and !query) {
         num_bits = atoi(argv[5]);
         std::cout << "num bits: " << num_bits << std::endl;
         max_int = 1ULL << num_bits;
@@ -1801,7 +1973,14 @@ int main(int argc, char** argv) {
             error_exit("Num bits is too large. Int math is done mod 2^64.");
     }
 
-    if (argc == 7) {
+    if (query) {
+        ;  // Parsed when sent
+    } else if (argc == 7 and protocol == "INTSUM") {
+        intsum_len = atoi(argv[6]);
+        std::cout << "intsum length: " << intsum_len << std::endl;
+        if (intsum_len < 1)
+            error_exit("Intsum length must be >= 1");
+    } else if (argc == 7) {
         linreg_degree = atoi(argv[6]);
         std::cout << "linreg degree: " << num_bits << std::endl;
         if (linreg_degree < 2)
@@ -1809,7 +1988,7 @@ int main(int argc, char** argv) {
     }
 
     // Heavy: t, w, d
-    if (argc > 7) {
+    if (argc > 7 and !query) {
         if (argc < 9) // just 8
             error_exit("Heavy needs at least t, w, d, possibly L");
         t = atof(argv[6]);
@@ -1972,6 +2151,18 @@ int main(int argc, char** argv) {
         std::cout << "Total time:\t" << sec_from(start) << std::endl;
     }
 
+    else if (protocol == "WINDOW") {
+        std::cout << "Querying " << argv[5] << " over the last " << argv[6] << " epochs" << std::endl;
+        window_query(argv[5], strtoull(argv[6], nullptr, 10));
+        std::cout << "Total time:\t" << sec_from(start) << std::endl;
+    }
+
+    else if (protocol == "QUERY") {
+        std::cout << "Querying " << argv[5] << " over epochs " << argv[6] << " to " << argv[7] << std::endl;
+        epoch_query(argv[5], strtoull(argv[6], nullptr, 10), strtoull(argv[7], nullptr, 10));
+        std::cout << "Total time:\t" << sec_from(start) << std::endl;
+    }
+
     else {
         std::cout << "Unrecognized protocol: " << protocol << std::endl;
         initMsg msg;
@@ -78,18 +78,20 @@ void share_polynomials(const Circuit* const circuit, ClientPacket* const p0, Cli
     SplitShare(h0, p0->h0_s, p1->h0_s);
 
     // Split outputs of input/mult gate shares.
-    circuit->GetMulShares(&p0->MulShares, &p1->MulShares);
+    circuit->GetMulShares(p0->MulShares, p1->MulShares);
 
     BeaverTriple* triple = NewBeaverTriple();
-    BeaverTripleShares(triple, p0->triple_share, p1->triple_share);
+    SplitShare(triple->A, p0->triple_a, p1->triple_a);
+    SplitShare(triple->B, p0->triple_b, p1->triple_b);
+    SplitShare(triple->C, p0->triple_c, p1->triple_c);
 
     delete triple;
     fmpz_clear(h0);
     fmpz_clear(h_val);
     clear_fmpz_array(pointsF, N);
     clear_fmpz_array(pointsG, N);
-    clear_fmpz_array(paddedF, N);
-    clear_fmpz_array(paddedG, N);
+    clear_fmpz_array(paddedF, 2*N);
+    clear_fmpz_array(paddedG, 2*N);
     clear_fmpz_array(evalsF, 2*N);
     clear_fmpz_array(evalsG, 2*N);
 }
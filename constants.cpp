@@ -33,6 +33,8 @@ void init_roots(const size_t N) {
     if (num_roots == N) {
         return;
     }
+    // Kept across batches
+    FmpzArenaPause pause;
     if (roots != nullptr) {
         clear_fmpz_array(roots, num_roots);
         clear_fmpz_array(invroots, num_roots);
@@ -7,18 +7,69 @@
 #include "constants.h"
 #include "net_share.h"
 #include "ot.h"
+#include "packed.h"
 #include "utils.h"
 
 void CorrelatedStore::addBoolTriples(const size_t n) {
   auto start = clock_start();
   const size_t num_to_make = (n > batch_size ? n : batch_size);
-  std::cout << "adding booltriples: " << num_to_make << std::endl;
-  std::queue<BooleanBeaverTriple*> new_triples = gen_boolean_beaver_triples(server_num, num_to_make, ot0, ot1);
+  const size_t n_words = words_for(num_to_make);
+  std::cout << "adding booltriples: " << 64 * n_words << std::endl;
+  uint64_t* const a = new uint64_t[n_words];
+  uint64_t* const b = new uint64_t[n_words];
+  uint64_t* const c = new uint64_t[n_words];
+  gen_boolean_beaver_triples(server_num, n_words, ot0, ot1, a, b, c);
+  btriple_store.append(n_words, a, b, c);
+  delete[] a;
+  delete[] b;
+  delete[] c;
+  std::cout << "addBoolTriples timing : " << sec_from(start) << std::endl;
+}
+
+void CorrelatedStore::addArithTriples(const size_t n) {
+  auto start = clock_start();
+  const size_t num_to_make = (n > batch_size ? n : batch_size);
+  std::cout << "adding arith triples: " << num_to_make << std::endl;
+  uint64_t* const a = new uint64_t[num_to_make];
+  uint64_t* const b = new uint64_t[num_to_make];
+  uint64_t* const c = new uint64_t[num_to_make];
+  gen_arith_beaver_triples(server_num, num_to_make, ot0, ot1,
+                           fmpz_get_ui(Int_Modulus), a, b, c);
+  atriple_store.append(num_to_make, a, b, c);
+  delete[] a;
+  delete[] b;
+  delete[] c;
+  std::cout << "addArithTriples timing : " << sec_from(start) << std::endl;
+}
+
+void CorrelatedStore::addEdaBits(const size_t n_bits, const size_t n) {
+  auto start = clock_start();
+  const size_t num_to_make = (n > batch_size ? n : batch_size);
+  std::cout << "adding " << n_bits << " bit edabits: " << num_to_make << std::endl;
+
+  emp::PRG prg;
+  const uint64_t mask = (n_bits >= 64 ? ~0ULL : (1ULL << n_bits) - 1);
+  uint64_t* const r = new uint64_t[num_to_make];
+  prg.random_data(r, num_to_make * sizeof(uint64_t));
+  fmpz_t* r2; new_fmpz_array(&r2, num_to_make);
   for (unsigned int i = 0; i < num_to_make; i++) {
-    btriple_store.push(new_triples.front());
-    new_triples.pop();
+    r[i] &= mask;
+    fmpz_set_ui(r2[i], r[i]);
   }
-  std::cout << "addBoolTriples timing : " << sec_from(start) << std::endl;
+
+  fmpz_t* const rp_f = b2a_ot(num_to_make, 1, &n_bits, r2, fmpz_get_ui(Int_Modulus));
+
+  uint64_t* const rp = new uint64_t[num_to_make];
+  for (unsigned int i = 0; i < num_to_make; i++)
+    rp[i] = fmpz_get_ui(rp_f[i]);
+
+  edabit_store[n_bits].append(num_to_make, r, rp);
+
+  delete[] r;
+  delete[] rp;
+  clear_fmpz_array(r2, num_to_make);
+  clear_fmpz_array(rp_f, num_to_make);
+  std::cout << "addEdaBits timing : " << sec_from(start) << std::endl;
 }
 
 void CorrelatedStore::addDaBits(const size_t n) {
@@ -26,62 +77,125 @@ void CorrelatedStore::addDaBits(const size_t n) {
   // const size_t num_to_make = (n > batch_size ? n : batch_size);
   const size_t num_to_make = n;  // Currently to make "end to end" easier to benchmark
   std::cout << "adding dabits: " << num_to_make << std::endl;
+  uint64_t* const bp = new uint64_t[num_to_make];
+  uint64_t* const b2 = new uint64_t[words_for(num_to_make)];
   if (!lazy) {
-    DaBit** dabit = generateDaBit(num_to_make);
-    for (unsigned int i = 0; i < num_to_make; i++)
-      dabit_store.push(dabit[i]);
-    delete[] dabit;
+    generateDaBit(num_to_make, bp, b2);
   } else {  // Lazy generation: make local and send over
-    DaBit** const dabit = new DaBit*[num_to_make];
-    for (unsigned int i = 0; i < num_to_make; i++)
-      dabit[i] = new DaBit;
     if (server_num == 0) {
-      DaBit** const other_dabit = new DaBit*[num_to_make];
+      emp::PRG prg;
+      const uint64_t mod = fmpz_get_ui(Int_Modulus);
+      bool* const b = new bool[num_to_make];
+      bool* const b2_other = new bool[num_to_make];
+      uint64_t* const bp_other = new uint64_t[num_to_make];
+      prg.random_bool(b, num_to_make);
+      prg.random_bool(b2_other, num_to_make);
+      prg.random_data(bp, num_to_make * sizeof(uint64_t));
       for (unsigned int i = 0; i < num_to_make; i++) {
-        other_dabit[i] = new DaBit;
-        makeLocalDaBit(dabit[i], other_dabit[i]);
+        bp[i] %= mod;
+        // b - bp
+        bp_other[i] = (b[i] + (mod - bp[i])) % mod;
+        b[i] ^= b2_other[i];
       }
-      send_DaBit_batch(serverfd, other_dabit, num_to_make);
-      for (unsigned int i = 0; i < num_to_make; i++) {
-        dabit_store.push(dabit[i]);
-        delete other_dabit[i];
-      }
-      delete[] other_dabit;
+      pack_bits(b2, b, num_to_make);
+      send_uint64_batch(serverfd, bp_other, num_to_make);
+      send_bool_batch(serverfd, b2_other, num_to_make);
+      delete[] b;
+      delete[] b2_other;
+      delete[] bp_other;
     } else {
-      recv_DaBit_batch(serverfd, dabit, num_to_make);
-      for (unsigned int i = 0; i < num_to_make; i++)
-        dabit_store.push(dabit[i]);
+      recv_uint64_batch(serverfd, bp, num_to_make);
+      recv_packed_bits(serverfd, b2, num_to_make);
     }
-    delete[] dabit;
   }
+  storeDaBits(num_to_make, bp, b2);
+  delete[] bp;
+  delete[] b2;
   std::cout << "addDaBits timing : " << sec_from(start) << std::endl;
 }
 
+void CorrelatedStore::storeDaBits(const size_t n, const uint64_t* const bp,
+                                  const uint64_t* const b2) {
+  // Both servers see the same n and space, so stay in sync
+  if (dabit_file and n <= dabit_file->space()) {
+    uint64_t* const records = new uint64_t[2 * n];
+    for (unsigned int i = 0; i < n; i++) {
+      records[2 * i] = bp[i];
+      records[2 * i + 1] = get_bit(b2, i);
+    }
+    dabit_file->append(n, records);
+    delete[] records;
+  } else {
+    dabit_store.append(n, bp, b2);
+  }
+}
+
+void CorrelatedStore::loadDaBits(const size_t n) {
+  uint64_t* const records = new uint64_t[2 * n];
+  uint64_t* const bp = new uint64_t[n];
+  uint64_t* const b2 = new uint64_t[words_for(n)];
+  memset(b2, 0, words_for(n) * sizeof(uint64_t));
+  dabit_file->take(n, records);
+  for (unsigned int i = 0; i < n; i++) {
+    bp[i] = records[2 * i];
+    b2[i / 64] |= records[2 * i + 1] << (i % 64);
+  }
+  dabit_store.append(n, bp, b2);
+  delete[] records;
+  delete[] bp;
+  delete[] b2;
+}
+
+void CorrelatedStore::attachDaBitFile(PersistentStore* const store) {
+  dabit_file = store;
+  dabit_file->sync(serverfd, server_num);
+}
+
 void CorrelatedStore::checkBoolTriples(const size_t n) {
-  if (btriple_store.size() < n) addBoolTriples(n - btriple_store.size());
+  const size_t have = 64 * btriple_store.size();
+  if (have < n) addBoolTriples(n - have);
 }
 
 void CorrelatedStore::checkDaBits(const size_t n) {
-  if (dabit_store.size() < n) addDaBits(n - dabit_store.size());
+  if (dabit_store.size() >= n) return;
+  if (dabit_file) {
+    const size_t in_file = dabit_file->available();
+    if (dabit_store.size() + in_file < n)
+      addDaBits(n - dabit_store.size() - in_file);
+    // addDaBits may have gone straight to memory if the file was full
+    if (dabit_store.size() < n)
+      loadDaBits(n - dabit_store.size());
+  } else {
+    addDaBits(n - dabit_store.size());
+  }
 }
 
-BooleanBeaverTriple* CorrelatedStore::getBoolTriple() {
-  checkBoolTriples(1);
-  BooleanBeaverTriple* ans = btriple_store.front();
-  btriple_store.pop();
-  return ans;
+TripleView CorrelatedStore::getBoolTriples(const size_t n_words) {
+  checkBoolTriples(64 * n_words);
+  return btriple_store.take(n_words);
 }
 
-DaBit* CorrelatedStore::getDaBit() {
-  checkDaBits(1);
-  DaBit* ans = dabit_store.front();
-  dabit_store.pop();
-  return ans;
+void CorrelatedStore::checkEdaBits(const size_t n_bits, const size_t n) {
+  const size_t have = edabit_store[n_bits].size();
+  if (have < n) addEdaBits(n_bits, n - have);
+}
+
+void CorrelatedStore::checkArithTriples(const size_t n) {
+  if (atriple_store.size() < n) addArithTriples(n - atriple_store.size());
+}
+
+TripleView CorrelatedStore::getArithTriples(const size_t n) {
+  checkArithTriples(n);
+  return atriple_store.take(n);
 }
 
 void CorrelatedStore::printSizes() {
   std::cout << "Current store sizes:" << std::endl;
   std::cout << " Dabits: " << dabit_store.size() << std::endl;
+  if (dabit_file)
+    std::cout << " Dabits on disk: " << dabit_file->available() << std::endl;
+  if (atriple_store.size() > 0)
+    std::cout << " Arith Triples: " << atriple_store.size() << std::endl;
   // std::cout << " Bool  Triples: " << btriple_store.size() << std::endl;
 }
 
@@ -89,15 +203,16 @@ void CorrelatedStore::maybeUpdate() {
   auto start = clock_start();
 
   // Make top level if stores not enough
-  const bool make_da = dabit_store.size() < (batch_size / 2);
+  const size_t num_dabits = dabit_store.size() + (dabit_file ? dabit_file->available() : 0);
+  const bool make_da = num_dabits < (batch_size / 2);
   // Determine how much of each to make
   const size_t da_target = 2 * make_da;
   const size_t btrip_target = 0;  // NOTE: Currently disabled
 
-  if (btriple_store.size() < btrip_target * batch_size)
+  if (64 * btriple_store.size() < btrip_target * batch_size)
       addBoolTriples(btrip_target * batch_size);
 
-  if (dabit_store.size() < da_target * batch_size)
+  if (num_dabits < da_target * batch_size)
     addDaBits(da_target * batch_size);
 
   printSizes();
@@ -105,57 +220,68 @@ void CorrelatedStore::maybeUpdate() {
   std::cout << "precompute timing : " << sec_from(start) << std::endl;
 }
 
-CorrelatedStore::~CorrelatedStore() {
-  while (!dabit_store.empty()) {
-    DaBit* bit = dabit_store.front();
-    dabit_store.pop();
-    delete bit;
-  }
-  while (!btriple_store.empty()) {
-    BooleanBeaverTriple* triple = btriple_store.front();
-    btriple_store.pop();
-    delete triple;
-  }
-}
+CorrelatedStore::~CorrelatedStore() {}
 
 bool* CorrelatedStore::multiplyBoolShares(const size_t N,
                                           const bool* const x,
                                           const bool* const y) {
-  bool* z = new bool[N];
+  const size_t words = words_for(N);
+  uint64_t* const x_packed = new uint64_t[words];
+  uint64_t* const y_packed = new uint64_t[words];
+  pack_bits(x_packed, x, N);
+  pack_bits(y_packed, y, N);
 
-  bool* d_this = new bool[N];
-  bool* e_this = new bool[N];
+  uint64_t* const z_packed = multiplyBoolShares(N, x_packed, y_packed);
 
-  checkBoolTriples(N);
-  for (unsigned int i = 0; i < N; i++) {
-    BooleanBeaverTriple* triple = getBoolTriple();
-    d_this[i] = x[i] ^ triple->a;
-    e_this[i] = y[i] ^ triple->b;
-    z[i] = triple->c;
-    delete triple;
+  bool* const z = new bool[N];
+  unpack_bits(z, z_packed, N);
+
+  delete[] x_packed;
+  delete[] y_packed;
+  delete[] z_packed;
+  return z;
+}
+
+uint64_t* CorrelatedStore::multiplyBoolShares(const size_t N,
+                                              const uint64_t* const x,
+                                              const uint64_t* const y) {
+  const size_t words = words_for(N);
+  uint64_t* const z = new uint64_t[words];
+
+  uint64_t* const d_this = new uint64_t[words];
+  uint64_t* const e_this = new uint64_t[words];
+
+  const TripleView triple = getBoolTriples(words);
+  for (unsigned int k = 0; k < words; k++) {
+    d_this[k] = x[k] ^ triple.a[k];
+    e_this[k] = y[k] ^ triple.b[k];
+    z[k] = triple.c[k];
   }
+  clear_tail(d_this, N);
+  clear_tail(e_this, N);
+
   pid_t pid = 0;
   int status = 0;
   if (do_fork) pid = fork();
   if (pid == 0) {
-    send_bool_batch(serverfd, d_this, N);
-    send_bool_batch(serverfd, e_this, N);
+    send_packed_bits(serverfd, d_this, N);
+    send_packed_bits(serverfd, e_this, N);
 
     if (do_fork) exit(EXIT_SUCCESS);
   }
 
-  bool* d_other = new bool[N];
-  bool* e_other = new bool[N];
-  recv_bool_batch(serverfd, d_other, N);
-  recv_bool_batch(serverfd, e_other, N);
+  uint64_t* const d_other = new uint64_t[words];
+  uint64_t* const e_other = new uint64_t[words];
+  recv_packed_bits(serverfd, d_other, N);
+  recv_packed_bits(serverfd, e_other, N);
 
-  for (unsigned int i = 0; i < N; i++) {
-    bool d = d_this[i] ^ d_other[i];
-    bool e = e_this[i] ^ e_other[i];
-    z[i] ^= (x[i] and e) ^ (y[i] and d);
-    if (server_num == 0)
-      z[i] ^= (d and e);
+  const uint64_t de_mask = (server_num == 0 ? ~0ULL : 0);
+  for (unsigned int k = 0; k < words; k++) {
+    const uint64_t d = d_this[k] ^ d_other[k];
+    const uint64_t e = e_this[k] ^ e_other[k];
+    z[k] ^= (x[k] & e) ^ (y[k] & d) ^ (d & e & de_mask);
   }
+  clear_tail(z, N);
 
   delete[] d_this;
   delete[] e_this;
@@ -166,99 +292,173 @@ bool* CorrelatedStore::multiplyBoolShares(const size_t N,
   return z;
 }
 
-// c_{i+1} = c_i xor ((x_i xor c_i) and (y_i xor c_i))
-// output z_i = x_i xor y_i xor c_i
-// Unused
 bool* CorrelatedStore::addBinaryShares(const size_t N,
                                        const size_t* const num_bits,
                                        const bool* const * const x,
                                        const bool* const * const y,
                                        bool* const * const z) {
-  bool* carry = new bool[N];
-  memset(carry, false, N);
-  bool* xi = new bool[N];
-  bool* yi = new bool[N];
+  const size_t words = words_for(N);
 
   size_t max_bits = 0;
-  size_t total_bits = 0;
-  for (unsigned int i = 0; i < N; i++) {
+  for (unsigned int i = 0; i < N; i++)
     max_bits = (num_bits[i] > max_bits ? num_bits[i] : max_bits);
-    total_bits += num_bits[i];
+
+  uint64_t* const xs = new uint64_t[max_bits * words];
+  uint64_t* const ys = new uint64_t[max_bits * words];
+  uint64_t* const zs = new uint64_t[max_bits * words];
+  memset(xs, 0, max_bits * words * sizeof(uint64_t));
+  memset(ys, 0, max_bits * words * sizeof(uint64_t));
+  for (unsigned int i = 0; i < N; i++) {
+    for (unsigned int j = 0; j < num_bits[i]; j++) {
+      xs[j * words + i / 64] |= ((uint64_t) x[i][j]) << (i % 64);
+      ys[j * words + i / 64] |= ((uint64_t) y[i][j]) << (i % 64);
+    }
   }
 
-  checkBoolTriples(total_bits);
+  uint64_t* const carry = addBinaryShares(N, num_bits, xs, ys, zs);
 
-  for (unsigned int j = 0; j < max_bits; j++) {
-    size_t idx = 0;
-    for (unsigned int i = 0; i < N; i++) {
-      if (j >= num_bits[i])
-        continue;
-      z[i][j] = carry[i] ^ x[i][j] ^ y[i][j];
-      xi[idx] = carry[i] ^ x[i][j];
-      yi[idx] = carry[i] ^ y[i][j];
-      idx++;
-    }
+  for (unsigned int i = 0; i < N; i++)
+    for (unsigned int j = 0; j < num_bits[i]; j++)
+      z[i][j] = get_bit(zs + j * words, i);
+  bool* const ret = new bool[N];
+  unpack_bits(ret, carry, N);
 
-    bool* new_carry = multiplyBoolShares(idx, xi, yi);
+  delete[] xs;
+  delete[] ys;
+  delete[] zs;
+  delete[] carry;
 
-    idx = 0;
-    for (unsigned int i = 0; i < N; i++) {
-      if (j >= num_bits[i])
-        continue;
-      carry[i] ^= new_carry[idx];
-      idx++;
+  return ret;
+}
+
+// Kogge-Stone parallel prefix.
+// Per bit, generate g_j = x_j y_j and propagate p_j = x_j xor y_j.
+// Then log rounds of, for span d:
+//   G_j = G_j xor (P_j and G_{j-d}),  P_j = P_j and P_{j-d}
+// G and P AND can be xor as a span can't both generate and propagate.
+// After, G_j is the carry out of bit j, so z_j = p_j xor G_{j-1}.
+// Bits past num_bits[i] have g = p = 0, so the carry out of value i is read at num_bits[i] - 1.
+uint64_t* CorrelatedStore::addBinaryShares(const size_t N,
+                                           const size_t* const num_bits,
+                                           const uint64_t* const x,
+                                           const uint64_t* const y,
+                                           uint64_t* const z) {
+  const size_t words = words_for(N);
+
+  size_t max_bits = 0;
+  for (unsigned int i = 0; i < N; i++)
+    max_bits = (num_bits[i] > max_bits ? num_bits[i] : max_bits);
+
+  const size_t len = max_bits * words;
+  uint64_t* const P = new uint64_t[len];
+  for (unsigned int k = 0; k < len; k++)
+    P[k] = x[k] ^ y[k];
+  uint64_t* const G = multiplyBoolShares(64 * len, x, y);
+
+  // p_j, kept for the sum
+  memcpy(z, P, len * sizeof(uint64_t));
+
+  uint64_t* const lhs = new uint64_t[2 * len];
+  uint64_t* const rhs = new uint64_t[2 * len];
+  for (size_t d = 1; d < max_bits; d *= 2) {
+    // P is needed again only if there is another round
+    const bool more = (2 * d < max_bits);
+    const size_t span = (max_bits - d) * words;
+
+    // lhs = [P_j, P_j], rhs = [G_{j-d}, P_{j-d}], for j >= d
+    memcpy(lhs, P + d * words, span * sizeof(uint64_t));
+    memcpy(rhs, G, span * sizeof(uint64_t));
+    if (more) {
+      memcpy(lhs + span, P + d * words, span * sizeof(uint64_t));
+      memcpy(rhs + span, P, span * sizeof(uint64_t));
     }
 
-    delete[] new_carry;
+    uint64_t* const prod = multiplyBoolShares(64 * span * (more ? 2 : 1), lhs, rhs);
+
+    for (unsigned int k = 0; k < span; k++)
+      G[d * words + k] ^= prod[k];
+    if (more)
+      memcpy(P + d * words, prod + span, span * sizeof(uint64_t));
+
+    delete[] prod;
   }
 
-  delete[] xi;
-  delete[] yi;
+  // z_j = p_j xor G_{j-1}
+  for (unsigned int k = words; k < len; k++)
+    z[k] ^= G[k - words];
+
+  uint64_t* const carry = new uint64_t[words];
+  memset(carry, 0, words * sizeof(uint64_t));
+  for (unsigned int i = 0; i < N; i++)
+    if (num_bits[i] > 0 and get_bit(G + (num_bits[i] - 1) * words, i))
+      carry[i / 64] |= 1ULL << (i % 64);
+
+  delete[] P;
+  delete[] G;
+  delete[] lhs;
+  delete[] rhs;
 
   return carry;
 }
 
+// out[i] = v[i] ? (server_num - bp[i]) : bp[i], mod p, with v packed.
+// [x]_p = v + [b]_p - 2 v [b]_p. Note v only added for one server.
+// Branch free, so the compiler can vectorize it.
+static void b2a_dabit_kernel(const size_t N, const uint64_t mod,
+                             const int server_num, const uint64_t* const v,
+                             const uint64_t* const bp, uint64_t* const out) {
+  for (size_t i = 0; i < N; i++) {
+    const uint64_t mask = 0 - ((v[i / 64] >> (i % 64)) & 1);
+    uint64_t neg = server_num + (mod - bp[i]);
+    neg = (neg >= mod ? neg - mod : neg);
+    out[i] = bp[i] ^ ((bp[i] ^ neg) & mask);
+  }
+}
+
 fmpz_t* CorrelatedStore::b2a_daBit_single(const size_t N, const bool* const x) {
-  fmpz_t* xp; new_fmpz_array(&xp, N);
+  uint64_t* const x_packed = new uint64_t[words_for(N)];
+  pack_bits(x_packed, x, N);
+  fmpz_t* const xp = b2a_daBit_single(N, x_packed);
+  delete[] x_packed;
+  return xp;
+}
+
+fmpz_t* CorrelatedStore::b2a_daBit_single(const size_t N, const uint64_t* const x) {
+  const size_t words = words_for(N);
 
   checkDaBits(N);
+  const DaBitView dabit = dabit_store.take(N);
 
-  bool* v_this = new bool[N];
-  for (unsigned int i = 0; i < N; i++) {
-    DaBit* dabit = getDaBit();
-    v_this[i] = x[i] ^ dabit->b2;
-
-    fmpz_set(xp[i], dabit->bp);
-    // consume the daBit
-    delete dabit;
-  }
+  // v = x ^ [b]_2, a word at a time
+  uint64_t* const v_this = new uint64_t[words];
+  for (unsigned int k = 0; k < words; k++)
+    v_this[k] = x[k] ^ load_word(dabit.b2, dabit.offset + 64 * k);
+  clear_tail(v_this, N);
 
   pid_t pid = 0;
   int status = 0;
   if (do_fork) pid = fork();
   if (pid == 0) {
-    send_bool_batch(serverfd, v_this, N);
+    send_packed_bits(serverfd, v_this, N);
 
     if (do_fork) exit(EXIT_SUCCESS);
   }
-  bool* v_other = new bool[N];
-  recv_bool_batch(serverfd, v_other, N);
+  uint64_t* const v_other = new uint64_t[words];
+  recv_packed_bits(serverfd, v_other, N);
 
-  for (unsigned int i = 0; i < N; i++) {
-    const bool v = v_this[i] ^ v_other[i];
-
-    // [x]_p = v + [b]_p - 2 v [b]_p. Note v only added for one server.
-    // So since server_num in {0, 1}, we add it when v = 1
-    // Currently, [x]_p is holding [b]_p, which is what we want for v = 0
-    if (v) {  // If v = 1, then [x]_p = (0/1) - [b]_p
-      fmpz_neg(xp[i], xp[i]);
-      fmpz_add_ui(xp[i], xp[i], server_num);
-      fmpz_mod(xp[i], xp[i], Int_Modulus);
-    }
-  }
+  for (unsigned int k = 0; k < words; k++)
+    v_this[k] ^= v_other[k];
+
+  uint64_t* const out = new uint64_t[N];
+  b2a_dabit_kernel(N, fmpz_get_ui(Int_Modulus), server_num, v_this, dabit.bp, out);
+
+  fmpz_t* xp; new_fmpz_array(&xp, N);
+  for (unsigned int i = 0; i < N; i++)
+    fmpz_set_ui(xp[i], out[i]);
 
   delete[] v_this;
   delete[] v_other;
+  delete[] out;
 
   if (do_fork) waitpid(pid, &status, 0);
 
@@ -302,6 +502,100 @@ fmpz_t* CorrelatedStore::b2a_daBit_multi(const size_t N,
   return xp;
 }
 
+// [x]_2 + [r]_2 = c + 2^n k, with c opened and k the carry out.
+// So [x]_p = c - [r]_p + 2^n [k]_p, with c only added by server 0.
+// Only bits below num_bits[i] of c are opened. Past that, a shorter value's
+// slices hold its carry, which has to stay shared.
+fmpz_t* CorrelatedStore::b2a_edaBit(const size_t N,
+                                    const size_t* const num_bits,
+                                    const fmpz_t* const x) {
+  const size_t words = words_for(N);
+
+  // All checks before any take, so adds can't move views
+  std::map<size_t, size_t> count;
+  size_t max_bits = 0;
+  for (unsigned int i = 0; i < N; i++) {
+    count[num_bits[i]]++;
+    max_bits = (num_bits[i] > max_bits ? num_bits[i] : max_bits);
+  }
+  for (const auto& pair : count)
+    checkEdaBits(pair.first, pair.second);
+  checkDaBits(N);
+  checkBoolTriples(64 * words * max_bits * (LOG2(max_bits) + 1) * 2);
+
+  std::map<size_t, EdaBitView> views;
+  for (const auto& pair : count) {
+    views[pair.first] = edabit_store[pair.first].take(pair.second);
+    count[pair.first] = 0;  // Now how many used
+  }
+
+  // Bit slice x and r, for the adder
+  const size_t len = max_bits * words;
+  uint64_t* const xs = new uint64_t[len];
+  uint64_t* const rs = new uint64_t[len];
+  uint64_t* const zs = new uint64_t[len];
+  uint64_t* const active = new uint64_t[len];
+  memset(xs, 0, len * sizeof(uint64_t));
+  memset(rs, 0, len * sizeof(uint64_t));
+  memset(active, 0, len * sizeof(uint64_t));
+  uint64_t* const rp = new uint64_t[N];
+  for (unsigned int i = 0; i < N; i++) {
+    const size_t idx = count[num_bits[i]]++;
+    const uint64_t r = views[num_bits[i]].b2[idx];
+    rp[i] = views[num_bits[i]].rp[idx];
+    const uint64_t xi = fmpz_get_ui(x[i]);
+    for (unsigned int j = 0; j < num_bits[i]; j++) {
+      xs[j * words + i / 64] |= ((xi >> j) & 1) << (i % 64);
+      rs[j * words + i / 64] |= ((r >> j) & 1) << (i % 64);
+      active[j * words + i / 64] |= 1ULL << (i % 64);
+    }
+  }
+
+  uint64_t* const carry = addBinaryShares(N, num_bits, xs, rs, zs);
+  for (unsigned int k = 0; k < len; k++)
+    zs[k] &= active[k];
+  delete[] active;
+
+  // Open the masked sum
+  pid_t pid = 0;
+  int status = 0;
+  if (do_fork) pid = fork();
+  if (pid == 0) {
+    send_packed_bits(serverfd, zs, 64 * len);
+
+    if (do_fork) exit(EXIT_SUCCESS);
+  }
+  uint64_t* const zs_other = new uint64_t[len];
+  recv_packed_bits(serverfd, zs_other, 64 * len);
+  if (do_fork) waitpid(pid, &status, 0);
+
+  fmpz_t* const kp = b2a_daBit_single(N, carry);
+
+  fmpz_t* xp; new_fmpz_array(&xp, N);
+  for (unsigned int i = 0; i < N; i++) {
+    uint64_t c = 0;
+    for (unsigned int j = 0; j < num_bits[i]; j++)
+      c |= ((uint64_t) (get_bit(zs + j * words, i) ^ get_bit(zs_other + j * words, i))) << j;
+
+    fmpz_set_ui(xp[i], (server_num == 0 ? c : 0));
+    fmpz_sub_ui(xp[i], xp[i], rp[i]);
+    // 2^n can be 2^64
+    fmpz_mul_2exp(kp[i], kp[i], num_bits[i]);
+    fmpz_add(xp[i], xp[i], kp[i]);
+    fmpz_mod(xp[i], xp[i], Int_Modulus);
+  }
+
+  delete[] xs;
+  delete[] rs;
+  delete[] zs;
+  delete[] zs_other;
+  delete[] rp;
+  delete[] carry;
+  clear_fmpz_array(kp, N);
+
+  return xp;
+}
+
 // Using intsum_ot, multiple bits
 fmpz_t* CorrelatedStore::b2a_ot(const size_t num_shares, const size_t num_values,
                                 const size_t* const num_bits,
@@ -341,25 +635,35 @@ fmpz_t* CorrelatedStore::b2a_ot(const size_t num_shares, const size_t num_values
   return ans;
 }
 
+void CorrelatedStore::b2a_ot_sum(const size_t num_shares, const size_t num_values,
+                                 const size_t* const num_bits,
+                                 const uint64_t* const shares,
+                                 const bool* const valid, fmpz_t* const ans,
+                                 const size_t mod) {
+  uint64_t* const sum = new uint64_t[num_values];
+  if (server_num == 0)
+    intsum_ot_sender_sum(ot0, shares, valid, num_bits, num_shares, num_values, mod, sum);
+  else
+    intsum_ot_receiver_sum(ot0, shares, valid, num_bits, num_shares, num_values, mod, sum);
+  for (unsigned int j = 0; j < num_values; j++)
+    fmpz_set_ui(ans[j], sum[j]);
+  delete[] sum;
+}
+
 // Use b2A via OT on random bit
 // Nearly COT, except delta is changing
 // random choice and random base, but also random delta matters
-DaBit** CorrelatedStore::generateDaBit(const size_t N) {
-  DaBit** const dabit = new DaBit*[N];
-
+void CorrelatedStore::generateDaBit(const size_t N, uint64_t* const bp,
+                                    uint64_t* const b2) {
   emp::PRG prg;
   const size_t mod = fmpz_get_ui(Int_Modulus);
 
   bool* const b = new bool[N];
   prg.random_bool(b, N);  // random bits
+  pack_bits(b2, b, N);
 
   uint64_t* const x = new uint64_t[N];
 
-  for (unsigned int i = 0; i < N; i++) {
-    dabit[i] = new DaBit();
-    dabit[i]->b2 = b[i];
-  }
-
   if (server_num == 0) {
     uint64_t* const b0 = new uint64_t[N];
     uint64_t* const b1 = new uint64_t[N];
@@ -375,13 +679,133 @@ DaBit** CorrelatedStore::generateDaBit(const size_t N) {
   } else {
     ot0->recv(x, b, N);
   }
-  for (unsigned int i = 0; i < N; i++) {
-    uint64_t bp = (b[i] + 2 * (mod - x[i])) % mod;
-    fmpz_set_ui(dabit[i]->bp, bp);
-  }
+  for (unsigned int i = 0; i < N; i++)
+    bp[i] = (b[i] + 2 * (mod - x[i])) % mod;
 
   delete[] b;
   delete[] x;
+}
+
+DaBitPool::~DaBitPool() {
+  delete[] bp;
+  delete[] b2;
+}
+
+void DaBitPool::reserve(const size_t n) {
+  if (tail + n <= cap)
+    return;
+
+  // Shift live daBits down to the first word, keeping the bit offset
+  const size_t live = size();
+  const size_t first_word = head / 64;
+  const size_t new_head = head % 64;
+  const size_t live_words = words_for(tail) - first_word;
+  const size_t need = new_head + live + n;
+
+  if (need <= cap) {
+    memmove(bp + new_head, bp + head, live * sizeof(uint64_t));
+    memmove(b2, b2 + first_word, live_words * sizeof(uint64_t));
+  } else {
+    const size_t new_cap = 64 * words_for(need > 2 * cap ? need : 2 * cap);
+    uint64_t* const new_bp = new uint64_t[new_cap];
+    uint64_t* const new_b2 = new uint64_t[new_cap / 64 + 1];
+    if (live > 0) {
+      memcpy(new_bp + new_head, bp + head, live * sizeof(uint64_t));
+      memcpy(new_b2, b2 + first_word, live_words * sizeof(uint64_t));
+    }
+    delete[] bp;
+    delete[] b2;
+    bp = new_bp;
+    b2 = new_b2;
+    cap = new_cap;
+  }
+  head = new_head;
+  tail = new_head + live;
+}
+
+void DaBitPool::append(const size_t n, const uint64_t* const new_bp,
+                       const uint64_t* const new_b2) {
+  if (n == 0)
+    return;
+  reserve(n);
+
+  memcpy(bp + tail, new_bp, n * sizeof(uint64_t));
+
+  // Splice bits in at tail. Words past tail are overwritten, so stale bits don't leak in.
+  const size_t q = tail / 64, r = tail % 64;
+  const size_t words = words_for(n);
+  if (r == 0) {
+    memcpy(b2 + q, new_b2, words * sizeof(uint64_t));
+  } else {
+    b2[q] &= (1ULL << r) - 1;
+    for (unsigned int k = 0; k < words; k++) {
+      b2[q + k] |= new_b2[k] << r;
+      b2[q + k + 1] = new_b2[k] >> (64 - r);
+    }
+  }
+  tail += n;
+  clear_tail(b2, tail);
+}
+
+DaBitView DaBitPool::take(const size_t n) {
+  if (n > size()) error_exit("DaBitPool: not enough daBits");
+  DaBitView view = {bp + head, b2, head, n};
+  head += n;
+  return view;
+}
+
+WordPool::WordPool(const size_t num_cols)
+: num_cols(num_cols)
+, cols(new uint64_t*[num_cols])
+{
+  for (unsigned int j = 0; j < num_cols; j++)
+    cols[j] = nullptr;
+}
+
+WordPool::~WordPool() {
+  for (unsigned int j = 0; j < num_cols; j++)
+    delete[] cols[j];
+  delete[] cols;
+}
+
+void WordPool::reserve(const size_t n) {
+  if (tail + n <= cap)
+    return;
+
+  const size_t live = size();
+  const size_t need = live + n;
+
+  if (need <= cap) {
+    for (unsigned int j = 0; j < num_cols; j++)
+      memmove(cols[j], cols[j] + head, live * sizeof(uint64_t));
+  } else {
+    const size_t new_cap = (need > 2 * cap ? need : 2 * cap);
+    for (unsigned int j = 0; j < num_cols; j++) {
+      uint64_t* const new_col = new uint64_t[new_cap];
+      if (live > 0)
+        memcpy(new_col, cols[j] + head, live * sizeof(uint64_t));
+      delete[] cols[j];
+      cols[j] = new_col;
+    }
+    cap = new_cap;
+  }
+  head = 0;
+  tail = live;
+}
+
+void WordPool::append_cols(const size_t n,
+                           const uint64_t* const * const new_cols) {
+  if (n == 0)
+    return;
+  reserve(n);
+  for (unsigned int j = 0; j < num_cols; j++)
+    memcpy(cols[j] + tail, new_cols[j], n * sizeof(uint64_t));
+  tail += n;
+}
 
-  return dabit;
+void WordPool::take_cols(const size_t n, const uint64_t** const ptrs) {
+  if (n > size()) error_exit("WordPool: not enough in pool");
+  for (unsigned int j = 0; j < num_cols; j++)
+    ptrs[j] = cols[j] + head;
+  head += n;
 }
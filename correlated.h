@@ -12,19 +12,136 @@ New batches are build either as it runs out, or by calling maybeUpdate
 
 For now, only uses DaBits for b2a Share conversion.
 boolean beaver triples are supported as they are straightforward, but not currently made.
+They are bit-sliced, 64 per word, and handed out a word at a time.
+Arithmetic beaver triples mod Int_Modulus are made by OT too, for checks that would otherwise need client triples.
 
 Due to send buffers potentially filling up, it forks out a child to do sending, while parent receives
 It also waits for the child to finish before exiting or moving to a substep that will send, to stay synced
+
+Optionally, daBits can be backed by a PersistentStore, so precomputes survive restarts.
+New daBits then go to the file, and are pulled into memory right before use.
 */
 
 #include <emp-ot/emp-ot.h>
 #include <emp-tool/emp-tool.h>
-#include <queue>
+#include <map>
 
 #include "constants.h"
 #include "ot.h"
+#include "persist.h"
 #include "share.h"
 
+// A view of n daBits taken from a DaBitPool.
+// Valid until the next append to the pool.
+struct DaBitView {
+  const uint64_t* bp;  // [n], [b]_p
+  const uint64_t* b2;  // [b]_2, packed, starting at bit offset
+  size_t offset;
+  size_t n;
+};
+
+// Contiguous daBit storage, as a structure of arrays.
+// [b]_p as words, [b]_2 packed 64 per word.
+// Taken in bulk from the front, appended to the back, and shifted down to reuse space on refill.
+class DaBitPool {
+  uint64_t* bp = nullptr;
+  uint64_t* b2 = nullptr;  // has one spare word, so load_word can read past the end
+  size_t cap = 0;          // in daBits, multiple of 64
+  size_t head = 0;         // first live daBit
+  size_t tail = 0;         // one past last live daBit
+
+  // Make room for n more at the back
+  void reserve(const size_t n);
+
+public:
+  ~DaBitPool();
+
+  size_t size() const { return tail - head; }
+
+  // new_b2 is packed from bit 0
+  void append(const size_t n, const uint64_t* const new_bp,
+              const uint64_t* const new_b2);
+
+  // Marks the next n used, and returns them. Fails if not enough.
+  DaBitView take(const size_t n);
+};
+
+// Columns of words, taken in bulk from the front and appended to the back.
+// Same layout idea as DaBitPool, but always whole words.
+class WordPool {
+  const size_t num_cols;
+  uint64_t** const cols;
+  size_t cap = 0;
+  size_t head = 0;
+  size_t tail = 0;
+
+  void reserve(const size_t n);
+
+public:
+  WordPool(const size_t num_cols);
+  ~WordPool();
+
+  size_t size() const { return tail - head; }
+
+  // new_cols is [num_cols][n]
+  void append_cols(const size_t n, const uint64_t* const * const new_cols);
+
+  // Marks the next n used, and sets ptrs[j] to them in column j.
+  // Valid until the next append.
+  void take_cols(const size_t n, const uint64_t** const ptrs);
+};
+
+// Triples taken from a TriplePool, as [n] word arrays.
+struct TripleView {
+  const uint64_t* a;
+  const uint64_t* b;
+  const uint64_t* c;
+};
+
+// Beaver triples, as three word columns.
+// For boolean triples, each word is 64 bit-sliced triples. For arithmetic ones, one triple mod p.
+class TriplePool : public WordPool {
+public:
+  TriplePool() : WordPool(3) {}
+
+  void append(const size_t n, const uint64_t* const a,
+              const uint64_t* const b, const uint64_t* const c) {
+    const uint64_t* const cols[3] = {a, b, c};
+    append_cols(n, cols);
+  }
+
+  TripleView take(const size_t n) {
+    const uint64_t* ptrs[3];
+    take_cols(n, ptrs);
+    TripleView view = {ptrs[0], ptrs[1], ptrs[2]};
+    return view;
+  }
+};
+
+// edaBits taken from an EdaBitPool
+struct EdaBitView {
+  const uint64_t* b2;  // [n], bits [r_j]_2 of each, packed in a word
+  const uint64_t* rp;  // [n], [r]_p
+};
+
+// edaBits of a single bit length
+class EdaBitPool : public WordPool {
+public:
+  EdaBitPool() : WordPool(2) {}
+
+  void append(const size_t n, const uint64_t* const b2, const uint64_t* const rp) {
+    const uint64_t* const cols[2] = {b2, rp};
+    append_cols(n, cols);
+  }
+
+  EdaBitView take(const size_t n) {
+    const uint64_t* ptrs[2];
+    take_cols(n, ptrs);
+    EdaBitView view = {ptrs[0], ptrs[1]};
+    return view;
+  }
+};
+
 // A Cache of correlated bits of different types
 // Makes batch_size at once, when running low
 class CorrelatedStore {
@@ -35,16 +152,33 @@ class CorrelatedStore {
   // If lazy, does fast but insecure offline.
   const bool lazy;
 
-  std::queue<DaBit*> dabit_store;
-  std::queue<BooleanBeaverTriple*> btriple_store;
+  DaBitPool dabit_store;
+  TriplePool btriple_store;  // in words, so 64 triples each
+  TriplePool atriple_store;  // arithmetic, mod Int_Modulus
+  // edaBits, by bit length. Ordered, so both servers walk it the same way.
+  std::map<size_t, EdaBitPool> edabit_store;
 
-  // return N new daBits
-  DaBit** generateDaBit(const size_t N);
+  // If set, new daBits are stored here instead, as {bp, b2} records.
+  PersistentStore* dabit_file = nullptr;
+
+  // Add made daBits to the file if there's space, else memory. b2 is packed.
+  void storeDaBits(const size_t n, const uint64_t* const bp,
+                   const uint64_t* const b2);
+  // Move n daBits from the file to memory
+  void loadDaBits(const size_t n);
+
+  // Make N new daBits, into bp[N] and packed b2[words_for(N)]
+  void generateDaBit(const size_t N, uint64_t* const bp, uint64_t* const b2);
 
   // add to the store.
   // Adds at least batch_size (or bool_batch_size), or n if bigger
+  // n counts triples, rounded up to words
   void addBoolTriples(const size_t n = 0);
   void addDaBits(const size_t n = 0);
+  void addArithTriples(const size_t n = 0);
+  // edaBits of n_bits bits. Each server picks random bits as its share of r,
+  // then [r]_p comes from the OT conversion.
+  void addEdaBits(const size_t n_bits, const size_t n = 0);
 
   OT_Wrapper* const ot0;
   OT_Wrapper* const ot1;
@@ -74,17 +208,24 @@ public:
 
   ~CorrelatedStore();
 
-  // get from store, and maybe add if necessary
-  BooleanBeaverTriple* getBoolTriple();
-  DaBit* getDaBit();
+  // Back daBits by file. Syncs with the other server, so both must call.
+  // Does not take ownership.
+  void attachDaBitFile(PersistentStore* const store);
+
+  // get n_words words of triples from store, and maybe add if necessary
+  TripleView getBoolTriples(const size_t n_words);
+  TripleView getArithTriples(const size_t n);
 
   void printSizes();
   // Precompute if not enough.
   void maybeUpdate();
 
   // check if enough to make n. if not, call add
+  // For bool triples, n is number of triples
   void checkBoolTriples(const size_t n = 0);
   void checkDaBits(const size_t n = 0);
+  void checkArithTriples(const size_t n = 0);
+  void checkEdaBits(const size_t n_bits, const size_t n = 0);
 
   // compute with store elements. Does batches of size N.
 
@@ -92,28 +233,53 @@ public:
   // does ret[i] = x[i] * y[i], as shares
   bool* multiplyBoolShares(const size_t N,
                            const bool* const x, const bool* const y);
+  // Same, on N bits packed 64 per word. One round for all of them.
+  uint64_t* multiplyBoolShares(const size_t N,
+                               const uint64_t* const x, const uint64_t* const y);
 
   // x, y, z are [N][num_bits], ret is [N]
   // Treats x[i], y[i], z[i] as array of bits
   // sets z[i] and ret[i] as x[i] + y[i] and carry[i], as shares
-  // Currently unused
+  // Kogge-Stone, so 1 + ceil(log2(max num_bits)) rounds, batched over all N
   bool* addBinaryShares(const size_t N, const size_t* const num_bits,
                         const bool* const * const x, const bool* const * const y,
                         bool* const * const z);
+  // Bit-sliced version. x, y, z are [max_bits][words_for(N)] words,
+  // so slice j holds bit j of every value. Bits past num_bits[i] must be 0.
+  // ret is the packed carry out.
+  uint64_t* addBinaryShares(const size_t N, const size_t* const num_bits,
+                            const uint64_t* const x, const uint64_t* const y,
+                            uint64_t* const z);
 
   // x, ret is [N]
   // Turns binary share x[i] into arith share ret[i]
   // Single bit. One round.
   fmpz_t* b2a_daBit_single(const size_t N, const bool* const x);
+  // Same, with x already packed
+  fmpz_t* b2a_daBit_single(const size_t N, const uint64_t* const x);
   // Multiple bits. Use a dabit per bit in parallel, so one round
   fmpz_t* b2a_daBit_multi(const size_t N, const size_t* const num_bits,
                           const fmpz_t* const x);
 
+  // Multiple bits, using one edaBit of the same length per value.
+  // Adds x + r in binary, opens it, and fixes the wraparound with a daBit on the carry.
+  // So a daBit per value instead of per bit, for log(num_bits) + 2 rounds.
+  fmpz_t* b2a_edaBit(const size_t N, const size_t* const num_bits,
+                     const fmpz_t* const x);
+
   // Using intsum_ot, multiple bits
   // TODO: shift mod to fmpz
   fmpz_t* b2a_ot(const size_t num_shares, const size_t num_values,
                  const size_t* const num_bits, const fmpz_t* const shares,
                  const size_t mod = 0);
+
+  // b2a_ot fused with the sum over valid shares, for ops that only need the total.
+  // shares is flat [num_shares * num_values], ans is [num_values].
+  // valid must match across servers.
+  void b2a_ot_sum(const size_t num_shares, const size_t num_values,
+                  const size_t* const num_bits, const uint64_t* const shares,
+                  const bool* const valid, fmpz_t* const ans,
+                  const size_t mod = 0);
 };
 
 #endif
@@ -0,0 +1,158 @@
+#include "dpf.h"
+
+#include <emp-tool/emp-tool.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "utils.h"
+
+// Public fixed AES keys: left child, right child, leaf output
+struct DPFKeys {
+  emp::AES_KEY aes[3];
+
+  DPFKeys() {
+    for (unsigned int i = 0; i < 3; i++)
+      emp::AES_set_encrypt_key(emp::makeBlock(0x5052494f44504630ULL, i), &aes[i]);
+  }
+};
+
+static const DPFKeys& dpf_keys() {
+  static const DPFKeys keys;
+  return keys;
+}
+
+static bool lsb(const emp::block b) {
+  return _mm_cvtsi128_si64(b) & 1;
+}
+
+static emp::block clear_lsb(const emp::block b) {
+  return _mm_and_si128(b, _mm_set_epi64x(-1, -2));
+}
+
+// Matyas-Meyer-Oseas, out[i] = AES_k(in[i]) ^ in[i]
+static void hash_blocks(const unsigned int k, const emp::block* const in,
+                        emp::block* const out, const size_t n) {
+  memcpy(out, in, n * sizeof(emp::block));
+  emp::AES_ecb_encrypt_blks(out, n, &dpf_keys().aes[k]);
+  for (unsigned int i = 0; i < n; i++)
+    out[i] = _mm_xor_si128(out[i], in[i]);
+}
+
+// 128 bits mod p, so the bias is 2^-64. mod 0 is 2^64.
+static uint64_t to_mod(const emp::block b, const uint64_t mod) {
+  uint64_t w[2];
+  memcpy(w, &b, sizeof(w));
+  if (mod == 0)
+    return w[0];
+  return (uint64_t) ((((unsigned __int128) w[1] << 64) | w[0]) % mod);
+}
+
+static uint64_t convert(const emp::block s, const uint64_t mod) {
+  emp::block h;
+  hash_blocks(2, &s, &h, 1);
+  return to_mod(h, mod);
+}
+
+void dpf_gen(const size_t depth, const uint64_t alpha, const uint64_t beta,
+             const uint64_t mod, uint64_t* const key0, uint64_t* const key1) {
+  emp::PRG prg;
+  emp::block s[2];
+  prg.random_block(s, 2);
+  s[0] = clear_lsb(s[0]);
+  s[1] = clear_lsb(s[1]);
+  bool t[2] = {false, true};
+  memcpy(&key0[0], &s[0], sizeof(emp::block));
+  memcpy(&key1[0], &s[1], sizeof(emp::block));
+
+  emp::block child[2][2];  // [server][left / right]
+  bool tc[2][2];
+  for (unsigned int l = 0; l < depth; l++) {
+    const bool bit = (alpha >> (depth - 1 - l)) & 1;
+    for (unsigned int b = 0; b < 2; b++) {
+      for (unsigned int c = 0; c < 2; c++) {
+        hash_blocks(c, &s[b], &child[b][c], 1);
+        tc[b][c] = lsb(child[b][c]);
+        child[b][c] = clear_lsb(child[b][c]);
+      }
+    }
+
+    // Off path children become equal, on path ones stay different
+    const emp::block s_cw = _mm_xor_si128(child[0][!bit], child[1][!bit]);
+    const bool t_cw[2] = {(bool) (tc[0][0] ^ tc[1][0] ^ bit ^ 1),
+                          (bool) (tc[0][1] ^ tc[1][1] ^ bit)};
+    const size_t idx = 2 + 3 * l;
+    memcpy(&key0[idx], &s_cw, sizeof(emp::block));
+    memcpy(&key1[idx], &s_cw, sizeof(emp::block));
+    key0[idx + 2] = key1[idx + 2] = t_cw[0] | (t_cw[1] << 1);
+
+    for (unsigned int b = 0; b < 2; b++) {
+      s[b] = t[b] ? _mm_xor_si128(child[b][bit], s_cw) : child[b][bit];
+      t[b] = tc[b][bit] ^ (t[b] & t_cw[bit]);
+    }
+  }
+
+  // Server 1 negates its output, so shares add to beta at alpha
+  const uint64_t cw = addmod(submod(beta, convert(s[0], mod), mod),
+                             convert(s[1], mod), mod);
+  key0[3 * depth + 2] = key1[3 * depth + 2] = t[1] ? submod(0, cw, mod) : cw;
+}
+
+void dpf_eval_all(const int server_num, const size_t depth,
+                  const uint64_t* const key, const size_t n,
+                  const uint64_t mod, uint64_t* const out) {
+  if (n == 0)
+    return;
+
+  emp::block* seeds = new emp::block[n];
+  emp::block* next = new emp::block[n];
+  emp::block* const left = new emp::block[n];
+  emp::block* const right = new emp::block[n];
+  bool* t = new bool[n];
+  bool* t_next = new bool[n];
+
+  memcpy(&seeds[0], &key[0], sizeof(emp::block));
+  t[0] = (server_num == 1);
+  size_t m = 1;  // nodes in this level that lead to [0, n)
+  for (unsigned int l = 0; l < depth; l++) {
+    const size_t m_next = ((n - 1) >> (depth - 1 - l)) + 1;
+    emp::block s_cw;
+    memcpy(&s_cw, &key[2 + 3 * l], sizeof(emp::block));
+    const bool t_cw[2] = {(bool) (key[4 + 3 * l] & 1), (bool) ((key[4 + 3 * l] >> 1) & 1)};
+
+    hash_blocks(0, seeds, left, m);
+    hash_blocks(1, seeds, right, m);
+    for (unsigned int i = 0; i < m; i++) {
+      for (unsigned int c = 0; c < 2 and 2 * i + c < m_next; c++) {
+        const emp::block h = (c == 0 ? left[i] : right[i]);
+        emp::block s = clear_lsb(h);
+        bool tb = lsb(h);
+        if (t[i]) {
+          s = _mm_xor_si128(s, s_cw);
+          tb ^= t_cw[c];
+        }
+        next[2 * i + c] = s;
+        t_next[2 * i + c] = tb;
+      }
+    }
+    std::swap(seeds, next);
+    std::swap(t, t_next);
+    m = m_next;
+  }
+
+  const uint64_t cw = key[3 * depth + 2];
+  hash_blocks(2, seeds, left, n);
+  for (unsigned int i = 0; i < n; i++) {
+    uint64_t y = to_mod(left[i], mod);
+    if (t[i])
+      y = addmod(y, cw, mod);
+    out[i] = (server_num == 1) ? submod(0, y, mod) : y;
+  }
+
+  delete[] seeds;
+  delete[] next;
+  delete[] left;
+  delete[] right;
+  delete[] t;
+  delete[] t_next;
+}
@@ -0,0 +1,48 @@
+#ifndef DPF_H
+#define DPF_H
+
+/*
+Distributed point functions, for compact one-hot submissions.
+Tree construction of Boyle, Gilboa, Ishai '16.
+
+gen makes a pair of keys for point alpha in [0, 2^depth) and value beta mod p.
+Expanding both and adding mod p gives beta at alpha and 0 everywhere else,
+while each key on its own looks random.
+So a client sends O(depth) blocks per server instead of a 2^depth bit vector,
+and servers get arithmetic shares directly, with no share conversion.
+
+The tree PRG is fixed key AES (AES-NI), two blocks per seed per level.
+Keys are flattened to uint64_t words, so they go over send_uint64_batch:
+  [0, 2)                  root seed
+  [2 + 3l, 4 + 3l)        level l correction seed
+  4 + 3l                  level l correction bits, tL | tR << 1
+  3 depth + 2             output correction, mod p
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+// uint64_t words per key
+inline size_t dpf_key_words(const size_t depth) {
+  return 3 * depth + 3;
+}
+
+// Tree depth to cover a domain of n points
+inline size_t dpf_depth(const size_t n) {
+  size_t depth = 0;
+  while ((1ULL << depth) < n)
+    depth++;
+  return depth;
+}
+
+// Keys for f(alpha) = beta, else 0. key0 and key1 are dpf_key_words(depth) each.
+void dpf_gen(const size_t depth, const uint64_t alpha, const uint64_t beta,
+             const uint64_t mod, uint64_t* const key0, uint64_t* const key1);
+
+// Server server_num's shares of f(0), ..., f(n - 1), into out[n].
+// Expands the tree a level at a time, so AES runs over whole levels.
+void dpf_eval_all(const int server_num, const size_t depth,
+                  const uint64_t* const key, const size_t n,
+                  const uint64_t mod, uint64_t* const out);
+
+#endif
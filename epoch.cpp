@@ -0,0 +1,257 @@
+#include "epoch.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "net_share.h"
+#include "utils.h"
+
+// On disk: magic, width, mod, count, config words, then the config
+enum { H_MAGIC, H_WIDTH, H_MOD, H_COUNT, H_CONFIG_WORDS, H_CONFIG };
+#define EPOCH_MAX_CONFIG (EPOCH_HEADER_BYTES / sizeof(uint64_t) - H_CONFIG)
+
+static void pwrite_all(const int fd, const void* const buf, const size_t len, const off_t offset) {
+  if (pwrite(fd, buf, len, offset) != (ssize_t) len)
+    error_exit("Failed to write epoch log");
+}
+
+static bool pread_all(const int fd, void* const buf, const size_t len, const off_t offset) {
+  return pread(fd, buf, len, offset) == (ssize_t) len;
+}
+
+bool EpochLog::valid_name(const std::string& name) {
+  if (name.empty() or name.size() > 200)
+    return false;
+  for (const char c : name)
+    if (not ((c >= 'a' and c <= 'z') or (c >= '0' and c <= '9') or c == '_'))
+      return false;
+  return true;
+}
+
+EpochLog::EpochLog(const std::string& dir, const EpochTask& task, const size_t width)
+: path(dir + "/" + task.name + ".epochs")
+, task(task)
+, width_(width)
+{
+  if (!valid_name(task.name) or task.config.size() > EPOCH_MAX_CONFIG)
+    error_exit("Bad epoch task");
+
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) error_exit("Failed to open epoch log");
+
+  uint64_t header[EPOCH_HEADER_BYTES / sizeof(uint64_t)] = {0};
+  if (pread_all(fd, header, sizeof(header), 0) and header[H_MAGIC] == EPOCH_MAGIC) {
+    const bool same = (header[H_WIDTH] == width and header[H_MOD] == task.mod
+                       and header[H_CONFIG_WORDS] == task.config.size()
+                       and std::equal(task.config.begin(), task.config.end(), &header[H_CONFIG]));
+    if (!same) error_exit("Epoch log exists with another shape");
+    count = header[H_COUNT];
+    return;
+  }
+
+  // New, or never got its header down
+  header[H_MAGIC] = EPOCH_MAGIC;
+  header[H_WIDTH] = width;
+  header[H_MOD] = task.mod;
+  header[H_COUNT] = 0;
+  header[H_CONFIG_WORDS] = task.config.size();
+  std::copy(task.config.begin(), task.config.end(), &header[H_CONFIG]);
+  if (ftruncate(fd, EPOCH_HEADER_BYTES) < 0) error_exit("Failed to size epoch log");
+  pwrite_all(fd, header, sizeof(header), 0);
+  fdatasync(fd);
+}
+
+EpochLog::EpochLog(const std::string& dir, const std::string& name)
+: path(dir + "/" + name + ".epochs")
+, width_(0)
+{
+  task.name = name;
+  task.mod = 0;
+  if (!valid_name(name))
+    return;
+  fd = open(path.c_str(), O_RDWR);
+  if (fd < 0)
+    return;
+
+  uint64_t header[EPOCH_HEADER_BYTES / sizeof(uint64_t)];
+  if (!pread_all(fd, header, sizeof(header), 0) or header[H_MAGIC] != EPOCH_MAGIC
+      or header[H_CONFIG_WORDS] > EPOCH_MAX_CONFIG) {
+    close(fd);
+    fd = -1;
+    return;
+  }
+  width_ = header[H_WIDTH];
+  task.mod = header[H_MOD];
+  task.config.assign(&header[H_CONFIG], &header[H_CONFIG + header[H_CONFIG_WORDS]]);
+  count = header[H_COUNT];
+}
+
+EpochLog::~EpochLog() {
+  if (fd >= 0)
+    close(fd);
+}
+
+void EpochLog::write_count(const uint64_t new_count) {
+  pwrite_all(fd, &new_count, sizeof(uint64_t), H_COUNT * sizeof(uint64_t));
+  fdatasync(fd);
+  count = new_count;
+}
+
+uint64_t EpochLog::append(const int serverfd, const uint64_t* const share,
+                          const uint64_t num_valid, const uint64_t num_inputs) {
+  uint64_t other;
+  send_uint64(serverfd, count);
+  recv_uint64(serverfd, other);
+  const uint64_t epoch = std::min(count, other);
+  if (count > epoch) {
+    std::cout << "Epoch log " << path << " dropping " << count - epoch
+              << " epochs the other server doesn't have" << std::endl;
+    write_count(epoch);
+  }
+
+  const size_t record_bytes = record_words() * sizeof(uint64_t);
+  const off_t offset = EPOCH_HEADER_BYTES + epoch * record_bytes;
+  const uint64_t counts[2] = {num_valid, num_inputs};
+  pwrite_all(fd, counts, sizeof(counts), offset);
+  pwrite_all(fd, share, width_ * sizeof(uint64_t), offset + sizeof(counts));
+  if (ftruncate(fd, offset + record_bytes) < 0) error_exit("Failed to size epoch log");
+  fdatasync(fd);
+
+  // Only now is it there
+  write_count(epoch + 1);
+  return epoch;
+}
+
+bool EpochLog::append_passed(const int serverfd, const int server_num, const double threshold,
+                             const uint64_t* const share, const uint64_t num_valid,
+                             const uint64_t num_inputs) {
+  bool passed;
+  if (server_num == 0) {
+    passed = !(num_valid < num_inputs * (1 - threshold));
+    send_bool(serverfd, passed);
+  } else {
+    recv_bool(serverfd, passed);
+  }
+  if (passed)
+    append(serverfd, share, num_valid, num_inputs);
+  return passed;
+}
+
+void EpochLog::read_record(const uint64_t epoch, uint64_t* const record) const {
+  const size_t record_bytes = record_words() * sizeof(uint64_t);
+  if (epoch >= count or !pread_all(fd, record, record_bytes, EPOCH_HEADER_BYTES + epoch * record_bytes))
+    error_exit("Failed to read epoch log");
+}
+
+void EpochLog::merge(const uint64_t first, const uint64_t last, uint64_t* const out,
+                     uint64_t& num_valid, uint64_t& num_inputs) const {
+  std::fill(out, out + width_, 0);
+  num_valid = num_inputs = 0;
+  if (first > last or last >= count)
+    error_exit("Epoch range out of the log");
+
+  uint64_t* const record = new uint64_t[record_words()];
+  for (uint64_t e = first; e <= last; e++) {
+    read_record(e, record);
+    num_valid += record[0];
+    num_inputs += record[1];
+    for (size_t j = 0; j < width_; j++)
+      out[j] = addmod(out[j], record[2 + j], task.mod);
+  }
+  delete[] record;
+}
+
+// On disk: magic, length, end, num_valid, num_inputs, then the sums
+enum { W_MAGIC, W_LENGTH, W_END, W_VALID, W_INPUTS, W_SUMS };
+
+EpochWindow::EpochWindow(const EpochLog& log, const std::string& dir, const size_t length)
+: log(log)
+, length(length)
+, path(dir + "/" + log.task.name + ".window")
+, sums_(new uint64_t[log.width_]())
+{
+  const size_t words = W_SUMS + log.width_;
+  uint64_t* const state = new uint64_t[words];
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd >= 0 and pread_all(fd, state, words * sizeof(uint64_t), 0)
+      and state[W_MAGIC] == EPOCH_MAGIC and state[W_LENGTH] == length) {
+    end_ = state[W_END];
+    num_valid_ = state[W_VALID];
+    num_inputs_ = state[W_INPUTS];
+    std::copy(&state[W_SUMS], &state[words], sums_);
+  }
+  if (fd >= 0)
+    close(fd);
+  delete[] state;
+}
+
+EpochWindow::~EpochWindow() {
+  delete[] sums_;
+}
+
+// Whole, or not at all: write a copy, then rename it over
+void EpochWindow::save() const {
+  const size_t words = W_SUMS + log.width_;
+  uint64_t* const state = new uint64_t[words];
+  state[W_MAGIC] = EPOCH_MAGIC;
+  state[W_LENGTH] = length;
+  state[W_END] = end_;
+  state[W_VALID] = num_valid_;
+  state[W_INPUTS] = num_inputs_;
+  std::copy(sums_, sums_ + log.width_, &state[W_SUMS]);
+
+  const std::string tmp = path + ".tmp";
+  const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) error_exit("Failed to open epoch window");
+  pwrite_all(fd, state, words * sizeof(uint64_t), 0);
+  fdatasync(fd);
+  close(fd);
+  if (rename(tmp.c_str(), path.c_str()) < 0)
+    error_exit("Failed to save epoch window");
+  delete[] state;
+}
+
+uint64_t EpochWindow::advance(const int serverfd) {
+  uint64_t other_end, other_count;
+  send_uint64(serverfd, end_);
+  send_uint64(serverfd, log.count);
+  recv_uint64(serverfd, other_end);
+  recv_uint64(serverfd, other_count);
+  const uint64_t target = std::min(log.count, other_count);
+  const uint64_t mod = log.task.mod;
+  uint64_t num_read = 0;
+
+  if (end_ != other_end or end_ > target or target - end_ >= length) {
+    // Out of step, or moving past the whole window anyway. Start over.
+    end_ = target;
+    if (target > 0) {
+      log.merge(first(), target - 1, sums_, num_valid_, num_inputs_);
+      num_read = target - first();
+    }
+  } else {
+    uint64_t* const record = new uint64_t[log.record_words()];
+    for (; end_ < target; end_++) {
+      log.read_record(end_, record);
+      num_valid_ += record[0];
+      num_inputs_ += record[1];
+      for (size_t j = 0; j < log.width_; j++)
+        sums_[j] = addmod(sums_[j], record[2 + j], mod);
+      num_read++;
+      if (end_ < length)
+        continue;
+      log.read_record(end_ - length, record);
+      num_valid_ -= record[0];
+      num_inputs_ -= record[1];
+      for (size_t j = 0; j < log.width_; j++)
+        sums_[j] = submod(sums_[j], record[2 + j], mod);
+      num_read++;
+    }
+    delete[] record;
+  }
+  save();
+  return num_read;
+}
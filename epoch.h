@@ -0,0 +1,123 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+/*
+Per task log of each server's share of every batch's aggregate.
+
+An epoch is one client batch of a task. Once a server has accumulated its
+share of the batch (the fmpz sums, count-min rows, LINREG statistics), and
+before the servers reveal, it appends that share and the batch's counts to the
+task's log. Shares add, so the sum of a server's records over epochs
+[first, last] is its share of the aggregate over all of those batches.
+Revealing that answers the query without going back to any submission, in
+time proportional to the merged state.
+
+A task is an op plus whatever shapes its accumulator, e.g. FREQ over 8 bits.
+Its log is dir/name.epochs: a header with the shape, then fixed width records
+[num_valid, num_inputs, width share words], in epoch order.
+A record is written and synced before the header's count is bumped.
+
+Only batches that were revealed are logged. Otherwise a query over a range
+with a refused batch, less one without it, would give that batch back.
+append_passed() has server 0 judge the batch and tell server 1, so both log
+it or neither does.
+
+Both servers append the same epochs in the same order. append() first swaps
+counts with the other server, and a server that's ahead (the other crashed
+before its append) drops the extra record, so record i pairs up on both.
+
+A window is a server's running share of the last length epochs of a task,
+e.g. the last 60 one minute batches. Shares are mod p, so they subtract too:
+moving the window's end from e to e + 1 adds record e and takes off
+record e - length, two records however long the window is. The servers
+move their windows in step, to the end both logs have, and keep them in
+dir/name.window between queries. There's one per task, so a client can't
+fill the disk by asking for many lengths. A query with another length
+starts it over.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define EPOCH_MAGIC 0x5052494f45504f43ULL  // "PRIOEPOC"
+#define EPOCH_HEADER_BYTES 4096
+
+struct EpochTask {
+  std::string name;               // [a-z0-9_] only, it names the file
+  std::vector<uint64_t> config;   // messageType, then the op's parameters
+  uint64_t mod;                   // shares add mod this, 0 for 2^64
+};
+
+class EpochLog {
+  const std::string path;
+  EpochTask task;
+  size_t width_;
+  uint64_t count = 0;
+  int fd = -1;
+
+  size_t record_words() const { return 2 + width_; }
+  void write_count(const uint64_t new_count);
+  void read_record(const uint64_t epoch, uint64_t* const record) const;
+
+  friend class EpochWindow;
+
+public:
+  // Open the task's log, making it if missing. Fails if it exists with another shape.
+  EpochLog(const std::string& dir, const EpochTask& task, const size_t width);
+  // Open an existing log, with the shape in its header. Check ok().
+  EpochLog(const std::string& dir, const std::string& name);
+  ~EpochLog();
+
+  static bool valid_name(const std::string& name);
+
+  bool ok() const { return fd >= 0; }
+  size_t size() const { return count; }
+  size_t width() const { return width_; }
+  const EpochTask& info() const { return task; }
+
+  // Append this server's share[width] of a batch, in step with the other server.
+  // Counts are as this server knows them. Returns the epoch.
+  uint64_t append(const int serverfd, const uint64_t* const share,
+                  const uint64_t num_valid, const uint64_t num_inputs);
+
+  // Append, only if server 0 finds the batch passed: no more than threshold of
+  // its num_inputs invalid, as the ops check before revealing. Both servers
+  // get server 0's verdict. Returns whether it was logged.
+  bool append_passed(const int serverfd, const int server_num, const double threshold,
+                     const uint64_t* const share, const uint64_t num_valid,
+                     const uint64_t num_inputs);
+
+  // Sum of shares over epochs [first, last] into out[width], and of the counts
+  void merge(const uint64_t first, const uint64_t last, uint64_t* const out,
+             uint64_t& num_valid, uint64_t& num_inputs) const;
+};
+
+class EpochWindow {
+  const EpochLog& log;
+  const size_t length;
+  const std::string path;
+  uint64_t end_ = 0;  // Holds epochs [end - length, end), from 0 while short
+  uint64_t num_valid_ = 0, num_inputs_ = 0;
+  uint64_t* const sums_;
+
+  void save() const;
+
+public:
+  // The window over log, as last saved in dir if it was this length, or empty
+  EpochWindow(const EpochLog& log, const std::string& dir, const size_t length);
+  ~EpochWindow();
+
+  // Move up to the end both servers' logs have, in step with the other server.
+  // Returns the number of records read.
+  uint64_t advance(const int serverfd);
+
+  uint64_t first() const { return end_ > length ? end_ - length : 0; }
+  uint64_t end() const { return end_; }
+  const uint64_t* sums() const { return sums_; }
+  uint64_t num_valid() const { return num_valid_; }
+  uint64_t num_inputs() const { return num_inputs_; }
+};
+
+#endif
@@ -2,12 +2,130 @@
 
 #include <gmpxx.h>
 
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
 extern "C" {
   #include "flint/flint.h"
   #include "flint/fmpz.h"
 };
 
+static thread_local FmpzArena* active_arena = nullptr;
+
+FmpzArena* fmpz_arena() {
+    return active_arena;
+}
+
+void fmpz_arena_phase(const char* const name) {
+    if (active_arena and active_arena->stats)
+        active_arena->phase(name);
+}
+
+FmpzArenaScope::FmpzArenaScope(FmpzArena* const arena)
+: prev(active_arena) {
+    active_arena = arena;
+}
+
+FmpzArenaScope::~FmpzArenaScope() {
+    active_arena = prev;
+}
+
+FmpzArena::FmpzArena(const size_t slab_len, const bool stats)
+: slab_len(slab_len), stats(stats) {
+    phase("start");
+}
+
+FmpzArena::~FmpzArena() {
+    reset();
+    for (const Slab& slab : slabs)
+        free(slab.base);
+}
+
+fmpz_t* FmpzArena::alloc(const size_t N) {
+    while (current < slabs.size() and slabs[current].cap - slabs[current].used < N)
+        current++;
+    if (current == slabs.size()) {
+        // calloc, so it starts all zero
+        const size_t cap = (N > slab_len ? N : slab_len);
+        fmpz_t* const base = (fmpz_t*) calloc(cap, sizeof(fmpz_t));
+        if (base == nullptr) {
+            std::cerr << "Failed to allocate fmpz slab" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        slabs.push_back({base, cap, 0});
+        phases[cur].slabs++;
+    }
+    Slab& slab = slabs[current];
+    fmpz_t* const out = &slab.base[slab.used];
+    slab.used += N;
+    phases[cur].news++;
+    phases[cur].elems += N;
+    return out;
+}
+
+FmpzArena::Slab* FmpzArena::find(const fmpz_t* const arr) {
+    // Inclusive, for empty arrays at the end of a slab
+    for (Slab& slab : slabs)
+        if (arr >= slab.base and arr <= slab.base + slab.cap)
+            return &slab;
+    return nullptr;
+}
+
+bool FmpzArena::release(fmpz_t* const arr, const size_t N) {
+    Slab* const slab = find(arr);
+    if (slab == nullptr)
+        return false;
+    // Frees any mpz, and leaves 0 for the next user
+    for (unsigned int i = 0; i < N; i++)
+        fmpz_zero(arr[i]);
+    if (arr + N == slab->base + slab->used)
+        slab->used -= N;
+    phases[cur].clears++;
+    return true;
+}
+
+void FmpzArena::reset() {
+    for (Slab& slab : slabs) {
+        for (unsigned int i = 0; i < slab.used; i++)
+            fmpz_zero(slab.base[i]);
+        slab.used = 0;
+    }
+    current = 0;
+    phases.clear();
+    phase("start");
+}
+
+void FmpzArena::phase(const char* const name) {
+    if (!phases.empty() and !stats)
+        return;
+    // Counts for a name add up over the batch, in first use order
+    for (cur = 0; cur < phases.size(); cur++)
+        if (strcmp(phases[cur].name, name) == 0)
+            return;
+    phases.push_back({name, 0, 0, 0, 0});
+}
+
+void FmpzArena::report() const {
+    if (!stats)
+        return;
+    size_t bytes = 0;
+    for (const Slab& slab : slabs)
+        bytes += slab.cap * sizeof(fmpz_t);
+    std::cout << "fmpz arena: " << slabs.size() << " slabs, " << bytes << " bytes" << std::endl;
+    for (const Phase& p : phases) {
+        if (p.news + p.clears + p.slabs == 0)
+            continue;
+        std::cout << "  " << p.name << ": " << p.news << " new, " << p.clears
+                  << " clear, " << p.elems << " fmpz, " << p.slabs << " slabs" << std::endl;
+    }
+}
+
 void new_fmpz_array(fmpz_t** arr, const size_t N) {
+    if (active_arena) {
+        *arr = active_arena->alloc(N);
+        return;
+    }
     fmpz_t* out = (fmpz_t*) malloc(N * sizeof(fmpz_t));
     for (unsigned int i = 0; i < N; i++)
         fmpz_init_set_ui(out[i], 0);
@@ -15,6 +133,8 @@ void new_fmpz_array(fmpz_t** arr, const size_t N) {
 }
 
 void clear_fmpz_array(fmpz_t* arr, const size_t N) {
+    if (active_arena and active_arena->release(arr, N))
+        return;
     for (unsigned int i = 0; i < N; i++)
         fmpz_clear(arr[i]);
     free(arr);
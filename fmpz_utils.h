@@ -9,6 +9,73 @@ extern "C" {
   #include "flint/fmpz.h"
 };
 
+#include <vector>
+
+/*
+Slab arena for per batch fmpz arrays.
+
+While an arena is active on a thread (FmpzArenaScope), new_fmpz_array
+bumps arrays out of its slabs instead of a malloc and N inits, and
+clear_fmpz_array on them just zeroes the values. Free slab space is kept
+all zero, which is what fmpz_init gives, so new arrays need no init.
+A clear of the newest array gives its space back, so temporaries in a loop
+reuse it. reset() zeroes whatever is left and rewinds, once per batch.
+It also starts the phase counts over.
+
+Anything that must outlive the batch has to be made under FmpzArenaPause.
+
+With stats set, counts calls per phase, for report().
+*/
+class FmpzArena {
+    struct Slab {
+        fmpz_t* base;
+        size_t cap;
+        size_t used;
+    };
+    struct Phase {
+        const char* name;
+        size_t news, clears, elems, slabs;
+    };
+
+    const size_t slab_len;
+    std::vector<Slab> slabs;
+    size_t current = 0;
+    std::vector<Phase> phases;
+    size_t cur = 0;  // phase counting now
+
+    Slab* find(const fmpz_t* const arr);
+
+public:
+    const bool stats;
+
+    FmpzArena(const size_t slab_len = 1 << 20, const bool stats = false);
+    ~FmpzArena();
+
+    fmpz_t* alloc(const size_t N);
+    // false if not from this arena
+    bool release(fmpz_t* const arr, const size_t N);
+    void reset();
+
+    // Following calls count toward phase name. Only kept with stats.
+    void phase(const char* const name);
+    void report() const;
+};
+
+// Active arena of this thread, or nullptr
+FmpzArena* fmpz_arena();
+void fmpz_arena_phase(const char* const name);
+
+struct FmpzArenaScope {
+    FmpzArena* const prev;
+    FmpzArenaScope(FmpzArena* const arena);
+    ~FmpzArenaScope();
+};
+
+// Plain malloc'd arrays for the scope, e.g. for long lived tables
+struct FmpzArenaPause : FmpzArenaScope {
+    FmpzArenaPause() : FmpzArenaScope(nullptr) {}
+};
+
 void new_fmpz_array(fmpz_t** arr, const size_t N);
 
 void clear_fmpz_array(fmpz_t* arr, const size_t N);
@@ -0,0 +1,135 @@
+#include "group_by.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "constants.h"
+#include "net_share.h"
+
+LabelSums::~LabelSums() {
+  if (sums)
+    clear_fmpz_array(sums, labels.size() * num_values);
+}
+
+size_t accumulate(const size_t num_inputs, const size_t num_values,
+                  const fmpz_t* const shares_p, const bool* const valid,
+                  const uint64_t* const labels, LabelSums& ans) {
+  fmpz_arena_phase("accumulate");
+  size_t num_valid = 0;
+
+  const size_t none = SIZE_MAX;
+  size_t* const slot = new size_t[num_inputs];
+  for (unsigned int i = 0; i < num_inputs; i++) {
+    slot[i] = none;
+    if (!valid[i])
+      continue;
+    num_valid++;
+    auto it = ans.index.find(labels[i]);
+    if (it == ans.index.end()) {
+      if (ans.size() >= ans.max_labels)
+        continue;
+      it = ans.index.emplace(labels[i], ans.size()).first;
+      ans.labels.push_back(labels[i]);
+      ans.counts.push_back(0);
+    }
+    slot[i] = it->second;
+    ans.counts[slot[i]]++;
+  }
+
+  // Drop slots under min_count, keeping first seen order
+  size_t* const remap = new size_t[ans.size()];
+  size_t num_kept = 0;
+  ans.index.clear();
+  for (unsigned int g = 0; g < ans.size(); g++) {
+    if (ans.counts[g] < ans.min_count) {
+      remap[g] = none;
+      ans.num_suppressed++;
+      continue;
+    }
+    remap[g] = num_kept;
+    ans.index[ans.labels[g]] = num_kept;
+    ans.labels[num_kept] = ans.labels[g];
+    ans.counts[num_kept] = ans.counts[g];
+    num_kept++;
+  }
+  ans.labels.resize(num_kept);
+  ans.counts.resize(num_kept);
+  for (unsigned int i = 0; i < num_inputs; i++) {
+    if (slot[i] != none)
+      slot[i] = remap[slot[i]];
+    if (valid[i] and slot[i] == none)
+      ans.num_left_out++;
+  }
+  delete[] remap;
+
+  ans.num_values = num_values;
+  new_fmpz_array(&ans.sums, ans.size() * num_values);
+  for (unsigned int j = 0; j < ans.size() * num_values; j++)
+    fmpz_zero(ans.sums[j]);
+  for (unsigned int i = 0; i < num_inputs; i++) {
+    if (slot[i] == none)
+      continue;
+    fmpz_t* const sum = &ans.sums[slot[i] * num_values];
+    for (unsigned int j = 0; j < num_values; j++) {
+      fmpz_add(sum[j], sum[j], shares_p[i * num_values + j]);
+      fmpz_mod(sum[j], sum[j], Int_Modulus);
+    }
+  }
+  delete[] slot;
+
+  return num_valid;
+}
+
+void split_labels(const size_t n, const size_t num_values, const uint64_t* const rows,
+                  uint64_t* const values, uint64_t* const labels) {
+  for (unsigned int i = 0; i < n; i++) {
+    memcpy(&values[i * num_values], &rows[i * (num_values + 1)], num_values * sizeof(uint64_t));
+    labels[i] = rows[i * (num_values + 1) + num_values];
+  }
+}
+
+int check_labels(const int serverfd, const int server_num, const size_t n,
+                 const uint64_t* const labels, bool* const valid) {
+  if (server_num == 1)
+    return send_uint64_batch(serverfd, labels, n);
+
+  uint64_t* const labels_other = new uint64_t[n];
+  recv_uint64_batch(serverfd, labels_other, n);
+  size_t num_bad = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    if (valid[i] and labels[i] != labels_other[i]) {
+      valid[i] = false;
+      num_bad++;
+    }
+  }
+  delete[] labels_other;
+  if (num_bad > 0)
+    std::cout << "Mismatched labels: " << num_bad << std::endl;
+  return 0;
+}
+
+uint64_t* reveal_label_sums(const int serverfd, const int server_num, const LabelSums& ans) {
+  const size_t len = ans.size() * ans.num_values;
+  if (server_num == 1) {
+    send_fmpz_batch(serverfd, ans.sums, len);
+    return nullptr;
+  }
+
+  fmpz_t* b; new_fmpz_array(&b, len);
+  recv_fmpz_batch(serverfd, b, len);
+  uint64_t* const sums = new uint64_t[len];
+  for (unsigned int j = 0; j < len; j++) {
+    fmpz_add(b[j], b[j], ans.sums[j]);
+    fmpz_mod(b[j], b[j], Int_Modulus);
+    sums[j] = fmpz_get_ui(b[j]);
+  }
+  clear_fmpz_array(b, len);
+  return sums;
+}
+
+void print_left_out(const LabelSums& ans) {
+  if (ans.num_suppressed > 0)
+    std::cout << "Suppressed labels under " << ans.min_count << ": " << ans.num_suppressed << std::endl;
+  if (ans.num_left_out > 0)
+    std::cout << "Clients not in a revealed label: " << ans.num_left_out << std::endl;
+}
@@ -0,0 +1,65 @@
+#ifndef GROUP_BY_H
+#define GROUP_BY_H
+
+/*
+Group by a public label, for INT_SUM and VAR/STDDEV.
+
+Clients send a label with their values. Labels are public, so the servers
+check they got the same one, then add each valid share into its label's
+slot of a sparse table. Labels get slots in the order they're first seen,
+so both servers line up given the same valid and labels.
+
+Any uint64 label is accepted, but only the first max_labels distinct ones
+get a slot. Slots with fewer than min_count valid shares are dropped before
+anything is revealed, so server 1 never sends their sums.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "fmpz_utils.h"
+
+struct LabelSums {
+  std::unordered_map<uint64_t, size_t> index;  // label -> slot
+  std::vector<uint64_t> labels;                // slot -> label
+  std::vector<size_t> counts;                  // valid shares per slot
+  fmpz_t* sums = nullptr;                      // [slots * num_values]
+  size_t num_values = 0;
+
+  const size_t min_count, max_labels;
+  size_t num_suppressed = 0;                   // labels under min_count
+  size_t num_left_out = 0;                     // valid shares not in any slot
+
+  LabelSums(const size_t min_count, const size_t max_labels)
+  : min_count(min_count), max_labels(max_labels) {}
+  ~LabelSums();
+
+  size_t size() const { return labels.size(); }
+};
+
+// Only labels that have a valid share get a slot, and each share is added
+// once, so it's O(num_inputs * num_values) however many labels.
+// Returns num_valid, which still counts shares left out of a slot.
+size_t accumulate(const size_t num_inputs, const size_t num_values,
+                  const fmpz_t* const shares_p, const bool* const valid,
+                  const uint64_t* const labels, LabelSums& ans);
+
+// Group by rows are the values, then the public label. Split n of them into
+// values [n * num_values], and labels [n].
+void split_labels(const size_t n, const size_t num_values, const uint64_t* const rows,
+                  uint64_t* const values, uint64_t* const labels);
+
+// Server 1 sends its labels. Server 0 drops clients whose labels don't
+// match, before it shares valid.
+int check_labels(const int serverfd, const int server_num, const size_t n,
+                 const uint64_t* const labels, bool* const valid);
+
+// Reveal per label sums. Server 0 gets them as words [slots * num_values],
+// server 1 gets nullptr.
+uint64_t* reveal_label_sums(const int serverfd, const int server_num, const LabelSums& ans);
+
+void print_left_out(const LabelSums& ans);
+
+#endif
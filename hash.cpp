@@ -4,25 +4,39 @@
 
 #include "fmpz_utils.h"
 
-void HashStore::eval(const unsigned int i, const unsigned int x, fmpz_t out) {
-  fmpz_zero(out);
+uint64_t HashStore::eval(const unsigned int i, const unsigned int x) const {
+  uint64_t out = 0;
   // f -> x(f + c_j)
-  for (unsigned int j = degree; j > 0; j--) {
-    fmpz_add(out, out, coeff[i][j]);
-    fmpz_mul_ui(out, out, x);
-    fmpz_mod(out, out, l);
-  }
+  for (unsigned int j = degree; j > 0; j--)
+    out = ((out + coeff[j * d + i]) * x) & l_mask;
   // right shift, take first w_bits bits
-  fmpz_fdiv_q_2exp(out, out, l_bits - w_bits);
+  out = (shift < 64) ? out >> shift : 0;
 
-  fmpz_add(out, out, coeff[i][0]);
-  fmpz_mod(out, out, w);
+  return (out + coeff[i]) % w_val;
+}
+
+void HashStore::eval(const unsigned int i, const unsigned int x, fmpz_t out) const {
+  fmpz_set_ui(out, eval(i, x));
+}
+
+void HashStore::eval_all(const unsigned int x, uint64_t* const out) const {
+  for (unsigned int i = 0; i < d; i++)
+    out[i] = 0;
+  for (unsigned int j = degree; j > 0; j--) {
+    const uint64_t* const c = &coeff[j * d];
+    for (unsigned int i = 0; i < d; i++)
+      out[i] = ((out[i] + c[i]) * x) & l_mask;
+  }
+  for (unsigned int i = 0; i < d; i++) {
+    const uint64_t top = (shift < 64) ? out[i] >> shift : 0;
+    out[i] = (top + coeff[i]) % w_val;
+  }
 }
 
 void HashStore::print_hash(const unsigned int i) {
   std::cout << "Hash " << i << ": ";
   for (unsigned int j = 0; j <= degree; j++) {
-    fmpz_print(coeff[i][j]);
+    std::cout << coeff[j * d + i];
     if (j > 0) std::cout << " x";
     if (j > 1) std::cout << "^" << j;
     if (j < degree) std::cout << " + ";
@@ -10,8 +10,11 @@ Ideally, w is field (p^k), especially 2^k, for perfect pairwise.
 For efficiency, fine for w smaller and just have slightly imbalanced. Instead treats as though 2^k for next power of 2, then mod w.
 Does poly(x), take first k bits, then mod w
 
-Could be more efficient to use fmpz_t poly, but more work. 
-For degree 1, efficient enough as is
+Coefficients are drawn as fmpz from the seed, then kept as native words.
+Since L = 2^l_bits, mod L is a mask, which only needs the low 64 bits of
+the product, so plain wrapping uint64_t arithmetic gives the same hashes.
+Stored coefficient major, coeff[j * d + i], so eval_all runs over the d rows
+with contiguous loads.
 */
 
 #ifndef PRIO_HASH_H
@@ -30,7 +33,10 @@ class HashStore {
   const size_t degree;  // degree+1 -wise independent. 
   flint_rand_t hash_seed;  // synced seed for same random hashes
 
-  fmpz_t** coeff;
+  uint64_t* coeff;  // d * (degree + 1), coeff[j * d + i] is x^j of hash i
+  uint64_t l_mask;  // mod L
+  uint64_t w_val;
+  size_t shift;  // to keep first w_bits of l_bits. 64 if w_bits > l_bits
 
 public: 
   HashStore(const size_t d, const size_t l_bits, const size_t w_arg,
@@ -38,6 +44,7 @@ public:
   : d(d)
   , l_bits(l_bits)
   , degree(independence - 1)
+  , w_val(w_arg)
   {
     fmpz_init(w); fmpz_set_ui(w, w_arg);
     fmpz_init(l); fmpz_set_ui(l, 1ULL << l_bits);
@@ -48,6 +55,9 @@ public:
     while(w_tmp >>= 1)
       w_bits++;
 
+    l_mask = (1ULL << l_bits) - 1;
+    shift = (w_bits > l_bits) ? 64 : l_bits - w_bits;
+
     // std::cout << "Hash store d: " << d << ", l: 2^" << l_bits << " -> w: " << w_arg << " (" << w_bits << " bits)" << std::endl;
 
     // TODO: sanity checks:
@@ -60,32 +70,38 @@ public:
     if (fmpz_cmp(wd, l) >= 0) {
       std::cout << "Warning: wd >= L, so no space saved vs standard frequency" << std::endl;
     }
+    fmpz_clear(wd);
 
-    coeff = new fmpz_t*[d];
+    // Same draw order as always, so seeds give the same hashes
+    coeff = new uint64_t[d * (degree + 1)];
+    fmpz_t tmp; fmpz_init(tmp);
     // Constant term can be mod w, rather than mod L
     for (unsigned int i = 0; i < d; i++) {
-      new_fmpz_array(&coeff[i], degree + 1);
       for (unsigned int j = 0; j <= degree; j++) {
         if (j == 0) {
-          fmpz_randm(coeff[i][j], hash_seed, w);
+          fmpz_randm(tmp, hash_seed, w);
         } else {
-          fmpz_randm(coeff[i][j], hash_seed, l);
+          fmpz_randm(tmp, hash_seed, l);
         }
+        coeff[j * d + i] = fmpz_get_ui(tmp);
       }
     }
+    fmpz_clear(tmp);
   }
 
   ~HashStore() {
     fmpz_clear(w);
     fmpz_clear(l);
     flint_randclear(hash_seed);
-    for (unsigned int i = 0; i < d; i++)
-      clear_fmpz_array(coeff[i], degree + 1);
     delete[] coeff;
   }
 
+  // Run hash i on x
+  uint64_t eval(const unsigned int i, const unsigned int x) const;
   // Run hash i on x, returning out
-  void eval(const unsigned int i, const unsigned int x, fmpz_t out);
+  void eval(const unsigned int i, const unsigned int x, fmpz_t out) const;
+  // All d hashes of x, into out[d]
+  void eval_all(const unsigned int x, uint64_t* const out) const;
   void print_hash(const unsigned int i);
 };
 
@@ -0,0 +1,154 @@
+#include "ingest.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "net_share.h"
+#include "utils.h"
+
+size_t IngestArena::spill_budget = SIZE_MAX;
+size_t IngestArena::spill_segment = 1ULL << 26;
+std::string IngestArena::spill_dir = ".";
+
+static size_t round_up(const size_t x, const size_t m) {
+  return (x + m - 1) / m * m;
+}
+
+SpillColumn::SpillColumn(const size_t words) {
+  capacity = words * sizeof(uint64_t);
+  spill = (capacity > IngestArena::spill_budget);
+  if (!spill) {
+    base = (char*) new uint64_t[words];
+    mapped = capacity;
+    return;
+  }
+
+  // Reserve the whole range up front, so rows stay contiguous, and map it in by segment
+  segment = round_up(IngestArena::spill_segment, sysconf(_SC_PAGESIZE));
+  capacity = round_up(capacity, segment);
+  ram_limit = IngestArena::spill_budget / segment * segment;
+  base = (char*) mmap(nullptr, capacity, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) error_exit("Failed to reserve spill column");
+  std::cout << "Spilling " << capacity << " byte column past " << ram_limit
+            << " bytes, to " << IngestArena::spill_dir << std::endl;
+}
+
+SpillColumn::~SpillColumn() {
+  if (spill)
+    munmap(base, capacity);
+  else
+    delete[] (uint64_t*) base;
+}
+
+void SpillColumn::map_segment() {
+  if (mapped >= capacity) error_exit("Spill column full");
+
+  void* ret;
+  if (mapped < ram_limit) {
+    ret = mmap(base + mapped, segment, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  } else {
+    std::string path = IngestArena::spill_dir + "/spill_XXXXXX";
+    const int fd = mkstemp(&path[0]);
+    if (fd < 0) error_exit("Failed to create spill segment");
+    // The mapping keeps it alive
+    unlink(path.c_str());
+    if (ftruncate(fd, segment) < 0) error_exit("Failed to size spill segment");
+    ret = mmap(base + mapped, segment, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+  }
+  if (ret == MAP_FAILED) error_exit("Failed to map spill segment");
+  mapped += segment;
+}
+
+// One spare slot, for a last submission that is dropped
+IngestArena::IngestArena(const size_t row_words, const size_t capacity)
+: row_words(row_words)
+, capacity(capacity)
+, rows((capacity + 1) * row_words)
+{
+  pks = new char[(capacity + 1) * PK_LENGTH];
+  index.reserve(capacity);
+}
+
+IngestArena::~IngestArena() {
+  delete[] pks;
+  delete gathered;
+}
+
+size_t IngestArena::stream_rows(const size_t bytes_per_row) const {
+  if (!spilled())
+    return SIZE_MAX;
+  return std::max((size_t) 1, spill_segment / std::max(bytes_per_row, (size_t) 1));
+}
+
+bool IngestArena::commit(const bool keep) {
+  if (!keep or num_rows == capacity)
+    return false;
+  const std::string pk(next_pk(), next_pk() + PK_LENGTH);
+  if (!index.emplace(pk, num_rows).second)
+    return false;
+  num_rows++;
+  return true;
+}
+
+size_t IngestArena::align(const int serverfd, const int server_num,
+                          size_t*& perm, bool*& valid, int& bytes) {
+  size_t n;
+  if (server_num == 1) {
+    n = num_rows;
+    bytes += send_size(serverfd, n);
+    if (n > 0 and send(serverfd, pks, n * PK_LENGTH, 0) <= 0)
+      error_exit("Failed to send pks");
+    bytes += n * PK_LENGTH;
+    perm = new size_t[n];
+    valid = new bool[n];
+    for (size_t k = 0; k < n; k++)
+      perm[k] = k;
+    return n;
+  }
+
+  recv_size(serverfd, n);
+  char* const other_pks = new char[n * PK_LENGTH];
+  recv_in(serverfd, other_pks, n * PK_LENGTH);
+  perm = new size_t[n];
+  valid = new bool[n];
+  for (size_t k = 0; k < n; k++) {
+    const std::string pk(&other_pks[k * PK_LENGTH], &other_pks[(k + 1) * PK_LENGTH]);
+    const auto it = index.find(pk);
+    valid[k] = (it != index.end());
+    perm[k] = valid[k] ? it->second : 0;
+  }
+  delete[] other_pks;
+  return n;
+}
+
+const uint64_t* IngestArena::ordered(const size_t* const perm, const bool* const valid,
+                                     const size_t n) {
+  bool identity = (n <= num_rows);
+  for (size_t k = 0; identity and k < n; k++)
+    identity = (perm[k] == k and (valid == nullptr or valid[k]));
+  if (identity)
+    return rows.data();
+
+  delete gathered;
+  gathered = new SpillColumn(n * row_words);
+  gathered->ensure(n * row_words);
+  uint64_t* const out = gathered->data();
+  for (size_t k = 0; k < n; k++) {
+    if (valid == nullptr or valid[k])
+      memcpy(&out[k * row_words], row(perm[k]), row_words * sizeof(uint64_t));
+    else
+      memset(&out[k * row_words], 0, row_words * sizeof(uint64_t));
+  }
+  return out;
+}
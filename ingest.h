@@ -0,0 +1,113 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+/*
+Columnar ingest arena for client submissions.
+
+Each submission's pk and payload are received straight into the next slot
+of two contiguous columns: pks, PK_LENGTH bytes each, and payloads of
+row_words words each. Everything is sized once from the batch size.
+The dedup index only maps pk -> row. A duplicate or rejected submission
+is never committed, so the next one lands on top of it.
+
+PK alignment doesn't copy payloads. Server 1 sends its pks in row order,
+as one block, so for it synced client k is just row k. Server 0 gets a
+permutation perm[k] of its own rows. If clients sent to both servers in
+the same order, that's the identity, and ordered() hands back the arena
+itself. Otherwise ordered() gathers once.
+
+Spilling: a payload column bigger than spill_budget bytes is still one
+range of addresses, but past the budget it is backed by segment files in
+spill_dir, mapped in as rows arrive. The files are unlinked right away,
+so they go with the arena. The kernel writes back and drops their pages
+as it needs to, so batch size is bounded by disk rather than RAM.
+Ops should then go over the rows in order, stream_rows() at a time.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "types.h"
+
+// Word column of fixed capacity. On the heap if it fits the budget,
+// otherwise RAM segments up to the budget, then file segments.
+class SpillColumn {
+  size_t capacity;       // bytes, a whole number of segments when spilled
+  bool spill;
+  char* base;
+  size_t mapped = 0;     // bytes usable from base
+  size_t segment = 0;
+  size_t ram_limit = 0;  // segments below this are anonymous memory
+
+  void map_segment();
+
+public:
+  SpillColumn(const size_t words);
+  ~SpillColumn();
+
+  bool spilled() const { return spill; }
+  uint64_t* data() const { return (uint64_t*) base; }
+
+  // Make the first words words usable
+  void ensure(const size_t words) {
+    while (words * sizeof(uint64_t) > mapped)
+      map_segment();
+  }
+};
+
+class IngestArena {
+  const size_t row_words;
+  const size_t capacity;
+  size_t num_rows = 0;
+
+  char* pks;
+  SpillColumn rows;
+  std::unordered_map<std::string, size_t> index;  // pk -> row
+
+  SpillColumn* gathered = nullptr;
+
+public:
+  // Set once at startup. Budget is per column. Default never spills.
+  static size_t spill_budget;
+  static size_t spill_segment;
+  static std::string spill_dir;
+
+  IngestArena(const size_t row_words, const size_t capacity);
+  ~IngestArena();
+
+  // Slots to receive the next submission into
+  char* next_pk() { return &pks[num_rows * PK_LENGTH]; }
+  uint64_t* next_row() {
+    rows.ensure((num_rows + 1) * row_words);
+    return &rows.data()[num_rows * row_words];
+  }
+
+  // Keep the submission in the next slot, unless keep is false or the pk was seen.
+  // Returns whether it was kept.
+  bool commit(const bool keep = true);
+
+  size_t size() const { return num_rows; }
+  size_t width() const { return row_words; }
+  const uint64_t* data() const { return rows.data(); }
+  const uint64_t* row(const size_t i) const { return &rows.data()[i * row_words]; }
+
+  bool spilled() const { return rows.spilled(); }
+  // Clients to handle at once, when each takes bytes_per_row of working memory.
+  // The whole batch, unless spilled.
+  size_t stream_rows(const size_t bytes_per_row) const;
+
+  // Line rows up with the other server. Returns the number of synced clients n,
+  // with perm[n] and valid[n] made here. Server 0's valid is whether it has the pk.
+  // Server 1's is left for the op to fill, and its perm is always the identity.
+  size_t align(const int serverfd, const int server_num,
+               size_t*& perm, bool*& valid, int& bytes);
+
+  // Rows in synced order, n * row_words. Rows not valid are 0.
+  // Owned by the arena. Only copies when the rows don't already line up.
+  const uint64_t* ordered(const size_t* const perm, const bool* const valid,
+                          const size_t n);
+};
+
+#endif
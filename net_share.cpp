@@ -4,6 +4,7 @@
 
 #include "constants.h"
 #include "fmpz_utils.h"
+#include "packed.h"
 
 // Ensure this is defined, as it's architecture dependent
 #if !defined(htonll) && !defined(ntohll)
@@ -19,7 +20,8 @@
 /* Core functions */
 
 int recv_in(const int sockfd, void* const buf, const size_t len) {
-    unsigned int bytes_read = 0, tmp;
+    unsigned int bytes_read = 0;
+    ssize_t tmp;  // Signed, so a failed recv isn't read as bytes
     char* bufptr = (char*) buf;
     while (bytes_read < len) {
         tmp = recv(sockfd, bufptr + bytes_read, len - bytes_read, 0);
@@ -67,6 +69,20 @@ int recv_bool_batch(const int sockfd, bool* const x, const size_t n) {
     return ret;
 }
 
+int send_packed_bits(const int sockfd, const uint64_t* const x, const size_t n) {
+    const size_t len = (n+7) / 8;
+    return send(sockfd, x, len, 0);
+}
+
+int recv_packed_bits(const int sockfd, uint64_t* const x, const size_t n) {
+    const size_t len = (n+7) / 8;
+    if (n > 0)
+        x[(n - 1) / 64] = 0;
+    int ret = recv_in(sockfd, x, len);
+    clear_tail(x, n);
+    return ret;
+}
+
 int send_int(const int sockfd, const int x) {
     int x_conv = htonl(x);
     const char* data = (const char*) &x_conv;
@@ -204,6 +220,8 @@ int recv_fmpz(const int sockfd, fmpz_t x) {
     } else {
         ret = recv_size(sockfd, len);
         if (ret <= 0) return ret; else total += ret;
+        // Reduced mod p, so never longer. Also bounds buf.
+        if (len > fmpz_size(Int_Modulus)) return -1;
     }
 
     if (len == 0) {
@@ -385,59 +403,30 @@ int recv_CorShare_batch(const int sockfd, CorShare* const * const x, const size_
     return total;
 }
 
+// The whole block in order, which is MulShares, f0, g0, h0, h_points, triple
 int send_ClientPacket(const int sockfd, const ClientPacket* const x,
                       const size_t NMul) {
     int total = 0, ret;
-    const size_t N = NextPowerOfTwo(NMul);
+    const size_t len = ClientPacket::words(NMul);
 
-    for (unsigned int i = 0; i < NMul; i++) {
-        ret = send_fmpz(sockfd, x->MulShares[i]);
+    for (unsigned int i = 0; i < len; i++) {
+        ret = send_fmpz(sockfd, x->data[i]);
         if (ret <= 0) return ret; else total += ret;
     }
 
-    ret = send_fmpz(sockfd, x->f0_s);
-    if (ret <= 0) return ret; else total += ret;
-    ret = send_fmpz(sockfd, x->g0_s);
-    if (ret <= 0) return ret; else total += ret;
-    ret = send_fmpz(sockfd, x->h0_s);
-    if (ret <= 0) return ret; else total += ret;
-
-    for (unsigned int i = 0; i < N; i++) {
-        ret = send_fmpz(sockfd, x->h_points[i]);
-        if (ret <= 0) return ret; else total += ret;
-    }
-
-    ret = send_BeaverTripleShare(sockfd, x->triple_share);
-    if (ret <= 0) return ret; else total += ret;
-
     return total;
 }
 
 int recv_ClientPacket(const int sockfd, ClientPacket* const x,
                       const size_t NMul) {
     int total = 0, ret;
-    const size_t N = NextPowerOfTwo(NMul);
-
-    for (unsigned int i = 0; i < NMul; i++) {
-        ret = recv_fmpz(sockfd, x->MulShares[i]);
-        if (ret <= 0) return ret; else total += ret;
-    }
+    const size_t len = ClientPacket::words(NMul);
 
-    ret = recv_fmpz(sockfd, x->f0_s);
-    if (ret <= 0) return ret; else total += ret;
-    ret = recv_fmpz(sockfd, x->g0_s);
-    if (ret <= 0) return ret; else total += ret;
-    ret = recv_fmpz(sockfd, x->h0_s);
-    if (ret <= 0) return ret; else total += ret;
-
-    for (unsigned int i = 0; i < N; i++) {
-        ret = recv_fmpz(sockfd, x->h_points[i]);
+    for (unsigned int i = 0; i < len; i++) {
+        ret = recv_fmpz(sockfd, x->data[i]);
         if (ret <= 0) return ret; else total += ret;
     }
 
-    ret = recv_BeaverTripleShare(sockfd, x->triple_share);
-    if (ret <= 0) return ret; else total += ret;
-
     return total;
 }
 
@@ -53,6 +53,11 @@ int recv_bool(const int sockfd, bool& x);
 int send_bool_batch(const int sockfd, const bool* const x, const size_t n);
 int recv_bool_batch(const int sockfd, bool* const x, const size_t n);
 
+// Same wire format as bool_batch, but already packed 64 per word (see packed.h)
+// Assumes little endian. recv clears the unused bits of the last word.
+int send_packed_bits(const int sockfd, const uint64_t* const x, const size_t n);
+int recv_packed_bits(const int sockfd, uint64_t* const x, const size_t n);
+
 // Unused
 int send_int(const int sockfd, const int x);
 int recv_int(const int sockfd, int& x);
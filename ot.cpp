@@ -2,6 +2,7 @@
 
 #include "constants.h"
 #include "net_share.h"
+#include "packed.h"
 #include "utils.h"
 
 #if OT_TYPE == EMP_IKNP
@@ -49,6 +50,41 @@ void OT_Wrapper::recv(uint64_t* const data, const bool* b, const size_t length)
     delete[] block;
 }
 
+void OT_Wrapper::send_rot_bits(uint64_t* const data0, uint64_t* const data1,
+                               const size_t length) {
+    emp::block* const block0 = new emp::block[length];
+    emp::block* const block1 = new emp::block[length];
+
+    io->sync();
+    ot->send_rot(block0, block1, length);
+    io->flush();
+
+    memset(data0, 0, words_for(length) * sizeof(uint64_t));
+    memset(data1, 0, words_for(length) * sizeof(uint64_t));
+    for (unsigned int i = 0; i < length; i++) {
+        data0[i / 64] |= (*(uint64_t*)&block0[i] & 1) << (i % 64);
+        data1[i / 64] |= (*(uint64_t*)&block1[i] & 1) << (i % 64);
+    }
+
+    delete[] block0;
+    delete[] block1;
+}
+
+void OT_Wrapper::recv_rot_bits(uint64_t* const data, const bool* b,
+                               const size_t length) {
+    emp::block* const block = new emp::block[length];
+
+    io->sync();
+    ot->recv_rot(block, b, length);
+    io->flush();
+
+    memset(data, 0, words_for(length) * sizeof(uint64_t));
+    for (unsigned int i = 0; i < length; i++)
+        data[i / 64] |= (*(uint64_t*)&block[i] & 1) << (i % 64);
+
+    delete[] block;
+}
+
 #else
 #error Not valid or defined OT type
 #endif
@@ -216,55 +252,231 @@ uint64_t** intsum_ot_receiver(OT_Wrapper* const ot,
     return ret;
 }
 
+// Clients per OT batch of the fused sums, at least 1
+static size_t intsum_chunk(const size_t total_bits) {
+    const size_t chunk = INTSUM_OT_CHUNK / (total_bits ? total_bits : 1);
+    return chunk ? chunk : 1;
+}
+
+void intsum_ot_sender_sum(OT_Wrapper* const ot, const uint64_t* const shares,
+                          const bool* const valid, const size_t* const num_bits,
+                          const size_t num_shares, const size_t num_values,
+                          const size_t mod, uint64_t* const ans) {
+    emp::PRG prg;
+
+    size_t total_bits = 0;
+    for (unsigned int j = 0; j < num_values; j++)
+        total_bits += num_bits[j];
+    const size_t chunk = intsum_chunk(total_bits);
+
+    memset(ans, 0, num_values * sizeof(uint64_t));
+    uint64_t* const b0 = new uint64_t[chunk * total_bits];
+    uint64_t* const b1 = new uint64_t[chunk * total_bits];
+
+    size_t i = 0;
+    while (i < num_shares) {
+        // Next chunk of valid shares. Invalid ones take no OTs.
+        size_t idx = 0, count = 0;
+        for (; i < num_shares and count < chunk; i++) {
+            if (!valid[i])
+                continue;
+            prg.random_data(&b0[idx], total_bits * sizeof(uint64_t));
+            for (unsigned int j = 0; j < num_values; j++) {
+                const uint64_t num = shares[i * num_values + j];
+                for (unsigned int k = 0; k < num_bits[j]; k++) {
+                    const bool bit = (num >> k) & 1;
+                    const uint64_t pow = 1ULL << k;
+                    if (mod != 0) b0[idx] %= mod;
+                    // b0 = r, b1 = r +- 2^k, and keep bit 2^k - r
+                    b1[idx] = (bit ? submod(b0[idx], pow, mod) : addmod(b0[idx], pow, mod));
+                    ans[j] = addmod(ans[j], submod(bit ? pow : 0, b0[idx], mod), mod);
+                    idx++;
+                }
+            }
+            count++;
+        }
+        if (idx > 0)
+            ot->send(b0, b1, idx);
+    }
+
+    delete[] b0;
+    delete[] b1;
+}
+
+void intsum_ot_receiver_sum(OT_Wrapper* const ot, const uint64_t* const shares,
+                            const bool* const valid, const size_t* const num_bits,
+                            const size_t num_shares, const size_t num_values,
+                            const size_t mod, uint64_t* const ans) {
+    size_t total_bits = 0;
+    for (unsigned int j = 0; j < num_values; j++)
+        total_bits += num_bits[j];
+    const size_t chunk = intsum_chunk(total_bits);
+
+    memset(ans, 0, num_values * sizeof(uint64_t));
+    uint64_t* const r = new uint64_t[chunk * total_bits];
+    bool* const bool_shares = new bool[chunk * total_bits];
+
+    size_t i = 0;
+    while (i < num_shares) {
+        size_t idx = 0, count = 0;
+        for (; i < num_shares and count < chunk; i++) {
+            if (!valid[i])
+                continue;
+            for (unsigned int j = 0; j < num_values; j++) {
+                const uint64_t num = shares[i * num_values + j];
+                for (unsigned int k = 0; k < num_bits[j]; k++)
+                    bool_shares[idx++] = (num >> k) & 1;
+            }
+            count++;
+        }
+        if (idx == 0)
+            continue;
+        ot->recv(r, bool_shares, idx);
+
+        // Same order as made, so value j of each share is a fixed run of bits
+        idx = 0;
+        for (unsigned int c = 0; c < count; c++) {
+            for (unsigned int j = 0; j < num_values; j++) {
+                for (unsigned int k = 0; k < num_bits[j]; k++)
+                    ans[j] = addmod(ans[j], r[idx++], mod);
+            }
+        }
+    }
+
+    delete[] r;
+    delete[] bool_shares;
+}
+
 // Ref : https://crypto.stackexchange.com/questions/41651/what-are-the-ways-to-generate-beaver-triples-for-multiplication-gate
-std::queue<BooleanBeaverTriple*> gen_boolean_beaver_triples(const int server_num, const unsigned int m, OT_Wrapper* const ot0, OT_Wrapper* const ot1){
+// Random OT (m0, m1) to receiver choice r gives sender a = m0 ^ m1, u = m0, and receiver u ^ a.r
+// So a.r is shared with no extra messages. One each way covers both cross terms:
+// c_0 = a_0 b_0 ^ u_0 ^ v_1, c_1 = a_1 b_1 ^ v_0 ^ u_1
+void gen_boolean_beaver_triples(const int server_num, const size_t n_words,
+                                OT_Wrapper* const ot0, OT_Wrapper* const ot1,
+                                uint64_t* const a, uint64_t* const b,
+                                uint64_t* const c) {
+    const size_t m = 64 * n_words;
     emp::PRG prg;
-    std::queue<BooleanBeaverTriple*> ans;
-    bool* x = new bool[m];
-    bool* y = new bool[m];
-    bool* z = new bool[m];
-    bool* r = new bool[m];
-    prg.random_bool(x, m);
-    prg.random_bool(y, m);
-    prg.random_bool(r, m);
-
-    uint64_t* b0 = new uint64_t[m];
-    uint64_t* b1 = new uint64_t[m];
-    uint64_t* b = new uint64_t[m];
-
-    for (unsigned int i = 0; i < m; i++){
-        b0[i] = r[i];
-        b1[i] = (x[i] != r[i]); // r[i] XOR x[i]
+
+    bool* const choice = new bool[m];
+    prg.random_bool(choice, m);
+    pack_bits(b, choice, m);
+
+    uint64_t* const m0 = new uint64_t[n_words];
+    uint64_t* const m1 = new uint64_t[n_words];
+    uint64_t* const v = new uint64_t[n_words];
+
+    if (server_num == 0) {
+        ot0->send_rot_bits(m0, m1, m);
+        ot1->recv_rot_bits(v, choice, m);
+    } else {
+        ot0->recv_rot_bits(v, choice, m);
+        ot1->send_rot_bits(m0, m1, m);
     }
 
-    if(server_num == 0){
-        ot0->send(b0, b1, m);
-        ot1->recv(b, y, m);
+    for (unsigned int k = 0; k < n_words; k++) {
+        a[k] = m0[k] ^ m1[k];
+        c[k] = (a[k] & b[k]) ^ m0[k] ^ v[k];
     }
-    else if(server_num == 1){
-        ot0->recv(b, y, m);
-        ot1->send(b0, b1, m);
+
+    delete[] choice;
+    delete[] m0;
+    delete[] m1;
+    delete[] v;
+}
+
+// Triples at once in gen_arith_beaver_triples. Each is 2 * bits OTs.
+#define ARITH_TRIPLE_CHUNK 16384
+
+// Cross term x * y, with x the receiver's, y the sender's.
+// Sender sends (r_k, r_k + 2^k y) for each bit k, receiver picks with bit k of x.
+// Sender's share is -sum r_k, receiver's is the sum of what it got.
+static void gilboa_sender(OT_Wrapper* const ot, const size_t n, const size_t bits,
+                          const uint64_t mod, const uint64_t* const y,
+                          uint64_t* const out) {
+    emp::PRG prg;
+    uint64_t* const m0 = new uint64_t[n * bits];
+    uint64_t* const m1 = new uint64_t[n * bits];
+    prg.random_data(m0, n * bits * sizeof(uint64_t));
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t shifted = y[i];  // 2^k y
+        uint64_t sum = 0;
+        for (unsigned int k = 0; k < bits; k++) {
+            const size_t idx = i * bits + k;
+            m0[idx] %= mod;
+            m1[idx] = addmod(m0[idx], shifted, mod);
+            sum = addmod(sum, m0[idx], mod);
+            shifted = addmod(shifted, shifted, mod);
+        }
+        out[i] = submod(0, sum, mod);
     }
 
-    for (unsigned int i = 0; i < m ; i++){
-        // b = r' ^ x'y
-        z[i] = b[i] != (r[i] != (x[i] and y[i])); // z[i] = r_A xor x_A.y_A xor r_B xor x_B.y_A
-        // std::cout << x[i] << " " << y[i] << " " <<  z[i] << std::endl;
+    ot->send(m0, m1, n * bits);
+
+    delete[] m0;
+    delete[] m1;
+}
+
+static void gilboa_receiver(OT_Wrapper* const ot, const size_t n, const size_t bits,
+                            const uint64_t mod, const uint64_t* const x,
+                            uint64_t* const out) {
+    bool* const choice = new bool[n * bits];
+    uint64_t* const m = new uint64_t[n * bits];
+    for (unsigned int i = 0; i < n; i++)
+        for (unsigned int k = 0; k < bits; k++)
+            choice[i * bits + k] = (x[i] >> k) & 1;
+
+    ot->recv(m, choice, n * bits);
+
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t sum = 0;
+        for (unsigned int k = 0; k < bits; k++)
+            sum = addmod(sum, m[i * bits + k], mod);
+        out[i] = sum;
     }
 
-    for (unsigned int i = 0 ; i < m ; i++){
-        ans.push(new BooleanBeaverTriple(x[i], y[i], z[i]));
+    delete[] choice;
+    delete[] m;
+}
+
+void gen_arith_beaver_triples(const int server_num, const size_t n,
+                              OT_Wrapper* const ot0, OT_Wrapper* const ot1,
+                              const uint64_t mod,
+                              uint64_t* const a, uint64_t* const b,
+                              uint64_t* const c) {
+    emp::PRG prg;
+    const size_t bits = LOG2((mod - 1));
+
+    prg.random_data(a, n * sizeof(uint64_t));
+    prg.random_data(b, n * sizeof(uint64_t));
+    for (unsigned int i = 0; i < n; i++) {
+        a[i] %= mod;
+        b[i] %= mod;
     }
 
-    delete[] b0;
-    delete[] b1;
-    delete[] b;
-    delete[] x;
-    delete[] y;
-    delete[] z;
-    delete[] r;
+    uint64_t* const cross0 = new uint64_t[ARITH_TRIPLE_CHUNK];
+    uint64_t* const cross1 = new uint64_t[ARITH_TRIPLE_CHUNK];
+
+    for (size_t start = 0; start < n; start += ARITH_TRIPLE_CHUNK) {
+        const size_t len = std::min((size_t) ARITH_TRIPLE_CHUNK, n - start);
+        // ot0: a_1 b_0, with server 0 sending. ot1: a_0 b_1, with server 1 sending.
+        if (server_num == 0) {
+            gilboa_sender(ot0, len, bits, mod, &b[start], cross0);
+            gilboa_receiver(ot1, len, bits, mod, &a[start], cross1);
+        } else {
+            gilboa_receiver(ot0, len, bits, mod, &a[start], cross0);
+            gilboa_sender(ot1, len, bits, mod, &b[start], cross1);
+        }
+
+        for (unsigned int i = 0; i < len; i++) {
+            const uint64_t ab = mulmod(a[start + i], b[start + i], mod);
+            c[start + i] = addmod(ab, addmod(cross0[i], cross1[i], mod), mod);
+        }
+    }
 
-    return ans;
+    delete[] cross0;
+    delete[] cross1;
 }
 
 // Slow. OT per bit
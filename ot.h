@@ -9,7 +9,6 @@ For share conversion
 #include <emp-ot/emp-ot.h>
 #include <emp-tool/emp-tool.h>
 #include <iostream>
-#include <queue>
 
 #include "share.h"
 
@@ -27,6 +26,12 @@ struct OT_Wrapper {
   void send(const uint64_t* const data0, const uint64_t* const data1,
             const size_t length);
   void recv(uint64_t* const data, const bool* b, const size_t length);
+
+  // Random OT, keeping 1 bit of each message, packed 64 per word.
+  // Sender gets random bits data0, data1. Receiver gets data_b for its choice b.
+  void send_rot_bits(uint64_t* const data0, uint64_t* const data1,
+                     const size_t length);
+  void recv_rot_bits(uint64_t* const data, const bool* b, const size_t length);
 };
 
 // mod 0 = default 2^64
@@ -49,8 +54,36 @@ uint64_t** intsum_ot_receiver(OT_Wrapper* const ot,
                               const size_t num_shares, const size_t num_values,
                               const size_t mod = 0);
 
-std::queue<BooleanBeaverTriple*> gen_boolean_beaver_triples(const int server_num, const unsigned int m, OT_Wrapper* const ot0, OT_Wrapper* const ot1);
+// Fused conversion and sum: ans[j] is this server's share of the sum of value j
+// over valid shares. shares is flat, [num_shares * num_values].
+// Both servers need the same valid. Invalid shares take no OTs.
+// OTs go in chunks, so nothing is num_shares x num_values besides the input.
+#define INTSUM_OT_CHUNK 65536
+void intsum_ot_sender_sum(OT_Wrapper* const ot, const uint64_t* const shares,
+                          const bool* const valid, const size_t* const num_bits,
+                          const size_t num_shares, const size_t num_values,
+                          const size_t mod, uint64_t* const ans);
+void intsum_ot_receiver_sum(OT_Wrapper* const ot, const uint64_t* const shares,
+                            const bool* const valid, const size_t* const num_bits,
+                            const size_t num_shares, const size_t num_values,
+                            const size_t mod, uint64_t* const ans);
+
+// Bit-sliced boolean triples, 64 per word. a, b, c are [n_words].
+// One 1-bit random OT each way per triple.
+void gen_boolean_beaver_triples(const int server_num, const size_t n_words,
+                                OT_Wrapper* const ot0, OT_Wrapper* const ot1,
+                                uint64_t* const a, uint64_t* const b,
+                                uint64_t* const c);
+
+// Arithmetic triples mod p, for p < 2^64. a, b, c are [n], this server's shares.
+// Gilboa style: each cross term a_s b_t takes one OT per bit of a_s. Done in chunks.
+void gen_arith_beaver_triples(const int server_num, const size_t n,
+                              OT_Wrapper* const ot0, OT_Wrapper* const ot1,
+                              const uint64_t mod,
+                              uint64_t* const a, uint64_t* const b,
+                              uint64_t* const c);
 
+// Deprecated, see gen_arith_beaver_triples
 BeaverTriple* generate_beaver_triple(const int serverfd, const int server_num, OT_Wrapper* const ot0, OT_Wrapper* const ot1);
 
 BeaverTriple* generate_beaver_triple_lazy(const int serverfd, const int server_num);
@@ -0,0 +1,83 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+/*
+Helpers for bits packed 64 to a uint64_t word.
+
+Bit i lives at word i / 64, position i % 64.
+On little endian machines, this matches the byte layout of send_bool_batch,
+so packed words can go straight to the socket.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Words needed to hold n bits
+inline size_t words_for(const size_t n) {
+  return (n + 63) / 64;
+}
+
+inline bool get_bit(const uint64_t* const x, const size_t i) {
+  return (x[i / 64] >> (i % 64)) & 1;
+}
+
+inline void set_bit(uint64_t* const x, const size_t i, const bool b) {
+  x[i / 64] = (x[i / 64] & ~(1ULL << (i % 64))) | ((uint64_t) b << (i % 64));
+}
+
+// 64 bits starting at bit offset. Reads one word past when not aligned.
+inline uint64_t load_word(const uint64_t* const x, const size_t offset) {
+  const size_t q = offset / 64, r = offset % 64;
+  if (r == 0)
+    return x[q];
+  return (x[q] >> r) | (x[q + 1] << (64 - r));
+}
+
+// Pack n bools into words_for(n) words. Unused high bits are zeroed.
+inline void pack_bits(uint64_t* const out, const bool* const x, const size_t n) {
+  memset(out, 0, words_for(n) * sizeof(uint64_t));
+  for (size_t i = 0; i < n; i++)
+    out[i / 64] |= ((uint64_t) x[i]) << (i % 64);
+}
+
+inline void unpack_bits(bool* const out, const uint64_t* const x, const size_t n) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = (x[i / 64] >> (i % 64)) & 1;
+}
+
+// Zero the bits in the last word past n
+inline void clear_tail(uint64_t* const x, const size_t n) {
+  if (n % 64)
+    x[n / 64] &= (1ULL << (n % 64)) - 1;
+}
+
+// OR n bits of src into dst, starting at bit offset of dst.
+// src bits past n must be 0. Never touches words of dst past the last bit.
+inline void or_bits_at(uint64_t* const dst, const size_t offset,
+                       const uint64_t* const src, const size_t n) {
+  const size_t q = offset / 64, r = offset % 64;
+  for (size_t k = 0; k < words_for(n); k++) {
+    dst[q + k] |= src[k] << r;
+    if (r and (src[k] >> (64 - r)))
+      dst[q + k + 1] |= src[k] >> (64 - r);
+  }
+}
+
+// XOR of bits [offset, offset + n)
+inline bool range_parity(const uint64_t* const x, const size_t offset, const size_t n) {
+  if (n == 0)
+    return false;
+  const size_t first = offset / 64, last = (offset + n - 1) / 64;
+  uint64_t acc = 0;
+  for (size_t k = first; k <= last; k++)
+    acc ^= x[k];
+  // Take back the bits before offset and after the end
+  acc ^= x[first] & ((1ULL << (offset % 64)) - 1);
+  const size_t end = (offset + n) % 64;
+  if (end)
+    acc ^= x[last] & ~((1ULL << end) - 1);
+  return __builtin_parityll(acc);
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include "persist.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+#include "net_share.h"
+#include "utils.h"
+
+// splitmix64 finalizer, to roll the checksum
+static uint64_t mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static uint64_t roll_checksum(const uint64_t checksum, const uint64_t count,
+                              const uint64_t n) {
+  return mix64(checksum ^ mix64(count ^ mix64(n)));
+}
+
+// Record index is mixed in, so a record in the wrong slot doesn't pass
+uint64_t PersistentStore::record_hash(const uint64_t index) const {
+  const uint64_t* const record = &data[(index % capacity) * record_words];
+  uint64_t h = mix64(index);
+  for (size_t j = 0; j < record_words; j++)
+    h = mix64(h ^ record[j]);
+  return h;
+}
+
+uint64_t PersistentStore::body_hash(const uint64_t first, const uint64_t last) const {
+  uint64_t sum = 0;
+  for (uint64_t i = first; i < last; i++)
+    sum += record_hash(i);
+  return sum;
+}
+
+PersistentStore::PersistentStore(const std::string path,
+                                 const size_t record_words,
+                                 const size_t capacity)
+: path(path)
+, record_words(record_words)
+, capacity(capacity)
+{
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) error_exit("Failed to open persistent store");
+
+  map_len = PERSIST_HEADER_BYTES + capacity * record_words * sizeof(uint64_t);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) error_exit("Failed to stat persistent store");
+  const bool fresh = ((size_t) st.st_size != map_len);
+  if (fresh and ftruncate(fd, map_len) < 0)
+    error_exit("Failed to size persistent store");
+
+  map = (char*) mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) error_exit("Failed to map persistent store");
+
+  header = (PersistHeader*) map;
+  data = (uint64_t*) (map + PERSIST_HEADER_BYTES);
+
+  if (fresh or header->magic != PERSIST_MAGIC
+      or header->record_words != record_words
+      or header->capacity != capacity) {
+    // Session 0 never matches in sync, so forces a shared reset there.
+    memset(header, 0, sizeof(PersistHeader));
+    header->magic = PERSIST_MAGIC;
+    header->record_words = record_words;
+    header->capacity = capacity;
+    flush_header();
+  }
+
+  std::cout << "Persistent store " << path << ": " << available()
+            << " records available" << std::endl;
+}
+
+PersistentStore::~PersistentStore() {
+  flush_header();
+  munmap(map, map_len);
+  close(fd);
+}
+
+void PersistentStore::flush(const size_t offset, const size_t len) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  const size_t start = offset - (offset % page);
+  if (msync(map + start, len + (offset - start), MS_SYNC) < 0)
+    error_exit("Failed to sync persistent store");
+}
+
+void PersistentStore::flush_header() {
+  flush(0, sizeof(PersistHeader));
+}
+
+void PersistentStore::reset(const uint64_t session) {
+  header->session = session;
+  header->count = 0;
+  header->cursor = 0;
+  header->checksum = mix64(session);
+  header->prev_count = 0;
+  header->prev_checksum = header->checksum;
+  header->body_sum = 0;
+  flush_header();
+}
+
+void PersistentStore::append(const size_t n, const uint64_t* const records) {
+  if (n > space()) error_exit("Persistent store full");
+
+  // Write records, in at most two pieces due to wraparound
+  size_t done = 0;
+  while (done < n) {
+    const size_t slot = (header->count + done) % capacity;
+    const size_t len = std::min(n - done, capacity - slot);
+    memcpy(&data[slot * record_words], &records[done * record_words],
+           len * record_words * sizeof(uint64_t));
+    flush(PERSIST_HEADER_BYTES + slot * record_words * sizeof(uint64_t),
+          len * record_words * sizeof(uint64_t));
+    done += len;
+  }
+
+  // Only now are they visible
+  header->prev_count = header->count;
+  header->prev_checksum = header->checksum;
+  header->checksum = roll_checksum(header->checksum, header->count, n);
+  header->body_sum += body_hash(header->count, header->count + n);
+  header->count += n;
+  flush_header();
+}
+
+void PersistentStore::take(const size_t n, uint64_t* const out) {
+  if (n > available()) error_exit("Persistent store has too few records");
+
+  const uint64_t start = header->cursor;
+  // Mark consumed before use, so a crash never reuses them
+  header->body_sum -= body_hash(start, start + n);
+  header->cursor += n;
+  flush_header();
+
+  size_t done = 0;
+  while (done < n) {
+    const size_t slot = (start + done) % capacity;
+    const size_t len = std::min(n - done, capacity - slot);
+    memcpy(&out[done * record_words], &data[slot * record_words],
+           len * record_words * sizeof(uint64_t));
+    done += len;
+  }
+}
+
+bool PersistentStore::sync(const int serverfd, const int server_num) {
+  // Records as they were last written, or this store is no good
+  const bool body_ok = (header->count - header->cursor <= capacity
+                        and body_hash(header->cursor, header->count) == header->body_sum);
+  if (!body_ok)
+    std::cout << "Persistent store " << path << " has corrupted records" << std::endl;
+
+  const size_t num_fields = 7;
+  uint64_t mine[num_fields] = {header->session, header->count, header->cursor,
+                               header->checksum, header->prev_count,
+                               header->prev_checksum, body_ok};
+  uint64_t other[num_fields];
+  send_uint64_batch(serverfd, mine, num_fields);
+  recv_uint64_batch(serverfd, other, num_fields);
+
+  // Same view on both servers: h0 is server 0's header.
+  const uint64_t* const h0 = (server_num == 0 ? mine : other);
+  const uint64_t* const h1 = (server_num == 0 ? other : mine);
+  // 0 session, 1 count, 2 cursor, 3 checksum, 4 prev_count, 5 prev_checksum, 6 body ok
+
+  bool keep = (h0[0] == h1[0] and h0[0] != 0 and h0[6] and h1[6]);
+  bool rollback0 = false, rollback1 = false;
+  if (keep and not (h0[1] == h1[1] and h0[3] == h1[3])) {
+    // One append ahead, from a crash mid append
+    rollback0 = (h0[1] > h1[1] and h0[4] == h1[1] and h0[5] == h1[3]);
+    rollback1 = (h1[1] > h0[1] and h1[4] == h0[1] and h1[5] == h0[3]);
+    keep = rollback0 or rollback1;
+  }
+
+  if (!keep) {
+    uint64_t session;
+    if (server_num == 0) {
+      emp::PRG prg;
+      do {
+        prg.random_data(&session, sizeof(uint64_t));
+      } while (session == 0);
+      send_uint64(serverfd, session);
+    } else {
+      recv_uint64(serverfd, session);
+    }
+    std::cout << "Persistent store " << path << " out of sync, resetting" << std::endl;
+    reset(session);
+    return false;
+  }
+
+  if ((server_num == 0 and rollback0) or (server_num == 1 and rollback1)) {
+    std::cout << "Persistent store " << path << " rolling back last append" << std::endl;
+    header->count = header->prev_count;
+    header->checksum = header->prev_checksum;
+  }
+  // Anything either side consumed is gone
+  uint64_t cursor = std::max(h0[2], h1[2]);
+  header->cursor = std::min(cursor, (uint64_t) header->count);
+  header->body_sum = body_hash(header->cursor, header->count);
+  flush_header();
+
+  std::cout << "Persistent store " << path << " synced, " << available()
+            << " records available" << std::endl;
+  return true;
+}
@@ -0,0 +1,97 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+/*
+Persistent store of correlated randomness
+
+On-disk, memory mapped ring of fixed width records (uint64_t words), so offline work
+like daBits survives a server restart.
+
+Both servers keep one file each, and append / consume the same amounts in the same order,
+so record i on server 0 pairs with record i on server 1.
+count and cursor are monotonic indices, with record i stored at slot i % capacity.
+
+Crash safety:
+  append writes the records first, syncs, and only then bumps count in the header.
+  take bumps cursor and syncs the header before handing the records out.
+So a crash can at worst waste records, never reuse one.
+
+At startup, sync() swaps headers with the other server and compares checksums.
+The checksum is rolled over every append, and seeded with a session nonce shared when the files were made.
+If one server crashed mid append, it can be one append behind, which is rolled back on the other.
+Anything else that doesn't line up resets both stores.
+
+That checksum only covers what both servers share, since records are each server's own shares.
+So each store also keeps body_sum, a sum of a hash of every unconsumed record and its index.
+append adds to it and take subtracts, in the same header write that makes the change visible.
+sync() rehashes the unconsumed records first, and a torn or corrupted record on either server
+resets both stores.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define PERSIST_MAGIC 0x5052494f53544f52ULL  // "PRIOSTOR"
+#define PERSIST_HEADER_BYTES 4096
+
+struct PersistHeader {
+  uint64_t magic;
+  uint64_t record_words;   // words per record
+  uint64_t capacity;       // max number of unconsumed records
+  uint64_t session;        // nonce shared by both servers when the store was made
+  uint64_t count;          // total records ever appended
+  uint64_t cursor;         // total records ever consumed
+  uint64_t checksum;       // rolling, over (count, n) of every append
+  uint64_t prev_count;     // state before the last append, for rollback
+  uint64_t prev_checksum;
+  uint64_t body_sum;       // sum of record_hash over [cursor, count), this server's only
+};
+
+class PersistentStore {
+  const std::string path;
+  const size_t record_words;
+  const size_t capacity;
+
+  int fd;
+  size_t map_len;
+  char* map;
+
+  PersistHeader* header;
+  uint64_t* data;
+
+  // msync the given byte range of the map, rounded out to pages
+  void flush(const size_t offset, const size_t len);
+  void flush_header();
+
+  // Both to 0, with checksum seeded by session
+  void reset(const uint64_t session);
+
+  uint64_t record_hash(const uint64_t index) const;
+  // Sum of record_hash over [first, last)
+  uint64_t body_hash(const uint64_t first, const uint64_t last) const;
+
+public:
+
+  PersistentStore(const std::string path, const size_t record_words,
+                  const size_t capacity);
+
+  ~PersistentStore();
+
+  // Number of appended but not yet consumed records
+  size_t available() const { return header->count - header->cursor; }
+  // Space left before the ring is full
+  size_t space() const { return capacity - available(); }
+
+  // Copies n records, n * record_words words, to the end. Fails if not enough space.
+  void append(const size_t n, const uint64_t* const records);
+
+  // Copies the next n records to out, and marks them consumed. Fails if not enough.
+  void take(const size_t n, uint64_t* const out);
+
+  // Handshake with the other server, to agree on count and cursor.
+  // Returns true if the existing records were kept.
+  bool sync(const int serverfd, const int server_num);
+};
+
+#endif
@@ -5,18 +5,29 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <map>
 #include <unordered_map>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "correlated.h"
+#include "dpf.h"
+#include "epoch.h"
+#include "group_by.h"
 #include "hash.h"
+#include "ingest.h"
 #include "net_share.h"
 #include "ot.h"
+#include "packed.h"
+#include "persist.h"
+#include "submit_queue.h"
 #include "types.h"
 #include "utils.h"
+#include "xor_reduce.h"
 
 #define SERVER0_IP "127.0.0.1"
 #define SERVER1_IP "127.0.0.1"
@@ -27,6 +38,11 @@
 // Fail if more than this fraction of clients provide invalid inputs
 #define INVALID_THRESHOLD 0.5
 
+// Group by: labels with fewer valid clients than this are never revealed,
+// and at most this many distinct labels get a slot per batch
+#define MIN_LABEL_COUNT 10
+#define MAX_LABELS (1 << 16)
+
 // Can keep the same random X for a while
 #define RANDOMX_THRESHOLD 1e6
 uint64_t randx_uses = 0;
@@ -47,15 +63,137 @@ CorrelatedStore* correlated_store;
 #define LAZY_PRECOMPUTE false
 // Whether to use OT or Dabits
 #define USE_OT_B2A true
+// For sum only ops with OT, sum OT outputs as they come instead of converting each share
+#define USE_FUSED_SUM true
+// If not OT, whether to use an edaBit per value, or a daBit per bit
+#define USE_EDABIT_B2A true
+// Use OT made arithmetic triples in snip checks, rather than the client's
+#define USE_SERVER_TRIPLES false
+// Keep precomputed dabits on disk, to reuse across restarts
+#define PERSIST_DABITS true
+#define DABIT_FILE "dabits_"
+#define DABIT_FILE_CAPACITY (1ULL << 24)
+PersistentStore* dabit_file = nullptr;
+// Heavy hitter descent: split a layer's candidates over threads, this many each at least
+#define HEAVY_MIN_PER_THREAD 4096
+
+// fmpz arrays come from a slab per batch, reset after each client batch
+#define USE_FMPZ_ARENA true
+#define FMPZ_SLAB_LEN (1ULL << 20)
+// Print fmpz allocation counts per phase after each batch
+#define FMPZ_ARENA_STATS false
+
+// Ingest columns past this many bytes each go to segment files in SPILL_DIR
+#define SPILL_BUDGET_BYTES (8ULL << 30)
+#define SPILL_SEGMENT_BYTES (64ULL << 20)
+#define SPILL_DIR "."
+
+// Ring of parsed submissions between the network thread and the op.
+// At most this many slots, and about this many bytes for wide rows.
+#define SUBMIT_QUEUE_SLOTS 4096
+#define SUBMIT_QUEUE_BYTES (64ULL << 20)
+
+// Limits on what one client connection can make the server hold. Checked from
+// the headers before anything sized by them is allocated.
+// Bytes of submissions one connection may send in a batch
+#define MAX_CONNECTION_BYTES (16ULL << 30)
+// Payload words of one submission, and entries of a FREQ / COUNTMIN / HEAVY row set
+#define MAX_ROW_WORDS (1ULL << 20)
+#define MAX_ONEHOT_SIZE (1ULL << 26)
+#define MAX_LINREG_DEGREE 64
+// Kernel receive buffer per client connection. Bounds what a client can have
+// in flight while the ingest queue isn't reading.
+#define CLIENT_RCVBUF_BYTES (4ULL << 20)
+
+// Log each batch's aggregate shares per task in EPOCH_DIR, so the answer over
+// a range of batches can be had later without the clients
+#define LOG_EPOCHS true
+#define EPOCH_DIR "."
 
 // Note: Currently does it in a single batch.
 // I.e. recieve and store all, then process all.
 // TODO: Set up batching. Either every N inputs (based on space consumed), or every S seconds (figure out timer)
 
-size_t send_out(const int sockfd, const void* const buf, const size_t len) {
-    size_t ret = send(sockfd, buf, len, 0);
-    if (ret <= 0) error_exit("Failed to send");
-    return ret;
+size_t submit_queue_slots(const size_t row_words) {
+    const size_t fit = SUBMIT_QUEUE_BYTES / (row_words * sizeof(uint64_t) + PK_LENGTH);
+    return std::max((size_t) 64, std::min((size_t) SUBMIT_QUEUE_SLOTS, fit));
+}
+
+// Whether to take a batch of n submissions of frame_bytes each, as the client's
+// headers say. Both servers must agree, else neither reads any.
+bool admit_batch(const int serverfd, const char* const what, const bool header_ok,
+                 const size_t n, const size_t frame_bytes) {
+    bool ok = header_ok;
+    if (!header_ok) {
+        std::cout << "Rejecting " << what << ": bad header" << std::endl;
+    } else if (n > 0 and frame_bytes > MAX_CONNECTION_BYTES / n) {
+        std::cout << "Rejecting " << what << ": " << n << " x " << frame_bytes
+                  << " bytes is over the connection budget" << std::endl;
+        ok = false;
+    }
+    send_bool(serverfd, ok);
+    bool other_ok;
+    recv_bool(serverfd, other_ok);
+    if (ok and !other_ok)
+        std::cout << "Rejecting " << what << ": other server rejected" << std::endl;
+    return ok and other_ok;
+}
+
+// Most bytes a ClientPacket takes on the wire
+size_t client_packet_bytes(const size_t NMul) {
+    const size_t per_fmpz = fmpz_size(Int_Modulus) * sizeof(ulong);
+    return ClientPacket::words(NMul) * (FIXED_FMPZ_SIZE ? per_fmpz : sizeof(size_t) + per_fmpz);
+}
+
+// Log this server's share[width] of the batch's aggregate, reduced mod task.mod.
+// Both servers call it at the same point, before revealing. Only logged if the
+// batch passes INVALID_THRESHOLD, by server 0's counts.
+void log_epoch(const int serverfd, const int server_num, const EpochTask& task,
+               const uint64_t* const share, const size_t width,
+               const size_t num_valid, const size_t num_inputs) {
+    if (!LOG_EPOCHS)
+        return;
+    EpochLog log(EPOCH_DIR, task, width);
+    if (log.append_passed(serverfd, server_num, INVALID_THRESHOLD, share, num_valid, num_inputs))
+        std::cout << "Logged epoch " << log.size() - 1 << " of " << task.name << std::endl;
+    else
+        std::cout << "Not logging " << task.name << ", too many invalid" << std::endl;
+}
+
+void log_epoch(const int serverfd, const int server_num, const EpochTask& task,
+               const fmpz_t* const share, const size_t width,
+               const size_t num_valid, const size_t num_inputs) {
+    if (!LOG_EPOCHS)
+        return;
+    uint64_t* const words = new uint64_t[width];
+    fmpz_t tmp; fmpz_init(tmp);
+    for (unsigned int j = 0; j < width; j++) {
+        fmpz_mod(tmp, share[j], Int_Modulus);
+        words[j] = fmpz_get_ui(tmp);
+    }
+    fmpz_clear(tmp);
+    log_epoch(serverfd, server_num, task, words, width, num_valid, num_inputs);
+    delete[] words;
+}
+
+// COUNTMIN / HEAVY rows only merge under the same hashes, so their tasks
+// are keyed by the seed, and the seed kept to answer with
+void add_seed(EpochTask& task, const flint_rand_t seed, const double t) {
+    uint64_t t_bits;
+    memcpy(&t_bits, &t, sizeof(double));
+    task.config.push_back(t_bits);
+    const size_t seed_words = (sizeof(seed[0]) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    uint64_t words[seed_words] = {0};
+    memcpy(words, &seed[0], sizeof(seed[0]));
+    task.config.insert(task.config.end(), words, words + seed_words);
+
+    // FNV-1a over the config
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const uint64_t x : task.config)
+        h = (h ^ x) * 0x100000001b3ULL;
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016lx", (unsigned long) h);
+    task.name += "_" + std::string(hex);
 }
 
 void bind_and_listen(sockaddr_in& addr, int& sockfd, const int port, const int reuse = 1) {
@@ -127,17 +265,10 @@ void sync_randomX(const int serverfd, const int server_num, fmpz_t randomX) {
     }
 }
 
-// TODO: can maybe batch this? Seems to help in other places. Not a big timesink though, so should be fine for now
-std::string get_pk(const int serverfd) {
-    char pk_buf[PK_LENGTH];
-    recv_in(serverfd, &pk_buf[0], PK_LENGTH);
-    std::string pk(pk_buf, pk_buf + PK_LENGTH);
-    return pk;
-}
-
 CheckerPreComp* getPrecomp(const size_t N) {
     CheckerPreComp* pre;
     if (precomp_store.find(N) == precomp_store.end()) {
+        FmpzArenaPause pause;  // Kept across batches
         pre = new CheckerPreComp(N);
         pre->setCheckerPrecomp(randomX);
         precomp_store[N] = pre;
@@ -155,6 +286,7 @@ fmpz_t* share_convert(const size_t num_shares,  // # inputs
                       const uint64_t* const shares_2
                       ) {
     auto start = clock_start();
+    fmpz_arena_phase("convert");
 
     fmpz_t* shares_p;
 
@@ -178,8 +310,12 @@ fmpz_t* share_convert(const size_t num_shares,  // # inputs
         for (unsigned int i = 0; i < num_shares; i++)
             memcpy(&bits_arr[i * num_values], num_bits, num_values * sizeof(size_t));
 
-        shares_p = correlated_store->b2a_daBit_multi(
-            num_shares * num_values, bits_arr, f_shares2);
+        if (USE_EDABIT_B2A)
+            shares_p = correlated_store->b2a_edaBit(
+                num_shares * num_values, bits_arr, f_shares2);
+        else
+            shares_p = correlated_store->b2a_daBit_multi(
+                num_shares * num_values, bits_arr, f_shares2);
 
         delete[] bits_arr;
     }
@@ -191,17 +327,42 @@ fmpz_t* share_convert(const size_t num_shares,  // # inputs
     return shares_p;
 }
 
+// Make sure there's enough precomputes to share_convert, so it's not part of the timing
+void precompute_convert(const size_t num_shares,
+                        const size_t num_values,
+                        const size_t* const num_bits) {
+    if (USE_OT_B2A)
+        return;
+    size_t total_bits = 0;
+    for (unsigned int j = 0; j < num_values; j++)
+        total_bits += num_bits[j];
+    if (USE_EDABIT_B2A) {
+        // Ordered, to keep the OTs in sync
+        std::map<size_t, size_t> count;
+        for (unsigned int j = 0; j < num_values; j++)
+            count[num_bits[j]] += num_shares;
+        for (const auto& pair : count)
+            correlated_store->checkEdaBits(pair.first, pair.second);
+        correlated_store->checkDaBits(num_shares * num_values);
+    } else {
+        correlated_store->checkDaBits(num_shares * total_bits);
+    }
+}
+
 // Batch of N (snips + num_input wire/share) validations
+// Checker i reads packet slot[i] of the batch in place.
 // Due to the nature of the final swap, both servers get the same valid array
 bool* validate_snips(const size_t N,
                      const size_t num_inputs,
                      const int serverfd,
                      const int server_num,
                      Circuit* const * const circuit,
-                     const ClientPacket* const * const packet,
+                     const ClientPacketBatch& packets,
+                     const size_t* const slot,
                      const fmpz_t* const shares_p
                      ) {
     auto start = clock_start();
+    fmpz_arena_phase("snips");
 
     bool* const ans = new bool[N];
 
@@ -211,12 +372,27 @@ bool* validate_snips(const size_t N,
 
     init_roots(NumRoots);
 
+    BeaverTripleShare** triple = nullptr;
+    if (USE_SERVER_TRIPLES) {
+        const TripleView view = correlated_store->getArithTriples(N);
+        triple = new BeaverTripleShare*[N];
+        for (unsigned int i = 0; i < N; i++) {
+            triple[i] = new BeaverTripleShare();
+            fmpz_set_ui(triple[i]->shareA, view.a[i]);
+            fmpz_set_ui(triple[i]->shareB, view.b[i]);
+            fmpz_set_ui(triple[i]->shareC, view.c[i]);
+        }
+    }
+
     Checker** const checker = new Checker*[N];
     CheckerPreComp* const pre = getPrecomp(NumRoots);
     randx_uses += N;
-    for (unsigned int i = 0; i < N; i++)
-        checker[i] = new Checker(circuit[i], server_num, packet[i], pre,
-                                 &shares_p[i * num_inputs]);
+    for (unsigned int i = 0; i < N; i++) {
+        const ClientPacket packet = packets.packet(slot[i]);
+        checker[i] = new Checker(circuit[i], server_num, &packet, pre,
+                                 &shares_p[i * num_inputs], false,
+                                 triple ? triple[i] : nullptr);
+    }
 
     CorShare** const cor_share = new CorShare*[N];
     for (unsigned int i = 0; i < N; i++)
@@ -259,10 +435,14 @@ bool* validate_snips(const size_t N,
         delete cor_share[i];
         delete cor_share_other[i];
         delete checker[i];
+        if (triple)
+            delete triple[i];
     }
     delete[] cor_share;
     delete[] cor_share_other;
     delete[] checker;
+    if (triple)
+        delete[] triple;
 
     if (correlated_store->do_fork) waitpid(pid, &status, 0);
 
@@ -270,12 +450,159 @@ bool* validate_snips(const size_t N,
     return ans;
 }
 
+// Batch check that every client's check values are all 1, m per client.
+// arith: [n * m] arithmetic shares. parity: [n * m] boolean shares, or nullptr.
+// valid: server 0's is the input, and is sent over. On return, both have the result.
+// Each value gets a shared random coefficient (arith) or 64 bit mask (parity),
+// so the whole batch combines to one field element and word, for one round if honest.
+// Failing groups are bisected, so k bad clients cost O(k log n) elements.
+// Returns the number of valid clients.
+size_t batch_check_ones(const size_t n,
+                        const size_t m,
+                        const fmpz_t* const arith,
+                        const bool* const parity,
+                        const int serverfd,
+                        const int server_num,
+                        bool* const valid
+                        ) {
+    auto start = clock_start();
+    fmpz_arena_phase("check");
+    const uint64_t mod = fmpz_get_ui(Int_Modulus);
+
+    // Fresh coefficients, only after all clients have sent
+    uint64_t seed[2];
+    if (server_num == 0) {
+        emp::PRG().random_data(seed, sizeof(seed));
+        send_uint64_batch(serverfd, seed, 2);
+        send_bool_batch(serverfd, valid, n);
+    } else {
+        recv_uint64_batch(serverfd, seed, 2);
+        recv_bool_batch(serverfd, valid, n);
+    }
+    emp::PRG prg(seed);
+
+    // Prefix sums of sum_j r_ij (x_ij - 1) and xor_j (p_ij ? mask_ij : 0) ^ mask_ij
+    // Server 0 takes the -1 and ^ mask parts.
+    uint64_t* const pre_x = new uint64_t[n + 1];
+    uint64_t* const pre_p = new uint64_t[n + 1];
+    uint64_t* const coef = new uint64_t[2 * m];
+    pre_x[0] = 0;
+    pre_p[0] = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        uint64_t x = 0, p = 0;
+        prg.random_data(coef, 2 * m * sizeof(uint64_t));
+        for (unsigned int j = 0; valid[i] and j < m; j++) {
+            const uint64_t r = coef[2 * j] % mod;
+            uint64_t v = fmpz_get_ui(arith[i * m + j]);
+            if (server_num == 0)
+                v = submod(v, 1, mod);
+            x = addmod(x, mulmod(r, v, mod), mod);
+            if (parity == nullptr)
+                continue;
+            if (parity[i * m + j])
+                p ^= coef[2 * j + 1];
+            if (server_num == 0)
+                p ^= coef[2 * j + 1];
+        }
+        pre_x[i + 1] = addmod(pre_x[i], x, mod);
+        pre_p[i + 1] = pre_p[i] ^ p;
+    }
+    delete[] coef;
+
+    // Bisect [lo, hi) groups that fail
+    std::vector<std::pair<size_t, size_t>> groups = {{0, n}};
+    size_t rounds = 0, sent = 0;
+    while (!groups.empty()) {
+        const size_t k = groups.size();
+        uint64_t* const gx = new uint64_t[k];
+        uint64_t* const gp = new uint64_t[k];
+        bool* const pass = new bool[k];
+        for (unsigned int g = 0; g < k; g++) {
+            gx[g] = submod(pre_x[groups[g].second], pre_x[groups[g].first], mod);
+            gp[g] = pre_p[groups[g].second] ^ pre_p[groups[g].first];
+        }
+
+        if (server_num == 1) {
+            sent += send_uint64_batch(serverfd, gx, k);
+            sent += send_uint64_batch(serverfd, gp, k);
+            recv_bool_batch(serverfd, pass, k);
+        } else {
+            uint64_t* const gx_other = new uint64_t[k];
+            uint64_t* const gp_other = new uint64_t[k];
+            recv_uint64_batch(serverfd, gx_other, k);
+            recv_uint64_batch(serverfd, gp_other, k);
+            for (unsigned int g = 0; g < k; g++)
+                pass[g] = (addmod(gx[g], gx_other[g], mod) == 0
+                           and gp[g] == gp_other[g]);
+            delete[] gx_other;
+            delete[] gp_other;
+            sent += send_bool_batch(serverfd, pass, k);
+        }
+
+        std::vector<std::pair<size_t, size_t>> next;
+        for (unsigned int g = 0; g < k; g++) {
+            if (pass[g])
+                continue;
+            const size_t lo = groups[g].first, hi = groups[g].second;
+            if (hi - lo == 1) {
+                valid[lo] = false;
+                continue;
+            }
+            const size_t mid = lo + (hi - lo) / 2;
+            next.push_back({lo, mid});
+            next.push_back({mid, hi});
+        }
+        groups.swap(next);
+        delete[] gx;
+        delete[] gp;
+        delete[] pass;
+        rounds++;
+    }
+    delete[] pre_x;
+    delete[] pre_p;
+
+    size_t num_valid = 0;
+    for (unsigned int i = 0; i < n; i++)
+        num_valid += valid[i];
+    std::cout << "batch check: " << rounds << " rounds, " << sent << " bytes, ";
+    std::cout << sec_from(start) << " sec" << std::endl;
+    return num_valid;
+}
+
+// Per client sum and parity of each row of one-hot shares, for batch_check_ones.
+// Rows are w wide, except the last, which is last_w wide (e.g. heavy's freq layer).
+// shares are packed bits, back to back. sums and parity are [num_inputs * num_rows].
+void row_checks(const size_t num_inputs,
+                const size_t num_rows,
+                const size_t w,
+                const size_t last_w,
+                const uint64_t* const shares,
+                const fmpz_t* const shares_p,
+                fmpz_t* const sums,
+                bool* const parity
+                ) {
+    const size_t share_size = (num_rows - 1) * w + last_w;
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        for (unsigned int j = 0; j < num_rows; j++) {
+            const size_t r = i * num_rows + j;
+            const size_t len = (j == num_rows - 1) ? last_w : w;
+            const size_t start = i * share_size + j * w;
+            parity[r] = range_parity(shares, start, len);
+            fmpz_zero(sums[r]);
+            for (unsigned int k = 0; k < len; k++)
+                fmpz_add(sums[r], sums[r], shares_p[start + k]);
+            fmpz_mod(sums[r], sums[r], Int_Modulus);
+        }
+    }
+}
+
 size_t accumulate(const size_t num_inputs,
                   const size_t num_values,
                   const fmpz_t* const shares_p,
                   const bool* const valid,
                   fmpz_t* const ans
                   ) {
+    fmpz_arena_phase("accumulate");
     size_t num_valid = 0;
 
     for (unsigned int j = 0; j < num_values; j++)
@@ -294,73 +621,427 @@ size_t accumulate(const size_t num_inputs,
     return num_valid;
 }
 
-returnType bit_sum(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
-    std::unordered_map<std::string, bool> share_map;
+// Sum of the valid shares' values, as fmpz shares of [num_values]
+// Same as share_convert then accumulate, but fused for OT, with O(num_values) space.
+// valid must already match across servers.
+size_t share_sum(const size_t num_shares,
+                 const size_t num_values,
+                 const size_t* const num_bits,
+                 const uint64_t* const shares_2,
+                 const bool* const valid,
+                 fmpz_t* const ans
+                 ) {
+    if (!(USE_OT_B2A and USE_FUSED_SUM)) {
+        fmpz_t* const shares_p = share_convert(num_shares, num_values, num_bits, shares_2);
+        const size_t num_valid = accumulate(num_shares, num_values, shares_p, valid, ans);
+        clear_fmpz_array(shares_p, num_shares * num_values);
+        return num_valid;
+    }
+
     auto start = clock_start();
+    fmpz_arena_phase("accumulate");
+    size_t num_valid = 0;
+    for (unsigned int i = 0; i < num_shares; i++)
+        num_valid += valid[i];
+    correlated_store->b2a_ot_sum(num_shares, num_values, num_bits, shares_2,
+                                 valid, ans, fmpz_get_ui(Int_Modulus));
+    std::cout << "Share sum time: " << sec_from(start) << std::endl;
+    return num_valid;
+}
 
-    BitShare share;
-    const unsigned int total_inputs = msg.num_of_inputs;
+// One-hot check for DPF expanded rows, which have no bit shares for parity.
+// With shared random r, row x is one-hot iff sum x = 1 and (sum r_k x_k)^2 = sum r_k^2 x_k,
+// except with probability 2/p. The square takes one arithmetic triple per row.
+// All check values then go through batch_check_ones. shares are [n * share_size].
+size_t dpf_check_rows(const size_t n,
+                      const size_t num_rows,
+                      const size_t w,
+                      const size_t last_w,
+                      const uint64_t* const shares,
+                      const int serverfd,
+                      const int server_num,
+                      bool* const valid
+                      ) {
+    const uint64_t mod = fmpz_get_ui(Int_Modulus);
+    const size_t share_size = (num_rows - 1) * w + last_w;
+    const size_t N = n * num_rows;
 
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share, sizeof(BitShare));
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
-        if (share_map.find(pk) != share_map.end())
-            continue;
-        share_map[pk] = share.val;
+    // Sketch coefficients, only after all clients have sent
+    uint64_t seed[2];
+    if (server_num == 0) {
+        emp::PRG().random_data(seed, sizeof(seed));
+        send_uint64_batch(serverfd, seed, 2);
+    } else {
+        recv_uint64_batch(serverfd, seed, 2);
     }
+    emp::PRG prg(seed);
+    const size_t max_w = std::max(w, last_w);
+    uint64_t* const r = new uint64_t[max_w];
+    uint64_t* const r2 = new uint64_t[max_w];
+    prg.random_data(r, max_w * sizeof(uint64_t));
+    for (unsigned int k = 0; k < max_w; k++) {
+        r[k] %= mod;
+        r2[k] = mulmod(r[k], r[k], mod);
+    }
+
+    // z, z* and sum of each row
+    uint64_t* const z = new uint64_t[N];
+    uint64_t* const zs = new uint64_t[N];
+    uint64_t* const sums = new uint64_t[N];
+    for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int j = 0; j < num_rows; j++) {
+            const size_t t = i * num_rows + j;
+            const size_t len = (j == num_rows - 1) ? last_w : w;
+            const uint64_t* const x = &shares[i * share_size + j * w];
+            z[t] = zs[t] = sums[t] = 0;
+            for (unsigned int k = 0; k < len; k++) {
+                z[t] = addmod(z[t], mulmod(r[k], x[k], mod), mod);
+                zs[t] = addmod(zs[t], mulmod(r2[k], x[k], mod), mod);
+                sums[t] = addmod(sums[t], x[k], mod);
+            }
+        }
+    }
+    delete[] r;
+    delete[] r2;
+
+    // Open z - a, z - b for z^2 = c + (z - a) b + (z - b) a + (z - a)(z - b)
+    const TripleView trip = correlated_store->getArithTriples(N);
+    uint64_t* const de = new uint64_t[2 * N];
+    for (unsigned int t = 0; t < N; t++) {
+        de[2 * t] = submod(z[t], trip.a[t], mod);
+        de[2 * t + 1] = submod(z[t], trip.b[t], mod);
+    }
+    if (server_num == 1) {
+        send_uint64_batch(serverfd, de, 2 * N);
+        recv_uint64_batch(serverfd, de, 2 * N);
+    } else {
+        uint64_t* const de_other = new uint64_t[2 * N];
+        recv_uint64_batch(serverfd, de_other, 2 * N);
+        for (unsigned int t = 0; t < 2 * N; t++)
+            de[t] = addmod(de[t], de_other[t], mod);
+        delete[] de_other;
+        send_uint64_batch(serverfd, de, 2 * N);
+    }
+
+    // Both should be 1: z^2 - z* + 1, and the sum
+    fmpz_t* checks; new_fmpz_array(&checks, 2 * N);
+    for (unsigned int t = 0; t < N; t++) {
+        const uint64_t D = de[2 * t], E = de[2 * t + 1];
+        uint64_t sq = addmod(trip.c[t], mulmod(D, trip.b[t], mod), mod);
+        sq = addmod(sq, mulmod(E, trip.a[t], mod), mod);
+        if (server_num == 0)
+            sq = addmod(addmod(sq, mulmod(D, E, mod), mod), 1, mod);
+        fmpz_set_ui(checks[2 * t], submod(sq, zs[t], mod));
+        fmpz_set_ui(checks[2 * t + 1], sums[t]);
+    }
+    delete[] de;
+    delete[] z;
+    delete[] zs;
+    delete[] sums;
+
+    const size_t num_valid = batch_check_ones(n, 2 * num_rows, checks, nullptr,
+                                              serverfd, server_num, valid);
+    clear_fmpz_array(checks, 2 * N);
+    return num_valid;
+}
+
+// Clients per chunk when streaming over a spilled arena.
+// Server 1's choice, so both servers chunk the same way.
+size_t sync_stream_rows(const IngestArena& arena, const size_t bytes_per_row,
+                        const int serverfd, const int server_num) {
+    size_t chunk = arena.stream_rows(bytes_per_row);
+    if (server_num == 1)
+        send_size(serverfd, chunk);
+    else
+        recv_size(serverfd, chunk);
+    return chunk;
+}
+
+// DPF mode of FREQ, COUNTMIN and HEAVY.
+// Each client sends its pk, then a DPF key per row, rows laid out as in row_checks.
+// Keys expand straight to arithmetic shares, so no daBits, and are checked with dpf_check_rows.
+// On server 0, sets ans [share_size] to the total of valid clients, and num_inputs.
+returnType onehot_dpf_sum(const initMsg msg, const int clientfd, const int serverfd,
+                          const int server_num, const size_t num_rows,
+                          const size_t w, const size_t last_w,
+                          const EpochTask& task, fmpz_t* const ans, size_t& num_inputs) {
+    auto start = clock_start();
+
+    const uint64_t mod = fmpz_get_ui(Int_Modulus);
+    const unsigned int total_inputs = msg.num_of_inputs;
+    const size_t depth = dpf_depth(w), last_depth = dpf_depth(last_w);
+    const size_t key_len = (num_rows - 1) * dpf_key_words(depth) + dpf_key_words(last_depth);
+    const size_t share_size = (num_rows - 1) * w + last_w;
+
+    IngestArena arena(key_len, total_inputs);
+    SubmitQueue queue(submit_queue_slots(key_len), key_len);
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs,
+        PK_LENGTH + key_len * sizeof(uint64_t), arena, queue,
+        [key_len](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            return recv_in(fd, pk, PK_LENGTH) + recv_uint64_batch(fd, row, key_len);
+        });
 
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
+
+    correlated_store->checkArithTriples(total_inputs * num_rows);
+
     start = clock_start();
     auto start2 = clock_start();
-
     int server_bytes = 0;
 
+    // Line keys up in server 1's pk order. Server 1's valid is filled in by the check.
+    size_t* perm;
+    bool* valid;
+    num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    const uint64_t* const ordered = arena.ordered(perm, server_num == 0 ? valid : nullptr, num_inputs);
+    delete[] perm;
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+
+    // A chunk of clients at a time, which is the whole batch unless the arena spilled
+    const size_t chunk = sync_stream_rows(arena, share_size * sizeof(uint64_t), serverfd, server_num);
+    float expand_time = 0, validate_time = 0, accumulate_time = 0;
+    size_t num_valid = 0;
+    uint64_t* const sum = new uint64_t[share_size];
+    memset(sum, 0, share_size * sizeof(uint64_t));
+    for (size_t c = 0; c < num_inputs; c += chunk) {
+        start2 = clock_start();
+        const size_t n = std::min(chunk, num_inputs - c);
+        bool* const chunk_valid = &valid[c];
+
+        uint64_t* const shares = new uint64_t[n * share_size];
+        for (unsigned int i = 0; i < n; i++) {
+            const uint64_t* key = &ordered[(c + i) * key_len];
+            for (unsigned int j = 0; j < num_rows; j++) {
+                const bool last = (j == num_rows - 1);
+                dpf_eval_all(server_num, last ? last_depth : depth, key,
+                             last ? last_w : w, mod, &shares[i * share_size + j * w]);
+                key += dpf_key_words(depth);
+            }
+        }
+        expand_time += sec_from(start2);
+        start2 = clock_start();
+
+        num_valid += dpf_check_rows(n, num_rows, w, last_w, shares,
+                                    serverfd, server_num, chunk_valid);
+        validate_time += sec_from(start2);
+        start2 = clock_start();
+
+        for (unsigned int i = 0; i < n; i++) {
+            if (!chunk_valid[i])
+                continue;
+            for (unsigned int k = 0; k < share_size; k++)
+                sum[k] = addmod(sum[k], shares[i * share_size + k], mod);
+        }
+        delete[] shares;
+        accumulate_time += sec_from(start2);
+    }
+    delete[] valid;
+    std::cout << "expand time: " << expand_time << std::endl;
+    std::cout << "validate time: " << validate_time << std::endl;
+    std::cout << "accumulate time: " << accumulate_time << std::endl;
+    std::cout << "total compute time: " << sec_from(start) << std::endl;
+
+    log_epoch(serverfd, server_num, task, sum, share_size, num_valid, total_inputs);
+
     if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs];
-        int i = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            shares[i] = share.second;
-            i++;
+        server_bytes += send_uint64_batch(serverfd, sum, share_size);
+        delete[] sum;
+        std::cout << "sent server bytes: " << server_bytes << std::endl;
+        return RET_NO_ANS;
+    }
+
+    uint64_t* const sum_other = new uint64_t[share_size];
+    recv_uint64_batch(serverfd, sum_other, share_size);
+    for (unsigned int k = 0; k < share_size; k++)
+        fmpz_set_ui(ans[k], addmod(sum[k], sum_other[k], mod));
+    delete[] sum;
+    delete[] sum_other;
+
+    std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
+    if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
+        std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+        return RET_INVALID;
+    }
+    return RET_ANS;
+}
+
+// Bit vector version of onehot_dpf_sum: clients send each row as boolean shares.
+// Shares stay packed, from the socket through the daBit conversion and checks.
+returnType onehot_bits_sum(const initMsg msg, const int clientfd, const int serverfd,
+                           const int server_num, const size_t num_rows,
+                           const size_t w, const size_t last_w,
+                           const EpochTask& task, fmpz_t* const ans, size_t& num_inputs) {
+    auto start = clock_start();
+
+    const unsigned int total_inputs = msg.num_of_inputs;
+    const size_t share_size = (num_rows - 1) * w + last_w;
+    const size_t share_words = words_for(share_size);
+
+    IngestArena arena(share_words, total_inputs);
+    SubmitQueue queue(submit_queue_slots(share_words), share_words);
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs,
+        PK_LENGTH + (share_size + 7) / 8, arena, queue,
+        [share_size](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            return recv_in(fd, pk, PK_LENGTH) + recv_packed_bits(fd, row, share_size);
+        });
+
+    std::cout << "Received " << total_inputs << " total shares" << std::endl;
+    std::cout << "bytes from client: " << num_bytes << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
+
+    correlated_store->checkDaBits(total_inputs * share_size);
+
+    start = clock_start();
+    auto start2 = clock_start();
+    int server_bytes = 0;
+
+    // Server 1's valid is filled in by the check
+    size_t* perm;
+    bool* valid;
+    num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+
+    // A chunk of clients at a time, which is the whole batch unless the arena spilled.
+    // The daBit shares take a word per bit, so they bound the chunk.
+    const size_t chunk = sync_stream_rows(arena, share_size * sizeof(fmpz_t), serverfd, server_num);
+    float convert_time = 0, validate_time = 0, accumulate_time = 0;
+    size_t num_valid = 0;
+    fmpz_t* part; new_fmpz_array(&part, share_size);
+    for (unsigned int j = 0; j < share_size; j++)
+        fmpz_zero(ans[j]);
+    for (size_t c = 0; c < num_inputs; c += chunk) {
+        start2 = clock_start();
+        const size_t n = std::min(chunk, num_inputs - c);
+        bool* const chunk_valid = &valid[c];
+
+        // In server 1's pk order, back to back, so the conversion has no padding
+        const size_t num_bits = n * share_size;
+        uint64_t* const shares = new uint64_t[words_for(num_bits)];
+        memset(shares, 0, words_for(num_bits) * sizeof(uint64_t));
+        for (unsigned int i = 0; i < n; i++) {
+            if (server_num == 1 or chunk_valid[i])
+                or_bits_at(shares, i * share_size, arena.row(perm[c + i]), share_size);
         }
-        std::cout << "pk time: " << sec_from(start2) << std::endl;
+
+        fmpz_arena_phase("convert");
+        fmpz_t* const shares_p = correlated_store->b2a_daBit_single(num_bits, shares);
+        convert_time += sec_from(start2);
+        start2 = clock_start();
+
+        // Each row should have exactly one 1: sum 1 and parity 1
+        const size_t num_checks = n * num_rows;
+        bool* const parity = new bool[num_checks];
+        fmpz_t* sums; new_fmpz_array(&sums, num_checks);
+        row_checks(n, num_rows, w, last_w, shares, shares_p, sums, parity);
+        delete[] shares;
+
+        batch_check_ones(n, num_rows, sums, parity, serverfd, server_num, chunk_valid);
+        delete[] parity;
+        clear_fmpz_array(sums, num_checks);
+        validate_time += sec_from(start2);
         start2 = clock_start();
 
+        num_valid += accumulate(n, share_size, shares_p, chunk_valid, part);
+        for (unsigned int j = 0; j < share_size; j++) {
+            fmpz_add(ans[j], ans[j], part[j]);
+            fmpz_mod(ans[j], ans[j], Int_Modulus);
+        }
+        clear_fmpz_array(shares_p, num_bits);
+        accumulate_time += sec_from(start2);
+    }
+    clear_fmpz_array(part, share_size);
+    delete[] perm;
+    delete[] valid;
+    std::cout << "convert time: " << convert_time << std::endl;
+    std::cout << "validate time: " << validate_time << std::endl;
+    std::cout << "accumulate time: " << accumulate_time << std::endl;
+    std::cout << "total compute time: " << sec_from(start) << std::endl;
+
+    log_epoch(serverfd, server_num, task, ans, share_size, num_valid, total_inputs);
+
+    if (server_num == 1) {
+        server_bytes += send_fmpz_batch(serverfd, ans, share_size);
+        std::cout << "sent server bytes: " << server_bytes << std::endl;
+        return RET_NO_ANS;
+    }
+
+    fmpz_t* b; new_fmpz_array(&b, share_size);
+    recv_fmpz_batch(serverfd, b, share_size);
+    for (unsigned int j = 0; j < share_size; j++) {
+        fmpz_add(ans[j], ans[j], b[j]);
+        fmpz_mod(ans[j], ans[j], Int_Modulus);
+    }
+    clear_fmpz_array(b, share_size);
+
+    std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
+    std::cout << "sent server bytes: " << server_bytes << std::endl;
+    if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
+        std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+        return RET_INVALID;
+    }
+    return RET_ANS;
+}
+
+returnType bit_sum(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
+    auto start = clock_start();
+
+    const unsigned int total_inputs = msg.num_of_inputs;
+    if (!admit_batch(serverfd, "BIT_SUM", true, total_inputs, sizeof(BitShare)))
+        return RET_INVALID;
+    IngestArena arena(1, total_inputs);
+    SubmitQueue queue(SUBMIT_QUEUE_SLOTS, 1);
+
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs, sizeof(BitShare), arena, queue,
+        [](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            BitShare share;
+            const int bytes = recv_in(fd, &share, sizeof(BitShare));
+            memcpy(pk, share.pk, PK_LENGTH);
+            row[0] = share.val;
+            return bytes;
+        });
+
+    std::cout << "Received " << total_inputs << " total shares" << std::endl;
+    std::cout << "bytes from client: " << num_bytes << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
+    start = clock_start();
+    auto start2 = clock_start();
+
+    int server_bytes = 0;
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    bool* const shares = new bool[num_inputs];
+    for (unsigned int i = 0; i < num_inputs; i++)
+        shares[i] = (server_num == 1 or valid[i]) and arena.row(perm[i])[0];
+    delete[] perm;
+    std::cout << "pk time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+
+    // Mod 2^64. Only server 0 knows the valid count.
+    const EpochTask task = {"bitsum", {BIT_SUM}, 0};
+
+    if (server_num == 1) {
+        delete[] valid;
         const uint64_t b = bitsum_ot_receiver(ot0, shares, num_inputs);
         delete[] shares;
 
+        log_epoch(serverfd, server_num, task, &b, 1, 0, total_inputs);
         send_uint64(serverfd, b);
         std::cout << "convert time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
         return RET_NO_ANS;
     } else {
-        size_t num_inputs, num_valid = 0;
-        recv_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs];
-        bool* const valid = new bool[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-
-            bool is_valid = (share_map.find(pk) != share_map.end());
-            valid[i] = is_valid;
-            if (!is_valid)
-                continue;
-            num_valid++;
-            shares[i] = share_map[pk];
-        }
-        std::cout << "pk time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+        size_t num_valid = 0;
+        for (unsigned int i = 0; i < num_inputs; i++)
+            num_valid += valid[i];
 
         const uint64_t a = bitsum_ot_sender(ot0, shares, valid, num_inputs);
         delete[] shares;
         delete[] valid;
+        log_epoch(serverfd, server_num, task, &a, 1, num_valid, total_inputs);
 
         uint64_t b;
         recv_uint64(serverfd, b);
@@ -378,206 +1059,260 @@ returnType bit_sum(const initMsg msg, const int clientfd, const int serverfd, co
     }
 }
 
-returnType int_sum(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
-    std::unordered_map<std::string, uint64_t> share_map;
+// int_sum's group by: one conversion over the batch, then sums per label.
+// rows are the synced [num_inputs * (num_values + 1)]. Takes nbits and valid.
+returnType int_sum_by_label(const size_t total_inputs, const size_t num_inputs,
+                            const size_t num_values, size_t* const nbits,
+                            const uint64_t* const rows, bool* const valid,
+                            const int serverfd, const int server_num, uint64_t* const ans) {
     auto start = clock_start();
-    
-    int nvalues = 10000;
-    std::cout << "Using gsize of " << nvalues << std::endl;
 
-    IntShare share;
-    const uint64_t max_val = 1ULL << msg.num_bits;
-    const unsigned int total_inputs = msg.num_of_inputs;
-    //const size_t nbits[1] = {msg.num_bits};
-    size_t* nbits = (size_t*) malloc(nvalues * sizeof(size_t));
-    for(int i = 0; i < nvalues; i++){
-        nbits[i] = msg.num_bits;
+    uint64_t* const shares = new uint64_t[num_inputs * num_values];
+    uint64_t* const labels = new uint64_t[num_inputs];
+    split_labels(num_inputs, num_values, rows, shares, labels);
+    int server_bytes = check_labels(serverfd, server_num, num_inputs, labels, valid);
+    if (server_num == 1)
+        recv_bool_batch(serverfd, valid, num_inputs);
+    else
+        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
+
+    fmpz_t* const shares_p = share_convert(num_inputs, num_values, nbits, shares);
+    delete[] shares;
+    delete[] nbits;
+    LabelSums by_label(MIN_LABEL_COUNT, MAX_LABELS);
+    const size_t num_valid = accumulate(num_inputs, num_values, shares_p, valid, labels, by_label);
+    clear_fmpz_array(shares_p, num_inputs * num_values);
+    delete[] labels;
+    delete[] valid;
+    std::cout << "convert+accumulate time: " << sec_from(start) << std::endl;
+
+    uint64_t* const sums = reveal_label_sums(serverfd, server_num, by_label);
+    std::cout << "sent server bytes: " << server_bytes << std::endl;
+    if (server_num == 1)
+        return RET_NO_ANS;
+
+    std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
+    if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
+        std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+        delete[] sums;
+        return RET_INVALID;
     }
 
-    // Their code supports all nbits like 32, 64, but 
-    // fixing it to close to 64 (doesn't allow 64) because OT messages can support max 64
-    // and in fact default to 64 since mod is not passed to it.
-    assert(nbits[0] == 63 && "Use 64 bits. See comment above");
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share, sizeof(IntShare));
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
+    print_left_out(by_label);
+    // Only over revealed labels, else it gives away the suppressed ones
+    const uint64_t mod = fmpz_get_ui(Int_Modulus);
+    memset(ans, 0, num_values * sizeof(uint64_t));
+    size_t num_revealed = 0;
+    for (unsigned int g = 0; g < by_label.size(); g++) {
+        std::cout << "Label " << by_label.labels[g] << " (" << by_label.counts[g] << "):";
+        for (unsigned int j = 0; j < num_values; j++) {
+            std::cout << " " << sums[g * num_values + j];
+            ans[j] = addmod(ans[j], sums[g * num_values + j], mod);
+        }
+        std::cout << std::endl;
+        num_revealed += by_label.counts[g];
+    }
+    delete[] sums;
+    if (num_revealed == 0) {
+        std::cout << "No labels revealed" << std::endl;
+        return RET_INVALID;
+    }
+    return RET_ANS;
+}
 
-        if (share_map.find(pk) != share_map.end()
-            or share.val >= max_val)
-            continue;
-        share_map[pk] = share.val;
+// Vector int sum. Each client sends k = msg.max_inp values,
+// with value j of num_bits[j] bits. The widths follow the initMsg.
+// With msg.group_by, each client then sends a public label, and server 0 also
+// prints the sums per label. ans is still over all clients.
+returnType int_sum(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t* const ans) {
+    auto start = clock_start();
 
-        // std::cout << "share[" << i << "] = " << share.val << std::endl;
+    const unsigned int total_inputs = msg.num_of_inputs;
+    const size_t num_values = msg.max_inp;
+    const size_t row_words = num_values + msg.group_by;
+    const size_t frame_bytes = PK_LENGTH + row_words * sizeof(uint64_t);
+    if (!admit_batch(serverfd, "INT_SUM", num_values > 0 and num_values <= MAX_ROW_WORDS,
+                     total_inputs, frame_bytes))
+        return RET_INVALID;
+
+    uint64_t* const bits_in = new uint64_t[num_values];
+    int num_bytes = recv_uint64_batch(clientfd, bits_in, num_values);
+    size_t* const nbits = new size_t[num_values];
+    uint64_t* const max_val = new uint64_t[num_values];
+    bool bad_bits = false;
+    for (unsigned int j = 0; j < num_values; j++) {
+        nbits[j] = bits_in[j];
+        // Mod is just over 2^63, so 63 bits is the most that fits
+        bad_bits |= (nbits[j] == 0 or nbits[j] > 63);
+        max_val[j] = 1ULL << (nbits[j] % 64);
+    }
+
+    // Make sure the client gave both servers the same widths
+    uint64_t* const bits_other = new uint64_t[num_values];
+    send_uint64_batch(serverfd, bits_in, num_values);
+    recv_uint64_batch(serverfd, bits_other, num_values);
+    bad_bits |= (memcmp(bits_in, bits_other, num_values * sizeof(uint64_t)) != 0);
+    delete[] bits_in;
+    delete[] bits_other;
+
+    // Both servers see the same, so both stop here before taking any shares
+    if (bad_bits) {
+        std::cout << "Bad or mismatched bit widths" << std::endl;
+        delete[] nbits;
+        delete[] max_val;
+        return RET_INVALID;
     }
 
+    IngestArena arena(row_words, total_inputs);
+    SubmitQueue queue(submit_queue_slots(row_words), row_words);
+    num_bytes += ingest_submissions(&clientfd, 1, total_inputs, frame_bytes, arena, queue,
+        [num_values, row_words, max_val](const int fd, char* const pk, uint64_t* const val, bool& keep) {
+            const int bytes = recv_in(fd, pk, PK_LENGTH) + recv_uint64_batch(fd, val, row_words);
+            for (unsigned int j = 0; j < num_values; j++)
+                keep &= (val[j] < max_val[j]);
+            return bytes;
+        });
+    delete[] max_val;
+
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
 
-    if (USE_OT_B2A == false) {
-        correlated_store->checkDaBits(total_inputs * msg.num_bits);
-    }
+    precompute_convert(total_inputs, num_values, nbits);
 
     start = clock_start();
     auto start2 = clock_start();
 
     int server_bytes = 0;
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    const uint64_t* const shares = arena.ordered(perm, server_num == 0 ? valid : nullptr, num_inputs);
+    delete[] perm;
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
 
-    if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
-        uint64_t* const shares = new uint64_t[num_inputs];
-        int i = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            shares[i] = share.second;
-            i++;
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        std::cout << "num_inputs, nvalues (gsize?), nbits " << num_inputs << " " << nvalues << " " << nbits[0] << std::endl;
-        fmpz_t* const shares_p = share_convert(num_inputs, nvalues, nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    if (msg.group_by)
+        return int_sum_by_label(total_inputs, num_inputs, num_values, nbits, shares,
+                                valid, serverfd, server_num, ans);
+
+    const EpochTask task = {"intsum_" + std::to_string(num_values), {INT_SUM, num_values},
+                            fmpz_get_ui(Int_Modulus)};
 
-        bool* const valid = new bool[num_inputs];
-        std::cout << "Receive result share from other server" << std::endl;
+    if (server_num == 1) {
+        // Valid first, so the sum can skip invalid ones
         recv_bool_batch(serverfd, valid, num_inputs);
 
-        fmpz_t* b; new_fmpz_array(&b, 1);
-        accumulate(num_inputs, 1, shares_p, valid, b);
-        clear_fmpz_array(shares_p, num_inputs);
-        delete[] shares;
+        fmpz_t* b; new_fmpz_array(&b, num_values);
+        const size_t num_valid = share_sum(num_inputs, num_values, nbits, shares, valid, b);
+        delete[] nbits;
         delete[] valid;
 
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
+        std::cout << "convert+accumulate time: " << sec_from(start2) << std::endl;
+        log_epoch(serverfd, server_num, task, b, num_values, num_valid, total_inputs);
 
-        send_fmpz(serverfd, b[0]);
-        clear_fmpz_array(b, 1);
+        send_fmpz_batch(serverfd, b, num_values);
+        clear_fmpz_array(b, num_values);
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
         return RET_NO_ANS;
     } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-        uint64_t* const shares = new uint64_t[num_inputs];
-        bool* const valid = new bool[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-
-            bool is_valid = (share_map.find(pk) != share_map.end());
-            valid[i] = is_valid;
-            if (!is_valid)
-                continue;
-            shares[i] = share_map[pk];
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        std::cout << "num_inputs, nvalues (gsize?), nbits " << num_inputs << " " << nvalues << " " << nbits[0] << std::endl;
-        fmpz_t* const shares_p = share_convert(num_inputs, nvalues, nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        std::cout << "Send result share to other server" << std::endl;
         server_bytes += send_bool_batch(serverfd, valid, num_inputs);
-        
-        fmpz_t* a; new_fmpz_array(&a, 1);
-        size_t num_valid = accumulate(num_inputs, 1, shares_p, valid, a);
-        clear_fmpz_array(shares_p, num_inputs);
-        delete[] shares;
+
+        fmpz_t* a; new_fmpz_array(&a, num_values);
+        size_t num_valid = share_sum(num_inputs, num_values, nbits, shares, valid, a);
+        delete[] nbits;
         delete[] valid;
+        log_epoch(serverfd, server_num, task, a, num_values, num_valid, total_inputs);
 
-        fmpz_t b; fmpz_init(b);
-        recv_fmpz(serverfd, b);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
+        fmpz_t* b; new_fmpz_array(&b, num_values);
+        recv_fmpz_batch(serverfd, b, num_values);
+        std::cout << "convert+accumulate time: " << sec_from(start2) << std::endl;
         std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
         if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
             std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+            clear_fmpz_array(a, num_values);
+            clear_fmpz_array(b, num_values);
             return RET_INVALID;
         }
 
-        fmpz_add(b, b, a[0]);
-        fmpz_mod(b, b, Int_Modulus);
-        clear_fmpz_array(a, 1);
-        ans = fmpz_get_ui(b);
-        fmpz_clear(b);
+        for (unsigned int j = 0; j < num_values; j++) {
+            fmpz_add(b[j], b[j], a[j]);
+            fmpz_mod(b[j], b[j], Int_Modulus);
+            ans[j] = fmpz_get_ui(b[j]);
+        }
+        clear_fmpz_array(a, num_values);
+        clear_fmpz_array(b, num_values);
         return RET_ANS;
     }
 }
 
 // For AND and OR
 returnType xor_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num, bool& ans) {
-    std::unordered_map<std::string, uint64_t> share_map;
     auto start = clock_start();
 
-    IntShare share;
     const unsigned int total_inputs = msg.num_of_inputs;
-
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share, sizeof(IntShare));
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
-
-        if (share_map.find(pk) != share_map.end())
-            continue;
-        share_map[pk] = share.val;
-    }
+    if (!admit_batch(serverfd, "AND/OR", true, total_inputs, sizeof(IntShare)))
+        return RET_INVALID;
+    IngestArena arena(1, total_inputs);
+    SubmitQueue queue(SUBMIT_QUEUE_SLOTS, 1);
+
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs, sizeof(IntShare), arena, queue,
+        [](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            IntShare share;
+            const int bytes = recv_in(fd, &share, sizeof(IntShare));
+            memcpy(pk, share.pk, PK_LENGTH);
+            row[0] = share.val;
+            return bytes;
+        });
 
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
     start = clock_start();
     auto start2 = clock_start();
 
     int server_bytes = 0;
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    // Arena rows to aggregate
+    bool* const mask = new bool[arena.size()];
+    memset(mask, 0, arena.size() * sizeof(bool));
 
     if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
-        uint64_t b = 0;
-        std::string* const pk_list = new std::string[num_inputs];
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            pk_list[idx] = share.first;
-            idx++;
-        }
         std::cout << "PK time: " << sec_from(start2) << std::endl;
         start2 = clock_start();
 
-        bool* const other_valid = new bool[num_inputs];
-        recv_bool_batch(serverfd, other_valid, num_inputs);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            if (!other_valid[i])
-                continue;
-            b ^= share_map[pk_list[i]];
-        }
-        delete[] other_valid;
+        recv_bool_batch(serverfd, valid, num_inputs);
+        for (unsigned int i = 0; i < num_inputs; i++)
+            mask[perm[i]] = valid[i];
+        delete[] valid;
+        delete[] perm;
+
+        uint64_t b;
+        xor_reduce(arena.data(), mask, arena.size(), 1, &b);
+        delete[] mask;
 
         send_uint64(serverfd, b);
-        delete[] pk_list;
         std::cout << "convert time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
         return RET_NO_ANS;
     } else {
-        size_t num_inputs, num_valid = 0;
-        recv_size(serverfd, num_inputs);
-        uint64_t a = 0;
-        bool* const valid = new bool[num_inputs];
-
+        size_t num_valid = 0;
         for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            valid[i] = (share_map.find(pk) != share_map.end());
             if (!valid[i])
                 continue;
             num_valid++;
-            a ^= share_map[pk];
+            mask[perm[i]] = true;
         }
+        delete[] perm;
+        uint64_t a;
+        xor_reduce(arena.data(), mask, arena.size(), 1, &a);
+        delete[] mask;
 
         std::cout << "PK + convert time: " << sec_from(start2) << std::endl;
         start2 = clock_start();
@@ -609,132 +1344,256 @@ returnType xor_op(const initMsg msg, const int clientfd, const int serverfd, con
     }
 }
 
-// For MAX and MIN
-returnType max_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
-    std::unordered_map<std::string, uint64_t*> share_map;
+// MAX and MIN from the log size bit encoding.
+// Word 0 of a share is the client's value v, and word 1 + k is a random nonzero
+// word if bit k of v is set, else 0. All XOR shared.
+// Goes from the top bit down, keeping a shared bit r per client of whether it
+// still matches the max so far. Each round ANDs r into bit k and its word,
+// then opens the XOR of the words, which is nonzero iff a client in the
+// running has bit k set. If so, that bit of the max is 1, and r = r AND bit k.
+returnType max_bit_encoding_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
     auto start = clock_start();
 
-    MaxShare share;
     const unsigned int total_inputs = msg.num_of_inputs;
-    const unsigned int B = msg.max_inp;
-    // Need this to have all share arrays stay in memory, for server1 later.
-    uint64_t* const shares = new uint64_t[total_inputs * (B + 1)];
-
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share.pk[0], PK_LENGTH);
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
-
-        num_bytes += recv_uint64_batch(clientfd, &shares[i*(B+1)], B+1);
+    const uint64_t B = msg.max_inp;
+    unsigned int nbits = 1;
+    while (nbits < 64 and (B >> nbits))
+        nbits++;
+    const size_t row_len = nbits + 1;
+    const size_t frame_bytes = PK_LENGTH + row_len * sizeof(uint64_t);
+    if (!admit_batch(serverfd, "MAX", true, total_inputs, frame_bytes))
+        return RET_INVALID;
+    IngestArena arena(row_len, total_inputs);
+    SubmitQueue queue(submit_queue_slots(row_len), row_len);
 
-        if (share_map.find(pk) != share_map.end())
-            continue;
-        share_map[pk] = &shares[i*(B+1)];
-    }
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs, frame_bytes, arena, queue,
+        [&arena](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            return recv_in(fd, pk, PK_LENGTH) + recv_uint64_batch(fd, row, arena.width());
+        });
 
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
     start = clock_start();
     auto start2 = clock_start();
 
     int server_bytes = 0;
+    size_t* rows;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, rows, valid, server_bytes);
+    if (server_num == 1)
+        recv_bool_batch(serverfd, valid, num_inputs);
+    else
+        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
+    size_t num_valid = 0;
+    for (unsigned int i = 0; i < num_inputs; i++)
+        num_valid += valid[i];
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+
+    if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
+        std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+        delete[] rows;
+        delete[] valid;
+        return server_num == 0 ? RET_INVALID : RET_NO_ANS;
+    }
+
+    // Per round: words of every client, then their bits, packed
+    const size_t n = num_inputs;
+    const size_t n_words = words_for(n);
+    const size_t round_words = n + n_words;
+    correlated_store->checkBoolTriples(64 * round_words * nbits);
+
+    uint64_t* const x = new uint64_t[round_words];
+    uint64_t* const y = new uint64_t[round_words];
+    // Shared running bit. Public valid to start, so server 0 holds it.
+    uint64_t* const running = new uint64_t[n_words];
+    if (server_num == 0)
+        pack_bits(running, valid, n);
+    else
+        memset(running, 0, n_words * sizeof(uint64_t));
+
+    uint64_t max_val = 0;
+    for (int k = nbits - 1; k >= 0; k--) {
+        memset(&x[n], 0, n_words * sizeof(uint64_t));
+        for (unsigned int i = 0; i < n; i++) {
+            const uint64_t* const row = arena.row(rows[i]);
+            const bool r = get_bit(running, i);
+            x[i] = valid[i] ? row[1 + k] : 0;
+            y[i] = r ? ~0ULL : 0;
+            if (valid[i] and ((row[0] >> k) & 1))
+                x[n + i / 64] |= 1ULL << (i % 64);
+        }
+        memcpy(&y[n], running, n_words * sizeof(uint64_t));
+
+        uint64_t* const z = correlated_store->multiplyBoolShares(64 * round_words, x, y);
+
+        uint64_t this_or, other_or;
+        xor_reduce(z, valid, n, 1, &this_or);
+        send_uint64(serverfd, this_or);
+        recv_uint64(serverfd, other_or);
+        if (this_or ^ other_or) {
+            max_val |= 1ULL << k;
+            memcpy(running, &z[n], n_words * sizeof(uint64_t));
+        }
+        delete[] z;
+    }
+    // d, e and the opened word, per round
+    server_bytes += nbits * (2 * round_words + 1) * sizeof(uint64_t);
+
+    delete[] x;
+    delete[] y;
+    delete[] running;
+    delete[] rows;
+    delete[] valid;
+
+    std::cout << "resolve time (" << nbits << " rounds): " << sec_from(start2) << std::endl;
+    std::cout << "total compute time: " << sec_from(start) << std::endl;
+    std::cout << "sent server bytes: " << server_bytes << std::endl;
+    if (server_num == 1)
+        return RET_NO_ANS;
+
+    std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
+    if (msg.type == MAX_OP) {
+        ans = max_val;
+    } else if (msg.type == MIN_OP) {
+        ans = B - max_val;
+    } else {
+        error_exit("Message type incorrect for max_bit_encoding_op");
+    }
+    return RET_ANS;
+}
+
+// For MAX and MIN
+returnType max_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num, uint64_t& ans) {
+    if (msg.use_bit_encoding)
+        return max_bit_encoding_op(msg, clientfd, serverfd, server_num, ans);
+
+    auto start = clock_start();
+
+    const unsigned int total_inputs = msg.num_of_inputs;
+    const unsigned int B = msg.max_inp;
+    const size_t frame_bytes = PK_LENGTH + (B + 1ULL) * sizeof(uint64_t);
+    if (!admit_batch(serverfd, "MAX", B < MAX_ROW_WORDS, total_inputs, frame_bytes))
+        return RET_INVALID;
+    IngestArena arena(B + 1, total_inputs);
+    SubmitQueue queue(submit_queue_slots(B + 1), B + 1);
+
+    const int num_bytes = ingest_submissions(&clientfd, 1, total_inputs, frame_bytes, arena, queue,
+        [&arena](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+            return recv_in(fd, pk, PK_LENGTH) + recv_uint64_batch(fd, row, arena.width());
+        });
+
+    std::cout << "Received " << total_inputs << " total shares" << std::endl;
+    std::cout << "bytes from client: " << num_bytes << std::endl;
+    std::cout << "receive time: " << sec_from(start) << ", stalls: " << queue.stalls() << std::endl;
+    start = clock_start();
+    auto start2 = clock_start();
+
+    int server_bytes = 0;
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    // Arena rows to aggregate
+    bool* const mask = new bool[arena.size()];
+    memset(mask, 0, arena.size() * sizeof(bool));
 
     if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
-        uint64_t b[B+1];
-        memset(b, 0, sizeof(b));
-        std::string* const pk_list = new std::string[num_inputs];
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            pk_list[idx] = share.first;
-            idx++;
-        }
         std::cout << "PK time: " << sec_from(start2) << std::endl;
         start2 = clock_start();
-        bool* const other_valid = new bool[num_inputs];
-        recv_bool_batch(serverfd, other_valid, num_inputs);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            if (!other_valid[i])
-                continue;
-            for (unsigned int j = 0; j <= B; j++)
-                b[j] ^= share_map[pk_list[i]][j];
-        }
-        delete[] other_valid;
-        delete[] shares;
-        delete[] pk_list;
+        recv_bool_batch(serverfd, valid, num_inputs);
+        for (unsigned int i = 0; i < num_inputs; i++)
+            mask[perm[i]] = valid[i];
+        delete[] valid;
+        delete[] perm;
+
+        uint64_t* const b = new uint64_t[B+1];
+        xor_reduce(arena.data(), mask, arena.size(), B+1, b,
+                   arena.stream_rows((B+1) * sizeof(uint64_t)));
+        delete[] mask;
         send_uint64_batch(serverfd, b, B+1);
+        delete[] b;
 
         std::cout << "convert time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
         return RET_NO_ANS;
     } else {
-        size_t num_inputs, num_valid = 0;
-        recv_size(serverfd, num_inputs);
-        uint64_t a[B+1];
-        memset(a, 0, sizeof(a));
-        bool* const valid = new bool[num_inputs];
-
+        size_t num_valid = 0;
         for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            valid[i] = (share_map.find(pk) != share_map.end());
             if (!valid[i])
                 continue;
             num_valid++;
-            for (unsigned int j = 0; j <= B; j++)
-                a[j] ^= share_map[pk][j];
+            mask[perm[i]] = true;
         }
+        delete[] perm;
+        // B+1 can be up to MAX_ROW_WORDS, too big for the stack
+        uint64_t* const a = new uint64_t[B+1];
+        xor_reduce(arena.data(), mask, arena.size(), B+1, a,
+                   arena.stream_rows((B+1) * sizeof(uint64_t)));
 
         std::cout << "PK+convert time: " << sec_from(start2) << std::endl;
         start2 = clock_start();
 
         server_bytes += send_bool_batch(serverfd, valid, num_inputs);
 
-        delete[] shares;
+        delete[] mask;
         delete[] valid;
-        uint64_t b[B+1];
+        uint64_t* const b = new uint64_t[B+1];
         recv_uint64_batch(serverfd, b, B+1);
 
         std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
         std::cout << "sent server bytes: " << server_bytes << std::endl;
+        returnType ret = RET_INVALID;  // If no bit differs. Shouldn't happen.
         if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
             std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
-            return RET_INVALID;
-        }
-
-        for (unsigned int j = B; j >= 0; j--) {
-            // std::cout << "a, b[" << j << "] = " << a[j] << ", " << b[j] << std::endl;
-            if (a[j] != b[j]) {
-                if (msg.type == MAX_OP) {
-                    ans = j;
-                } else if (msg.type == MIN_OP) {
-                    ans = B - j;
-                } else {
-                    error_exit("Message type incorrect for max_op");
+        } else {
+            for (size_t j = B + 1; j-- > 0; ) {
+                // std::cout << "a, b[" << j << "] = " << a[j] << ", " << b[j] << std::endl;
+                if (a[j] != b[j]) {
+                    if (msg.type == MAX_OP) {
+                        ans = j;
+                    } else if (msg.type == MIN_OP) {
+                        ans = B - j;
+                    } else {
+                        error_exit("Message type incorrect for max_op");
+                    }
+                    ret = RET_ANS;
+                    break;
                 }
-                return RET_ANS;
             }
         }
-        // Shouldn't reach.
-        return RET_INVALID;
+        delete[] a;
+        delete[] b;
+        return ret;
     }
 
     return RET_INVALID;
 }
 
+// Var, or stddev, from the sums of x and x^2 over num_valid clients
+double var_answer(const messageType type, const double sum, const double sum_sq,
+                  const size_t num_valid) {
+    const double ex = sum / num_valid;
+    const double ex2 = sum_sq / num_valid;
+    double ans = ex2 - (ex * ex);
+    if (type == VAR_OP) {
+        std::cout << "Ans: " << ex2 << " - (" << ex << ")^2 = " << ans << std::endl;
+    }
+    if (type == STDDEV_OP) {
+        ans = sqrt(ans);
+        std::cout << "Ans: sqrt(" << ex2 << " - (" << ex << ")^2) = " << ans << std::endl;
+    }
+    return ans;
+}
+
 // For var, stddev
 returnType var_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num, double& ans) {
     auto start = clock_start();
 
-    typedef std::tuple <uint64_t, uint64_t, ClientPacket*> sharetype;
-    std::unordered_map<std::string, sharetype> share_map;
-
     VarShare share;
-    const uint64_t max_val = 1ULL << msg.num_bits;
+    const uint64_t max_val = 1ULL << (msg.num_bits % 64);
     const unsigned int total_inputs = msg.num_of_inputs;
     const size_t nbits[2] = {msg.num_bits, msg.num_bits * 2};
 
@@ -743,34 +1602,50 @@ returnType var_op(const initMsg msg, const int clientfd, const int serverfd, con
     const size_t NMul = mock_circuit->NumMulGates();
     delete mock_circuit;
 
+    // Squares need to fit
+    const size_t label_bytes = (msg.group_by ? sizeof(uint64_t) : 0);
+    if (!admit_batch(serverfd, "VAR", msg.num_bits > 0 and msg.num_bits <= 31,
+                     total_inputs, sizeof(VarShare) + label_bytes + client_packet_bytes(NMul)))
+        return RET_INVALID;
+
+    // A client's packet goes in the batch slot of its arena row.
+    // Group by labels go after the values.
+    IngestArena arena(2 + msg.group_by, total_inputs);
+    ClientPacketBatch packets(NMul, total_inputs);
+
     int num_bytes = 0;
     for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share, sizeof(VarShare));
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
+        int share_bytes = recv_in(clientfd, &share, sizeof(VarShare));
+        uint64_t label = 0;
+        if (msg.group_by)
+            share_bytes += recv_uint64(clientfd, label);
 
-        ClientPacket* packet = new ClientPacket(NMul);
-        int packet_bytes = recv_ClientPacket(clientfd, packet, NMul);
-        num_bytes += packet_bytes;
+        ClientPacket packet = packets.packet(arena.size());
+        const int packet_bytes = recv_ClientPacket(clientfd, &packet, NMul);
+        // Closed, or out of step with the frames
+        if (share_bytes != (int) (sizeof(VarShare) + label_bytes) or packet_bytes <= 0) {
+            std::cout << "Stopped reading client after " << i << " shares" << std::endl;
+            break;
+        }
+        num_bytes += share_bytes + packet_bytes;
 
         // std::cout << "share[" << i << "] = " << share.val << ", " << share.val_squared << std::endl;
 
-        if ((share_map.find(pk) != share_map.end())
-            or (share.val >= max_val)
-            or (share.val_squared >= max_val * max_val)
-            or (packet_bytes <= 0)
-            ) {
-            delete packet;
-            continue;
-        }
-        share_map[pk] = {share.val, share.val_squared, packet};
+        memcpy(arena.next_pk(), share.pk, PK_LENGTH);
+        uint64_t* const row = arena.next_row();
+        row[0] = share.val;
+        row[1] = share.val_squared;
+        if (msg.group_by)
+            row[2] = label;
+        arena.commit((share.val < max_val)
+                     and (share.val_squared < max_val * max_val));
     }
 
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
     std::cout << "receive time: " << sec_from(start) << std::endl;
 
-    if (USE_OT_B2A == false)
-        correlated_store->checkDaBits(total_inputs * msg.num_bits * 3);
+    precompute_convert(total_inputs, 2, nbits);
 
     start = clock_start();
 
@@ -778,62 +1653,106 @@ returnType var_op(const initMsg msg, const int clientfd, const int serverfd, con
 
     int server_bytes = 0;
 
-    if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
+    // Server 1's valid is filled in after the snips
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    const uint64_t* shares = arena.ordered(perm, server_num == 0 ? valid : nullptr, num_inputs);
+    uint64_t* values = nullptr;
+    uint64_t* labels = nullptr;
+    if (msg.group_by) {
+        values = new uint64_t[num_inputs * 2];
+        labels = new uint64_t[num_inputs];
+        split_labels(num_inputs, 2, shares, values, labels);
+        server_bytes += check_labels(serverfd, server_num, num_inputs, labels, valid);
+        shares = values;
+    }
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        if (server_num == 0 and !valid[i])
+            perm[i] = packets.zero_slot();
+    }
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+
+    Circuit** const circuit = new Circuit*[num_inputs];
+    for (unsigned int i = 0; i < num_inputs; i++)
+        circuit[i] = CheckVar();
+    fmpz_t* const shares_p = share_convert(num_inputs, 2,
+                                           nbits, shares);
+    delete[] values;
+    std::cout << "convert time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+    const bool* const snip_valid = validate_snips(
+        num_inputs, 2, serverfd, server_num, circuit, packets, perm, shares_p);
+    delete[] perm;
+
+    if (server_num == 1)
+        recv_bool_batch(serverfd, valid, num_inputs);
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        valid[i] &= snip_valid[i];
 
-        uint64_t* const shares = new uint64_t[2 * num_inputs];
-        ClientPacket** const packet = new ClientPacket*[num_inputs];
+        delete circuit[i];
+    }
+    // Send valid back, to also encapsulate pre-snip valid[]
+    if (server_num == 0)
+        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
+    delete[] snip_valid;
+    delete[] circuit;
+    std::cout << "validate time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+
+    if (msg.group_by) {
+        LabelSums by_label(MIN_LABEL_COUNT, MAX_LABELS);
+        const size_t num_valid = accumulate(num_inputs, 2, shares_p, valid, labels, by_label);
+        clear_fmpz_array(shares_p, num_inputs * 2);
+        delete[] labels;
+        delete[] valid;
+        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
+        std::cout << "total compute time: " << sec_from(start) << std::endl;
 
-        std::string* const pk_list = new std::string[num_inputs];
-        Circuit** const circuit = new Circuit*[num_inputs];
+        uint64_t* const sums = reveal_label_sums(serverfd, server_num, by_label);
+        std::cout << "sent non-snip server bytes: " << server_bytes << std::endl;
+        if (server_num == 1)
+            return RET_NO_ANS;
 
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            pk_list[idx] = share.first;
-            idx++;
+        std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
+        if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
+            std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+            delete[] sums;
+            return RET_INVALID;
         }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
 
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            uint64_t val = 0, val2 = 0;
-            std::tie(val, val2, packet[i]) = share_map[pk_list[i]];
-            circuit[i] = CheckVar();
-            shares[2 * i] = val;
-            shares[2 * i + 1] = val2;
+        print_left_out(by_label);
+        double sum = 0, sum_sq = 0;
+        size_t num_revealed = 0;
+        for (unsigned int g = 0; g < by_label.size(); g++) {
+            std::cout << "Label " << by_label.labels[g] << " (" << by_label.counts[g] << "): ";
+            var_answer(msg.type, sums[2 * g], sums[2 * g + 1], by_label.counts[g]);
+            sum += sums[2 * g];
+            sum_sq += sums[2 * g + 1];
+            num_revealed += by_label.counts[g];
         }
-        fmpz_t* const shares_p = share_convert(num_inputs, 2,
-                                               nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        const bool* const snip_valid = validate_snips(
-            num_inputs, 2, serverfd, server_num, circuit, packet, shares_p);
-
-        bool* const valid = new bool[num_inputs];
-        recv_bool_batch(serverfd, valid, num_inputs);
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            valid[i] &= snip_valid[i];
-
-            delete circuit[i];
-            delete packet[i];
+        delete[] sums;
+        if (num_revealed == 0) {
+            std::cout << "No labels revealed" << std::endl;
+            return RET_INVALID;
         }
-        delete[] snip_valid;
-        delete[] pk_list;
-        delete[] circuit;
-        delete[] packet;
-        delete[] shares;
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+        std::cout << "Revealed labels: ";
+        ans = var_answer(msg.type, sum, sum_sq, num_revealed);
+        return RET_ANS;
+    }
 
+    // VAR and STDDEV share it
+    const EpochTask task = {"var", {VAR_OP}, fmpz_get_ui(Int_Modulus)};
+
+    if (server_num == 1) {
         // Convert
         fmpz_t* b; new_fmpz_array(&b, 2);
-        accumulate(num_inputs, 2, shares_p, valid, b);
+        const size_t num_valid = accumulate(num_inputs, 2, shares_p, valid, b);
 
         std::cout << "accumulate time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
+        log_epoch(serverfd, server_num, task, b, 2, num_valid, total_inputs);
 
         send_fmpz(serverfd, b[0]);
         send_fmpz(serverfd, b[1]);
@@ -845,63 +1764,13 @@ returnType var_op(const initMsg msg, const int clientfd, const int serverfd, con
         std::cout << "sent non-snip server bytes: " << server_bytes << std::endl;
         return RET_NO_ANS;
     } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-
-        uint64_t* const shares = new uint64_t[2 * num_inputs];
-        ClientPacket** const packet = new ClientPacket*[num_inputs];
-
-        bool* const valid = new bool[num_inputs];
-        std::string* const pk_list = new std::string[num_inputs];
-        Circuit** const circuit = new Circuit*[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            pk_list[i] = pk;
-            valid[i] = (share_map.find(pk) != share_map.end());
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            uint64_t val = 0, val2 = 0;
-            if (valid[i]) {
-                std::tie(val, val2, packet[i]) = share_map[pk_list[i]];
-            } else {
-                packet[i] = new ClientPacket(NMul);  // mock empty packet
-            }
-            circuit[i] = CheckVar();
-            shares[2 * i] = val;
-            shares[2 * i + 1] = val2;
-        }
-        fmpz_t* const shares_p = share_convert(num_inputs, 2,
-                                               nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        const bool* const snip_valid = validate_snips(
-            num_inputs, 2, serverfd, server_num, circuit, packet, shares_p);
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            valid[i] &= snip_valid[i];
-
-            delete circuit[i];
-            delete packet[i];
-        }
-        // Send valid back, to also encapsulate pre-snip valid[]
-        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
-        delete[] snip_valid;
-        delete[] pk_list;
-        delete[] circuit;
-        delete[] packet;
-        delete[] shares;
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
         // Convert
         fmpz_t* a; new_fmpz_array(&a, 2);
         size_t num_valid = accumulate(num_inputs, 2, shares_p, valid, a);
 
         std::cout << "accumulate time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
+        log_epoch(serverfd, server_num, task, a, 2, num_valid, total_inputs);
         start2 = clock_start();
 
         delete[] valid;
@@ -923,16 +1792,7 @@ returnType var_op(const initMsg msg, const int clientfd, const int serverfd, con
         fmpz_add(b, b, a[0]); fmpz_mod(b, b, Int_Modulus);
         fmpz_add(b2, b2, a[1]); fmpz_mod(b2, b2, Int_Modulus);
 
-        const double ex = fmpz_get_d(b) / num_valid;
-        const double ex2 = fmpz_get_d(b2) / num_valid;
-        ans = ex2 - (ex * ex);
-        if (msg.type == VAR_OP) {
-            std::cout << "Ans: " << ex2 << " - (" << ex << ")^2 = " << ans << std::endl;
-        }
-        if (msg.type == STDDEV_OP) {
-            ans = sqrt(ans);
-            std::cout << "Ans: sqrt(" << ex2 << " - (" << ex << ")^2) = " << ans << std::endl;
-        }
+        ans = var_answer(msg.type, fmpz_get_d(b), fmpz_get_d(b2), num_valid);
         clear_fmpz_array(a, 2);
         fmpz_clear(b);
         fmpz_clear(b2);
@@ -941,16 +1801,52 @@ returnType var_op(const initMsg msg, const int clientfd, const int serverfd, con
     }
 }
 
+// Solve from the revealed sums [x], y, [x2], [xy] over num_valid clients
+void print_linreg(const size_t degree, const uint64_t* const sums, const size_t num_valid) {
+    const size_t num_x = degree - 1;
+    const size_t num_quad = num_x * (num_x + 1) / 2;
+
+    uint64_t* const x_accum = new uint64_t[degree + num_quad];
+    uint64_t* const y_accum = new uint64_t[degree];
+    x_accum[0] = num_valid;
+    for (unsigned int j = 0; j < num_x; j++)
+        x_accum[1 + j] = sums[j];
+    y_accum[0] = sums[num_x];
+    for (unsigned int j = 0; j < num_quad; j++)
+        x_accum[1 + num_x + j] = sums[degree + j];
+    for (unsigned int j = 0; j < num_x; j++)
+        y_accum[1 + j] = sums[degree + num_quad + j];
+
+    double* c = SolveLinReg(degree, x_accum, y_accum);
+    std::cout << "Estimate: y = ";
+    for (unsigned int i = 0; i < degree; i++) {
+        if (i > 0) std::cout << " + ";
+        std::cout << c[i];
+        if (i > 0) std::cout << " * x_" << (i-1);
+    }
+    std::cout << std::endl;
+    delete[] x_accum;
+    delete[] y_accum;
+    delete[] c;
+}
+
 returnType linreg_op(const initMsg msg, const int clientfd,
                      const int serverfd, const int server_num) {
     auto start = clock_start();
     int num_bytes = 0;
 
-    size_t degree;
+    size_t degree = 0;
     num_bytes += recv_size(clientfd, degree);
 
     std::cout << "Linreg degree: " << degree << std::endl;
 
+    // Everything below is sized from it. If it's bad, size for the smallest
+    // until both servers have agreed to reject.
+    const bool header_ok = (degree >= 2 and degree <= MAX_LINREG_DEGREE
+                            and msg.num_bits > 0 and msg.num_bits <= 31);
+    if (!header_ok)
+        degree = 2;
+
     const size_t num_x = degree - 1;
     const size_t num_quad = num_x * (num_x + 1) / 2;
     const size_t num_fields = 2 * num_x + 1 + num_quad;
@@ -958,11 +1854,7 @@ returnType linreg_op(const initMsg msg, const int clientfd,
     // std::cout << "num_quad: " << num_quad << std::endl;
     // std::cout << "num_fields: " << num_fields << std::endl;
 
-    // [x], y, [x2], [xy]
-    typedef std::tuple <uint64_t*, uint64_t, uint64_t*, uint64_t*, ClientPacket*> sharetype;
-    std::unordered_map<std::string, sharetype> share_map;
-
-    const uint64_t max_val = 1ULL << msg.num_bits;
+    const uint64_t max_val = 1ULL << (msg.num_bits % 64);
     const unsigned int total_inputs = msg.num_of_inputs;
     size_t nbits[num_fields];
     for (unsigned int i = 0; i < num_fields; i++)
@@ -973,135 +1865,116 @@ returnType linreg_op(const initMsg msg, const int clientfd,
     const size_t NMul = mock_circuit->NumMulGates();
     delete mock_circuit;
 
-    LinRegShare share;
+    const size_t row_bytes = PK_LENGTH + num_fields * sizeof(uint64_t);
+    if (!admit_batch(serverfd, "LINREG", header_ok, total_inputs, row_bytes + client_packet_bytes(NMul)))
+        return RET_INVALID;
+
+    // Rows are [x], y, [x2], [xy]. A client's packet goes in the batch slot of its row.
+    IngestArena arena(num_fields, total_inputs);
+    ClientPacketBatch packets(NMul, total_inputs);
+
     for (unsigned int i = 0; i < total_inputs; i++) {
         bool sizes_valid = true;
 
-        num_bytes += recv_in(clientfd, &share.pk[0], PK_LENGTH);
-        const std::string pk(share.pk, share.pk + PK_LENGTH);
+        int bytes = recv_in(clientfd, arena.next_pk(), PK_LENGTH);
 
-        share.x_vals = new uint64_t[num_x];
-        share.x2_vals = new uint64_t[num_quad];
-        share.xy_vals = new uint64_t[num_x];
+        uint64_t* const row = arena.next_row();
+        const uint64_t* const x_vals = row;
+        const uint64_t& y = row[num_x];
+        const uint64_t* const x2_vals = &row[num_x + 1];
+        const uint64_t* const xy_vals = &row[num_x + 1 + num_quad];
 
-        num_bytes += recv_uint64_batch(clientfd, share.x_vals, num_x);
-        num_bytes += recv_uint64(clientfd, share.y);
-        num_bytes += recv_uint64_batch(clientfd, share.x2_vals, num_quad);
-        num_bytes += recv_uint64_batch(clientfd, share.xy_vals, num_x);
+        bytes += recv_uint64_batch(clientfd, &row[0], num_x);
+        bytes += recv_uint64(clientfd, row[num_x]);
+        bytes += recv_uint64_batch(clientfd, &row[num_x + 1], num_quad);
+        bytes += recv_uint64_batch(clientfd, &row[num_x + 1 + num_quad], num_x);
 
         for (unsigned int j = 0; j < num_x; j++) {
-            if (share.x_vals[j] >= max_val)
+            if (x_vals[j] >= max_val)
                 sizes_valid = false;
-            if (share.xy_vals[j] >= max_val * max_val)
+            if (xy_vals[j] >= max_val * max_val)
                 sizes_valid = false;
         }
-        if (share.y >= max_val)
+        if (y >= max_val)
             sizes_valid = false;
         for (unsigned int j = 0; j < num_quad; j++) {
-            if (share.x2_vals[j] >= max_val * max_val)
+            if (x2_vals[j] >= max_val * max_val)
                 sizes_valid = false;
         }
 
-        ClientPacket* packet = new ClientPacket(NMul);
-        int packet_bytes = recv_ClientPacket(clientfd, packet, NMul);
-        num_bytes += packet_bytes;
-
-        if ((share_map.find(pk) != share_map.end())
-            or (not sizes_valid)
-            or (packet_bytes  <= 0)
-            ) {
-            delete packet;
-            continue;
+        ClientPacket packet = packets.packet(arena.size());
+        const int packet_bytes = recv_ClientPacket(clientfd, &packet, NMul);
+        // Closed, or out of step with the frames
+        if (bytes != (int) row_bytes or packet_bytes <= 0) {
+            std::cout << "Stopped reading client after " << i << " shares" << std::endl;
+            break;
         }
+        num_bytes += bytes + packet_bytes;
 
-        share_map[pk] = {share.x_vals, share.y, share.x2_vals, share.xy_vals, packet};
+        arena.commit(sizes_valid);
     }
 
     std::cout << "Received " << total_inputs << " total shares" << std::endl;
     std::cout << "bytes from client: " << num_bytes << std::endl;
     std::cout << "receive time: " << sec_from(start) << std::endl;
 
-    if (USE_OT_B2A == false) {
-        const int total_dabits = degree * (degree + 2) - 2;
-        correlated_store->checkDaBits(total_inputs * msg.num_bits * total_dabits);
-    }
+    precompute_convert(total_inputs, num_fields, nbits);
 
     start = clock_start();
     auto start2 = clock_start();
 
     int server_bytes = 0;
 
-    if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        server_bytes += send_size(serverfd, num_inputs);
-
-        uint64_t* const shares = new uint64_t[num_inputs * num_fields];
-        ClientPacket** const packet = new ClientPacket*[num_inputs];
-
-        std::string* const pk_list = new std::string[num_inputs];
-        Circuit** const circuit = new Circuit*[num_inputs];
-
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            server_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            pk_list[idx] = share.first;
-            idx++;
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            uint64_t* x_vals;
-            uint64_t y_val = 0;
-            uint64_t* x2_vals;
-            uint64_t* xy_vals;
-
-            std::tie(x_vals, y_val, x2_vals, xy_vals, packet[i]) = share_map[pk_list[i]];
-            circuit[i] = CheckLinReg(degree);
-
-            memcpy(&shares[num_fields * i],
-                   x_vals, num_x * sizeof(uint64_t));
-            shares[num_fields * i + num_x] = y_val;
-            memcpy(&shares[num_fields * i + num_x + 1],
-                   x2_vals, num_quad * sizeof(uint64_t));
-            memcpy(&shares[num_fields * i + num_x + num_quad + 1],
-                   xy_vals, num_x * sizeof(uint64_t));
-
-            delete x_vals;
-            delete x2_vals;
-            delete xy_vals;
-        }
-        fmpz_t* const shares_p = share_convert(num_inputs, num_fields,
-                                               nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        const bool* const snip_valid = validate_snips(
-            num_inputs, num_fields, serverfd, server_num, circuit,
-            packet, shares_p);
-
-        bool* const valid = new bool[num_inputs];
+    // Server 1's valid is filled in after the snips
+    size_t* perm;
+    bool* valid;
+    const size_t num_inputs = arena.align(serverfd, server_num, perm, valid, server_bytes);
+    const uint64_t* const shares = arena.ordered(perm, server_num == 0 ? valid : nullptr, num_inputs);
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        if (server_num == 0 and !valid[i])
+            perm[i] = packets.zero_slot();
+    }
+    std::cout << "PK time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+
+    Circuit** const circuit = new Circuit*[num_inputs];
+    for (unsigned int i = 0; i < num_inputs; i++)
+        circuit[i] = CheckLinReg(degree);
+    fmpz_t* const shares_p = share_convert(num_inputs, num_fields,
+                                           nbits, shares);
+    std::cout << "convert time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
+    const bool* const snip_valid = validate_snips(
+        num_inputs, num_fields, serverfd, server_num, circuit,
+        packets, perm, shares_p);
+    delete[] perm;
+
+    if (server_num == 1)
         recv_bool_batch(serverfd, valid, num_inputs);
+    for (unsigned int i = 0; i < num_inputs; i++) {
+        valid[i] &= snip_valid[i];
 
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            valid[i] &= snip_valid[i];
+        delete circuit[i];
+    }
+    // Send valid back, to also encapsulate pre-snip valid[]
+    if (server_num == 0)
+        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
+    delete[] snip_valid;
+    delete[] circuit;
+    std::cout << "validate time: " << sec_from(start2) << std::endl;
+    start2 = clock_start();
 
-            delete circuit[i];
-            delete packet[i];
-        }
-        delete[] snip_valid;
-        delete[] pk_list;
-        delete[] circuit;
-        delete[] packet;
-        delete[] shares;
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    const EpochTask task = {"linreg_" + std::to_string(degree), {LINREG_OP, degree},
+                            fmpz_get_ui(Int_Modulus)};
 
+    if (server_num == 1) {
         // Convert
         fmpz_t* b; new_fmpz_array(&b, num_fields);
-        accumulate(num_inputs, num_fields, shares_p, valid, b);
+        const size_t num_valid = accumulate(num_inputs, num_fields, shares_p, valid, b);
 
         std::cout << "accumulate time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
+        log_epoch(serverfd, server_num, task, b, num_fields, num_valid, total_inputs);
 
         send_fmpz_batch(serverfd, b, num_fields);
 
@@ -1113,74 +1986,6 @@ returnType linreg_op(const initMsg msg, const int clientfd,
 
         return RET_NO_ANS;
     } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-
-        uint64_t* const shares = new uint64_t[num_inputs * num_fields];
-        ClientPacket** const packet = new ClientPacket*[num_inputs];
-
-        bool* const valid = new bool[num_inputs];
-        std::string* const pk_list = new std::string[num_inputs];
-        Circuit** const circuit = new Circuit*[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            pk_list[i] = pk;
-            valid[i] = (share_map.find(pk) != share_map.end());
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            uint64_t* x_vals;
-            uint64_t y_val = 0;
-            uint64_t* x2_vals;
-            uint64_t* xy_vals;
-            if (valid[i]) {
-                std::tie(x_vals, y_val, x2_vals, xy_vals, packet[i]) = share_map[pk_list[i]];
-            } else {
-                x_vals = new uint64_t[num_x];
-                x2_vals = new uint64_t[num_quad];
-                xy_vals = new uint64_t[num_x];
-                packet[i] = new ClientPacket(NMul);
-            }
-            circuit[i] = CheckLinReg(degree);
-            memcpy(&shares[num_fields * i],
-                   x_vals, num_x * sizeof(uint64_t));
-            shares[num_fields * i + num_x] = y_val;
-            memcpy(&shares[num_fields * i + num_x + 1],
-                   x2_vals, num_quad * sizeof(uint64_t));
-            memcpy(&shares[num_fields * i + num_x + num_quad + 1],
-                   xy_vals, num_x * sizeof(uint64_t));
-
-            delete x_vals;
-            delete x2_vals;
-            delete xy_vals;
-        }
-        fmpz_t* const shares_p = share_convert(num_inputs, num_fields,
-                                               nbits, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        const bool* const snip_valid = validate_snips(
-            num_inputs, num_fields, serverfd, server_num, circuit,
-            packet, shares_p);
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            valid[i] &= snip_valid[i];
-
-            delete circuit[i];
-            delete packet[i];
-        }
-        // Send valid back, to also encapsulate pre-snip valid[]
-        server_bytes += send_bool_batch(serverfd, valid, num_inputs);
-        delete[] snip_valid;
-        delete[] pk_list;
-        delete[] circuit;
-        delete[] packet;
-        delete[] shares;
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
         // Convert
         fmpz_t* a; new_fmpz_array(&a, num_fields);
         size_t num_valid = accumulate(num_inputs, num_fields, shares_p, valid, a);
@@ -1190,312 +1995,113 @@ returnType linreg_op(const initMsg msg, const int clientfd,
 
         std::cout << "accumulate time: " << sec_from(start2) << std::endl;
         std::cout << "total compute time: " << sec_from(start) << std::endl;
+        log_epoch(serverfd, server_num, task, a, num_fields, num_valid, total_inputs);
         start2 = clock_start();
 
-        uint64_t* const x_accum = new uint64_t[degree + num_quad];
-        memset(x_accum, 0, (degree + num_quad) * sizeof(uint64_t));
-        uint64_t* const y_accum = new uint64_t[degree];
-        memset(y_accum, 0, (degree) * sizeof(uint64_t));
-
-        fmpz_t b; fmpz_init(b);
-
-        x_accum[0] = num_valid;
-        for (unsigned int j = 0; j < num_x; j++) {
-            recv_fmpz(serverfd, b);
-            fmpz_add(b, b, a[j]);
-            fmpz_mod(b, b, Int_Modulus);
-            x_accum[1 + j] = fmpz_get_si(b);
-        }
-        recv_fmpz(serverfd, b);
-        fmpz_add(b, b, a[num_x]);
-        fmpz_mod(b, b, Int_Modulus);
-        y_accum[0] = fmpz_get_si(b);
-
-        for (unsigned int j = 0; j < num_quad; j++) {
-            recv_fmpz(serverfd, b);
-            fmpz_add(b, b, a[degree + j]);
-            fmpz_mod(b, b, Int_Modulus);
-            x_accum[1 + num_x + j] = fmpz_get_si(b);
-        }
-        for (unsigned int j = 0; j < num_x; j++) {
-            recv_fmpz(serverfd, b);
-            fmpz_add(b, b, a[degree + num_quad + j]);
-            fmpz_mod(b, b, Int_Modulus);
-            y_accum[1 + j] = fmpz_get_si(b);
+        fmpz_t* b; new_fmpz_array(&b, num_fields);
+        recv_fmpz_batch(serverfd, b, num_fields);
+        uint64_t* const sums = new uint64_t[num_fields];
+        for (unsigned int j = 0; j < num_fields; j++) {
+            fmpz_add(b[j], b[j], a[j]);
+            fmpz_mod(b[j], b[j], Int_Modulus);
+            sums[j] = fmpz_get_ui(b[j]);
         }
-
         clear_fmpz_array(a, num_fields);
-        fmpz_clear(b);
+        clear_fmpz_array(b, num_fields);
 
         std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
         std::cout << "sent non-snip server bytes: " << server_bytes << std::endl;
         if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
             std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
-            delete[] x_accum;
-            delete[] y_accum;
+            delete[] sums;
             return RET_INVALID;
         }
 
-        double* c = SolveLinReg(degree, x_accum, y_accum);
-        std::cout << "Estimate: y = ";
-        for (unsigned int i = 0; i < degree; i++) {
-            if (i > 0) std::cout << " + ";
-            std::cout << c[i];
-            if (i > 0) std::cout << " * x_" << (i-1);
-        }
-        std::cout << std::endl;
+        print_linreg(degree, sums, num_valid);
         std::cout << "eval time: " << sec_from(start2) << std::endl;
-        delete[] x_accum;
-        delete[] y_accum;
-        delete[] c;
+        delete[] sums;
 
         return RET_ANS;
     }
 }
 
-returnType freq_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num) {
-    std::unordered_map<std::string, bool*> share_map;
-    auto start = clock_start();
+void print_freq(const fmpz_t* const a, const size_t max_inp) {
+    for (unsigned int j = 0; j < max_inp; j++) {
+        std::cout << " Freq(" << j << ") = ";
+        fmpz_print(a[j]);
+        std::cout << std::endl;
+    }
+}
 
-    const unsigned int total_inputs = msg.num_of_inputs;
+// FREQ / COUNTMIN / HEAVY batches: num_rows rows of w entries, the last of last_w.
+// header_ok should already cover those, and the entries fitting MAX_ONEHOT_SIZE.
+bool admit_onehot(const initMsg msg, const int serverfd, const char* const what,
+                  const bool header_ok, const size_t num_rows,
+                  const size_t w, const size_t last_w) {
+    size_t frame_bytes = 0;
+    if (header_ok) {
+        const size_t key_len = (num_rows - 1) * dpf_key_words(dpf_depth(w)) + dpf_key_words(dpf_depth(last_w));
+        const size_t share_size = (num_rows - 1) * w + last_w;
+        frame_bytes = PK_LENGTH + (msg.use_dpf ? key_len * sizeof(uint64_t) : (share_size + 7) / 8);
+    }
+    return admit_batch(serverfd, what, header_ok, msg.num_of_inputs, frame_bytes);
+}
+
+returnType freq_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num) {
+    const bool header_ok = (msg.num_bits > 0 and msg.num_bits < 64
+                            and (1ULL << msg.num_bits) <= MAX_ONEHOT_SIZE);
     // const uint64_t max_inp = msg.max_inp;
-    const uint64_t max_inp = 1ULL << msg.num_bits;
+    const uint64_t max_inp = header_ok ? 1ULL << msg.num_bits : 0;
     // TODO: if 1 << num_bits < max_inp, fail
+    if (!admit_onehot(msg, serverfd, "FREQ", header_ok, 1, max_inp, max_inp))
+        return RET_INVALID;
 
-    FreqShare share;
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share.pk[0], PK_LENGTH);
-        const std::string pk(share.pk, share.pk+PK_LENGTH);
-        share.arr = new bool[max_inp];
-        num_bytes += recv_bool_batch(clientfd, share.arr, max_inp);
-
-        if (share_map.find(pk) != share_map.end()) {
-            delete[] share.arr;
-            continue;
-        }
-        share_map[pk] = share.arr;
+    const EpochTask task = {"freq_" + std::to_string(msg.num_bits), {FREQ_OP, msg.num_bits},
+                            fmpz_get_ui(Int_Modulus)};
+    fmpz_t* a; new_fmpz_array(&a, max_inp);
+    size_t num_inputs;
+    const returnType ret = (msg.use_dpf ? onehot_dpf_sum : onehot_bits_sum)(
+        msg, clientfd, serverfd, server_num, 1, max_inp, max_inp, task, a, num_inputs);
+    if (ret == RET_ANS)
+        print_freq(a, max_inp);
+    clear_fmpz_array(a, max_inp);
+    return ret;
+}
 
-        // for (unsigned int j = 0; j < max_inp; j++) {
-        //     std::cout << "share[" << i << ", " << j << "] = " << share.arr[j] << std::endl;
+// Count-min answer. Prints values x (up to 256) whose min over rows is >= t num_inputs
+void find_countmin_heavy(const fmpz_t* const a, HashStore& hash_store,
+                         const size_t num_bits, const size_t d, const size_t w,
+                         const size_t num_inputs, const double t) {
+    std::cout << "Finding heavy..." << std::endl;
+    const double target_freq = num_inputs * t;
+    std::cout << "Heavy of " << t << " is freq >= " << target_freq << std::endl;
+    int total = 0;
+    for (unsigned int x = 0; x < (1ULL << num_bits) && x < 256; x++) {
+        int acc = num_inputs;  // could also do mean, other stats
+        // d hashes range w
+        for (unsigned int j = 0; j < d; j++) {
+            const uint64_t h = hash_store.eval(j, x);
+            int est = fmpz_get_ui(a[j * w + h]);
+            // std::cout << "hash_" << j << "(" << x << ") = " << h << ", est = " << est << std::endl;
+            acc = est < acc ? est : acc;
+        }
+        total += acc;
+        // if (acc > 0) {
+        //     std::cout << "Est Freq(" << x << ") \t= " << acc << std::endl;
+        //     for (unsigned int j = 0; j < d; j++) {
+        //         hash_store.eval(j, x, hashed);
+        //         int h = fmpz_get_ui(hashed);
+        //         int est = fmpz_get_ui(a[j * w + h]);
+        //         std::cout << "hash_" << j << "(" << x << ") = " << h << ", est = " << est << std::endl;
+        //     }
         // }
-    }
-
-    std::cout << "Received " << total_inputs << " total shares" << std::endl;
-    std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
-
-    correlated_store->checkDaBits(total_inputs * max_inp);
-
-    start = clock_start();
-    auto start2 = clock_start();
-    num_bytes = 0;
-
-    if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        num_bytes += send_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * max_inp];
-
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            num_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            memcpy(&shares[idx * max_inp], share.second, max_inp);
-            delete[] share.second;
-            idx++;
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * max_inp, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-        
-        bool* const valid = new bool[num_inputs];
-        fmpz_t* sums; new_fmpz_array(&sums, num_inputs);
-        bool total_parity = 0;
-        fmpz_t sum; fmpz_init_set_si(sum, 0);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            fmpz_zero(sums[i]);
-            for (unsigned int j = 0; j < max_inp; j++) {
-                // std::cout << "share_p[" << i << ", " << j << "] = ";
-                // fmpz_print(shares_p[i * max_inp + j]); std::cout << std::endl;
-
-                fmpz_add(sums[i], sums[i], shares_p[i * max_inp + j]);
-                fmpz_mod(sums[i], sums[i], Int_Modulus);
-                total_parity ^= shares[i * max_inp + j];
-            }
-            fmpz_add(sum, sum, sums[i]);
-            fmpz_mod(sum, sum, Int_Modulus);
-        }
-        // Batch check.
-        num_bytes += send_bool(serverfd, total_parity);
-        num_bytes += send_fmpz(serverfd, sum);
-        fmpz_clear(sum);
-        delete[] shares;
-
-        bool all_valid;
-        recv_bool(serverfd, all_valid);
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            // Batch check fails. Test single. Binary search is more rounds but (possibly) less bytes).
-            num_bytes += send_bool_batch(serverfd, valid, num_inputs);
-            num_bytes += send_fmpz_batch(serverfd, sums, num_inputs);
-            recv_bool_batch(serverfd, valid, num_inputs);
-        }
-        clear_fmpz_array(sums, num_inputs);
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* b; new_fmpz_array(&b, max_inp);
-        accumulate(num_inputs, max_inp, shares_p, valid, b);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-
-        delete[] valid;
-        clear_fmpz_array(shares_p, num_inputs * max_inp);
-        // send b
-        send_fmpz_batch(serverfd, b, max_inp);
-        clear_fmpz_array(b, max_inp);
-
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
-        return RET_NO_ANS;
-    } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * max_inp];
-        bool* const valid = new bool[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            valid[i] = (share_map.find(pk) != share_map.end());
-
-            // realign shares_2 to pk order
-            if (valid[i]) {
-                memcpy(&shares[i * max_inp], share_map[pk], max_inp);
-                delete[] share_map[pk];
-            } else {
-                memset(&shares[i * max_inp], 0, max_inp);
-            }
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * max_inp, shares);
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        // Validity check
-        bool* const parity = new bool[num_inputs];
-        bool total_parity = 0;
-        fmpz_t* sums; new_fmpz_array(&sums, num_inputs);
-        fmpz_t sum; fmpz_init(sum); fmpz_zero(sum);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            parity[i] = false;
-            fmpz_zero(sums[i]);
-            for (unsigned int j = 0; j < max_inp; j++) {
-                // std::cout << "share_p[" << i << ", " << j << "] = ";
-                // fmpz_print(shares_p[i * max_inp + j]); std::cout << std::endl;
-
-                parity[i] ^= shares[i * max_inp + j];
-                fmpz_add(sums[i], sums[i], shares_p[i * max_inp + j]);
-                fmpz_mod(sums[i], sums[i], Int_Modulus);
-            }
-            total_parity ^= parity[i];
-            fmpz_add(sum, sum, sums[i]);
-            fmpz_mod(sum, sum, Int_Modulus);
-        }
-        // batch check
-        bool total_parity_other;
-        fmpz_t sum_other; fmpz_init(sum_other);
-        recv_bool(serverfd, total_parity_other);
-        recv_fmpz(serverfd, sum_other);
-        bool all_valid = false;
-        all_valid = (total_parity ^ total_parity_other) == (total_inputs % 2);
-        if (all_valid) {
-            fmpz_add(sum, sum, sum_other);
-            fmpz_mod(sum, sum, Int_Modulus);
-            all_valid = fmpz_equal_ui(sum, total_inputs);
-        }
-        num_bytes += send_bool(serverfd, all_valid);
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            // Batch check fails. Test single. Binary search is more rounds but (possibly) less bytes).
-
-            bool* const parity_other = new bool[num_inputs];
-            fmpz_t* sums_other; new_fmpz_array(&sums_other, num_inputs);
-            recv_bool_batch(serverfd, parity_other, num_inputs);
-            recv_fmpz_batch(serverfd, sums_other, num_inputs);
-            for (unsigned int i = 0; i < num_inputs; i++) {
-                if (!valid[i])
-                    continue;
-                if ((parity[i] ^ parity_other[i]) == 0) {
-                    valid[i] = false;
-                    continue;
-                }
-                fmpz_add(sums[i], sums[i], sums_other[i]);
-                fmpz_mod(sums[i], sums[i], Int_Modulus);
-                if (!fmpz_is_one(sums[i]))
-                    valid[i] = false;
-            }
-            clear_fmpz_array(sums_other, num_inputs);
-            delete[] parity_other;
-
-            num_bytes += send_bool_batch(serverfd, valid, num_inputs);
-        }
-
-        clear_fmpz_array(sums, num_inputs);
-        delete[] parity;
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* a; new_fmpz_array(&a, max_inp);
-        size_t num_valid = accumulate(num_inputs, max_inp, shares_p, valid, a);
-        delete[] valid;
-        delete[] shares;
-        clear_fmpz_array(shares_p, num_inputs * max_inp);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-        start2 = clock_start();
-
-        // receive b
-        fmpz_t* b; new_fmpz_array(&b, max_inp);
-        recv_fmpz_batch(serverfd, b, max_inp);
-
-        std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
-        if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
-            std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
-            clear_fmpz_array(b, max_inp);
-            clear_fmpz_array(a, max_inp);
-            return RET_INVALID;
-        }
-
-        // Sum accumulates
-        for (unsigned int j = 0; j < max_inp; j++) {
-            fmpz_add(a[j], a[j], b[j]);
-            fmpz_mod(a[j], a[j], Int_Modulus);
-        }
-        clear_fmpz_array(b, max_inp);
-        // output
-        for (unsigned int j = 0; j < max_inp; j++) {
-            std::cout << " Freq(" << j << ") = ";
-            fmpz_print(a[j]);
-            std::cout << std::endl;
-        }
-        clear_fmpz_array(a, max_inp);
-        std::cout << "eval time: " << sec_from(start2) << std::endl;
-        return RET_ANS;
+        if (acc >= target_freq) {
+            std::cout << x << " is heavy!" << std::endl;
+        } 
     }
 }
 
 returnType countMin_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num) {
-    std::unordered_map<std::string, bool*> share_map;
-    auto start = clock_start();
-
     HeavyConfig hcfg;
     recv_heavycfg(clientfd, hcfg);
     const double t = hcfg.t;
@@ -1504,265 +2110,135 @@ returnType countMin_op(const initMsg msg, const int clientfd, const int serverfd
     flint_rand_t hash_seed; flint_randinit(hash_seed);
     recv_seed(clientfd, hash_seed);
 
-    HashStore hash_store(d, msg.num_bits, w, hash_seed);
-
-    const unsigned int total_inputs = msg.num_of_inputs;
-    
-    FreqShare share;
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share.pk[0], PK_LENGTH);
-        const std::string pk(share.pk, share.pk+PK_LENGTH);
-        share.arr = new bool[d * w];
-        num_bytes += recv_bool_batch(clientfd, share.arr, d * w);
-
-        if (share_map.find(pk) != share_map.end()) {
-            delete[] share.arr;
-            continue;
-        }
-        share_map[pk] = share.arr;
-
-        // for (unsigned int j = 0; j < d; j++) {
-        //     std::cout << "share[" << i << "][" << j << "] = ";
-        //     for (unsigned int k = 0; k < w; k++) {
-        //         std::cout << share.arr[j * d + k] << " ";
-        //     }
-        //     std::cout << std::endl;
-        // }
-    }
-
-    std::cout << "Received " << total_inputs << " total shares" << std::endl;
-    std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
-
-    correlated_store->checkDaBits(total_inputs * w * d);
-
-    start = clock_start();
-    auto start2 = clock_start();
-    num_bytes = 0;
-
-    if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        num_bytes += send_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * d * w];
-
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            num_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            memcpy(&shares[idx * d * w], share.second, d * w);
-            delete[] share.second;
-            idx++;
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * d * w, shares);
-
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        // Batch validity check
-        bool* const valid = new bool[num_inputs];
-        bool* const parity = new bool[d];
-        memset(parity, false, d);
-        fmpz_t* sums; new_fmpz_array(&sums, d);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            for (unsigned int j = 0; j < d; j++) {
-                for (unsigned int k = 0; k < w; k++) {
-                    const size_t idx = i * d * w + j * w + k;
-                    parity[j] ^= shares[idx];
-                    fmpz_add(sums[j], sums[j], shares_p[idx]);
-                    fmpz_mod(sums[j], sums[j], Int_Modulus);
-                }
-            }
-        }
-        num_bytes += send_bool_batch(serverfd, parity, d);
-        num_bytes += send_fmpz_batch(serverfd, sums, d);
-        clear_fmpz_array(sums, d);
-        delete[] parity;
-        delete[] shares;
-
-        bool all_valid;
-        recv_bool(serverfd, all_valid);
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            std::cout << "Batch not valid. Individual check currently not implemented" << std::endl;
-            memset(valid, false, num_inputs);
-        }
-
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* b; new_fmpz_array(&b, d * w);
-        accumulate(num_inputs, d * w, shares_p, valid, b);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-
-        delete[] valid;
-        clear_fmpz_array(shares_p, num_inputs * d * w);
-        send_fmpz_batch(serverfd, b, d * w);
-        clear_fmpz_array(b, d * w);
-
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
-        return RET_NO_ANS;
-    } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * d * w];
-        bool* const valid = new bool[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            valid[i] = (share_map.find(pk) != share_map.end());
-
-            if (valid[i]) {
-                memcpy(&shares[i * d * w], share_map[pk], d * w);
-                delete[] share_map[pk];
-            } else {
-                memset(&shares[i * d * w], 0, d * w);
-            }
-        }
-
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    const bool header_ok = (msg.num_bits > 0 and msg.num_bits < 64 and d > 0 and w > 0
+                            and w <= MAX_ONEHOT_SIZE and d <= MAX_ONEHOT_SIZE / w);
+    if (!admit_onehot(msg, serverfd, "COUNTMIN", header_ok, d, w, w))
+        return RET_INVALID;
 
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * d * w, shares);
+    EpochTask task = {"countmin_" + std::to_string(msg.num_bits) + "_" + std::to_string(d)
+                      + "_" + std::to_string(w), {COUNTMIN_OP, msg.num_bits, d, w},
+                      fmpz_get_ui(Int_Modulus)};
+    add_seed(task, hash_seed, t);
 
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    HashStore hash_store(d, msg.num_bits, w, hash_seed);
 
-        // Batch validity check
-        bool* const parity = new bool[d];
-        memset(parity, false, d);
-        fmpz_t* sums; new_fmpz_array(&sums, d);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            for (unsigned int j = 0; j < d; j++) {
-                for (unsigned int k = 0; k < w; k++) {
-                    const size_t idx = i * d * w + j * w + k;
-                    parity[j] ^= shares[idx];
-                    fmpz_add(sums[j], sums[j], shares_p[idx]);
-                    fmpz_mod(sums[j], sums[j], Int_Modulus);
-                }
-            }
-        }
-        bool* parity_other = new bool[d];
-        fmpz_t* sums_other; new_fmpz_array(&sums_other, d);
-        recv_bool_batch(serverfd, parity_other, d);
-        recv_fmpz_batch(serverfd, sums_other, d);
+    fmpz_t* a; new_fmpz_array(&a, d * w);
+    size_t num_inputs;
+    const returnType ret = (msg.use_dpf ? onehot_dpf_sum : onehot_bits_sum)(
+        msg, clientfd, serverfd, server_num, d, w, w, task, a, num_inputs);
+    if (ret == RET_ANS)
+        find_countmin_heavy(a, hash_store, msg.num_bits, d, w, num_inputs, t);
+    clear_fmpz_array(a, d * w);
+    return ret;
+}
 
-        bool all_valid = false;
+// Mark which children 2x, 2x+1 of candidates [start, end) are heavy in layer sketch
+void heavy_expand(const uint64_t* const layer, const HashStore& hash_store,
+                  const size_t d, const size_t w, const uint64_t num_inputs,
+                  const double target_freq, const uint64_t* const candidates,
+                  const size_t start, const size_t end, bool* const keep) {
+    uint64_t* const h0 = new uint64_t[d];
+    uint64_t* const h1 = new uint64_t[d];
+    for (size_t c = start; c < end; c++) {
+        const uint64_t x = candidates[c];
+        hash_store.eval_all(2 * x, h0);
+        hash_store.eval_all(2 * x + 1, h1);
+        uint64_t min0 = num_inputs, min1 = num_inputs;
         for (unsigned int j = 0; j < d; j++) {
-            all_valid = (parity[j] ^ parity_other[j]) == (total_inputs % 2);
-            if (!all_valid)
-                continue;
-        }
-        if (all_valid) {
-            for (unsigned int j = 0; j < d; j++) {
-                fmpz_add(sums[j], sums[j], sums_other[j]);
-                fmpz_mod(sums[j], sums[j], Int_Modulus);
-                all_valid = fmpz_equal_ui(sums[j], total_inputs);
-                if (!all_valid)
-                    continue;
-            }
-        }
-        num_bytes += send_bool(serverfd, all_valid);
-        clear_fmpz_array(sums, d);
-        clear_fmpz_array(sums_other, d);
-        delete[] parity;
-        delete[] parity_other;
-        delete[] shares;
-
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            std::cout << "Batch not valid. Individual check currently not implemented" << std::endl;
-            memset(valid, false, num_inputs);
-        }
-
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* a; new_fmpz_array(&a, d * w);
-        size_t num_valid = accumulate(num_inputs, d * w, shares_p, valid, a);
-        delete[] valid;
-        clear_fmpz_array(shares_p, num_inputs * d * w);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* b; new_fmpz_array(&b, d * w);
-        recv_fmpz_batch(serverfd, b, d * w);
-
-        std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
-        if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
-            std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
-            clear_fmpz_array(b, d * w);
-            clear_fmpz_array(a, d * w);
-            return RET_INVALID;
+            min0 = std::min(min0, layer[j * w + h0[j]]);
+            min1 = std::min(min1, layer[j * w + h1[j]]);
         }
+        keep[2 * c] = (min0 >= target_freq);
+        keep[2 * c + 1] = (min1 >= target_freq);
+    }
+    delete[] h0;
+    delete[] h1;
+}
 
-        // Sum accumulates
-        for (unsigned int j = 0; j < d * w; j++) {
-            fmpz_add(a[j], a[j], b[j]);
-            fmpz_mod(a[j], a[j], Int_Modulus);
-        }
-        clear_fmpz_array(b, d * w);
-
-        // Find heavy
-        std::cout << "Finding heavy..." << std::endl;
-        const double target_freq = num_inputs * t;
-        std::cout << "Heavy of " << t << " is freq >= " << target_freq << std::endl;
-        fmpz_t hashed; fmpz_init(hashed);
-        int total = 0;
-        for (unsigned int x = 0; x < (1ULL << msg.num_bits) && x < 256; x++) {
-            int acc = num_inputs;  // could also do mean, other stats
-            // d hashes range w
-            for (unsigned int j = 0; j < d; j++) {
-                hash_store.eval(j, x, hashed);
-                int h = fmpz_get_ui(hashed);
-                int est = fmpz_get_ui(a[j * w + h]);
-                // std::cout << "hash_" << j << "(" << x << ") = " << h << ", est = " << est << std::endl;
-                acc = est < acc ? est : acc;
-            }
-            total += acc;
-            // if (acc > 0) {
-            //     std::cout << "Est Freq(" << x << ") \t= " << acc << std::endl;
-            //     for (unsigned int j = 0; j < d; j++) {
-            //         hash_store.eval(j, x, hashed);
-            //         int h = fmpz_get_ui(hashed);
-            //         int est = fmpz_get_ui(a[j * w + h]);
-            //         std::cout << "hash_" << j << "(" << x << ") = " << h << ", est = " << est << std::endl;
-            //     }
-            // }
-            if (acc >= target_freq) {
-                std::cout << x << " is heavy!" << std::endl;
-            } 
-        }
+// Heavy hitter answer. Finds heavy prefixes in the freq layer,
+// then extends them a bit at a time through the L count-min layers.
+// Each layer's candidates are split over threads.
+void find_heavy(const fmpz_t* const a, flint_rand_t hash_seed,
+                const size_t num_bits, const size_t L, const size_t d,
+                const size_t w, const size_t num_inputs, const double t) {
+    const size_t first_size = 1ULL << (num_bits - L);
+    std::cout << "Finding heavy..." << std::endl;
+    const double target_freq = num_inputs * t;
+    std::cout << "Heavy of " << t << " is freq >= " << target_freq << std::endl;
+
+    HashStore** hash_stores = new HashStore*[L];
+    for (unsigned int i = 0; i < L; i++)
+        hash_stores[i] = new HashStore(d, num_bits - i, w, hash_seed);
+
+    // Sketch as words, once
+    const size_t sketch_size = L * d * w + first_size;
+    uint64_t* const sketch = new uint64_t[sketch_size];
+    for (unsigned int i = 0; i < sketch_size; i++)
+        sketch[i] = fmpz_get_ui(a[i]);
+
+    // Double buffered candidates: this layer's in cand[cur], next in cand[!cur]
+    vector<uint64_t> cand[2];
+    bool cur = 0;
+    // Check freq layer
+    std::cout << "Checking initial freq..." << std::endl;
+    for (uint64_t x = 0; x < first_size; x++) {
+        if (sketch[L * d * w + x] >= target_freq)
+            cand[cur].push_back(x);
+    }
 
-        fmpz_clear(hashed);
-        clear_fmpz_array(a, d * w);
+    const size_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+    // Iterate down tree
+    for (unsigned int i = 0; i < L; i++) {
+        const size_t n = cand[cur].size();
+        bool* const keep = new bool[2 * n];
+        const uint64_t* const layer = &sketch[i * d * w];
+        const size_t num_threads = std::min(max_threads, n / HEAVY_MIN_PER_THREAD + 1);
+        const size_t per_thread = (n + num_threads - 1) / num_threads;
+
+        vector<std::thread> threads;
+        for (unsigned int k = 1; k < num_threads; k++)
+            threads.emplace_back(heavy_expand, layer, std::cref(*hash_stores[i]), d, w,
+                                 num_inputs, target_freq, cand[cur].data(),
+                                 std::min(n, k * per_thread),
+                                 std::min(n, (k + 1) * per_thread), keep);
+        heavy_expand(layer, *hash_stores[i], d, w, num_inputs, target_freq,
+                     cand[cur].data(), 0, std::min(n, per_thread), keep);
+        for (auto& thread : threads)
+            thread.join();
+
+        cand[!cur].clear();
+        for (size_t c = 0; c < 2 * n; c++) {
+            if (keep[c])
+                cand[!cur].push_back(2 * cand[cur][c / 2] + (c % 2));
+        }
+        cur = !cur;
+        delete[] keep;
+    }
 
-        std::cout << "eval time: " << sec_from(start2) << std::endl;
-        return RET_ANS;
+    for (const uint64_t x : cand[cur]) {
+        std::cout << x << " is heavy!" << std::endl;
     }
+
+    delete[] sketch;
+    for (unsigned int i = 0; i < L; i++)
+        delete hash_stores[i];
+    delete[] hash_stores;
 }
 
 returnType heavy_op(const initMsg msg, const int clientfd, const int serverfd, const int server_num) {
-    std::unordered_map<std::string, bool*> share_map;
-    auto start = clock_start();
-
     HeavyConfig hcfg;
     recv_heavycfg(clientfd, hcfg);
     const double t = hcfg.t;
     const size_t w = hcfg.w;
     const size_t d = hcfg.d;
     const size_t L = hcfg.L;
-    const size_t first_size = 1ULL << (msg.num_bits - L);  // size of freq layer
-    const size_t share_size = L * d * w + first_size;
+    // Layers of d * w, then 2^(num_bits - L)
+    const bool header_ok = (msg.num_bits < 64 and L < msg.num_bits and d > 0 and w > 0
+                            and (1ULL << (msg.num_bits - L)) <= MAX_ONEHOT_SIZE
+                            and w <= MAX_ONEHOT_SIZE and d <= MAX_ONEHOT_SIZE / w
+                            and L * d * w <= MAX_ONEHOT_SIZE - (1ULL << (msg.num_bits - L)));
+    const size_t first_size = header_ok ? 1ULL << (msg.num_bits - L) : 0;  // size of freq layer
+    const size_t share_size = header_ok ? L * d * w + first_size : 0;
     std::cout << "got: t = " << t << std::endl;
     std::cout << "got: w = " << w << std::endl;
     std::cout << "got: d = " << d << std::endl;
@@ -1771,295 +2247,150 @@ returnType heavy_op(const initMsg msg, const int clientfd, const int serverfd, c
     flint_rand_t hash_seed; flint_randinit(hash_seed);
     recv_seed(clientfd, hash_seed);
 
-    const unsigned int total_inputs = msg.num_of_inputs;
-    
-    FreqShare share;
-    int num_bytes = 0;
-    for (unsigned int i = 0; i < total_inputs; i++) {
-        num_bytes += recv_in(clientfd, &share.pk[0], PK_LENGTH);
-        const std::string pk(share.pk, share.pk+PK_LENGTH);
-        share.arr = new bool[share_size];
-        num_bytes += recv_bool_batch(clientfd, share.arr, share_size);
-
-        if (share_map.find(pk) != share_map.end()) {
-            delete[] share.arr;
-            continue;
-        }
-        share_map[pk] = share.arr;
-    }
-
-    std::cout << "Received " << total_inputs << " total shares" << std::endl;
-    std::cout << "bytes from client: " << num_bytes << std::endl;
-    std::cout << "receive time: " << sec_from(start) << std::endl;
+    if (!admit_onehot(msg, serverfd, "HEAVY", header_ok, L * d + 1, w, first_size))
+        return RET_INVALID;
 
-    correlated_store->checkDaBits(total_inputs * share_size);
+    EpochTask task = {"heavy_" + std::to_string(msg.num_bits) + "_" + std::to_string(L)
+                      + "_" + std::to_string(d) + "_" + std::to_string(w),
+                      {HEAVY_OP, msg.num_bits, L, d, w}, fmpz_get_ui(Int_Modulus)};
+    add_seed(task, hash_seed, t);
+
+    fmpz_t* a; new_fmpz_array(&a, share_size);
+    size_t num_inputs;
+    const returnType ret = (msg.use_dpf ? onehot_dpf_sum : onehot_bits_sum)(
+        msg, clientfd, serverfd, server_num, L * d + 1, w, first_size, task, a, num_inputs);
+    if (ret == RET_ANS)
+        find_heavy(a, hash_seed, msg.num_bits, L, d, w, num_inputs, t);
+    clear_fmpz_array(a, share_size);
+    return ret;
+}
 
-    start = clock_start();
-    auto start2 = clock_start();
-    num_bytes = 0;
+// A task name from the client. Too long to be valid is left unread, as "".
+std::string recv_task_name(const int clientfd) {
+    size_t len = 0;
+    recv_size(clientfd, len);
+    std::string name;
+    if (len <= 256) {
+        name.resize(len);
+        recv_in(clientfd, &name[0], len);
+    }
+    return name;
+}
 
+// Reveal this server's share[width] of a logged task's aggregate, and have server 0
+// answer it the way the task's op would have. Counts are server 0's.
+returnType reveal_epochs(const int serverfd, const int server_num, const EpochLog& log,
+                         const uint64_t* const share, const uint64_t num_valid,
+                         const uint64_t num_inputs) {
+    const size_t width = log.width();
     if (server_num == 1) {
-        const size_t num_inputs = share_map.size();
-        num_bytes += send_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * share_size];
-
-        size_t idx = 0;
-        for (const auto& share : share_map) {
-            num_bytes += send_out(serverfd, &share.first[0], PK_LENGTH);
-            memcpy(&shares[idx * share_size], share.second, share_size);
-            delete[] share.second;
-            idx++;
-        }
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * share_size, shares);
-
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        // Batch validity check
-        bool* const valid = new bool[num_inputs];
-        const size_t valid_batch_size = L * d + 1;  // L layers size d + freq
-        bool* const parity = new bool[valid_batch_size];
-        memset(parity, false, valid_batch_size);
-        fmpz_t* sums; new_fmpz_array(&sums, valid_batch_size);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            for (unsigned int j = 0; j < L * d; j++) {
-                for (unsigned int k = 0; k < w; k++) {
-                    const size_t idx = i * share_size + j * w + k;
-                    parity[j] ^= shares[idx];
-                    fmpz_add(sums[j], sums[j], shares_p[idx]);
-                    fmpz_mod(sums[j], sums[j], Int_Modulus);
-                }
-            }
-            // freq layer
-            const size_t j = L * d;
-            for (unsigned int k = 0; k < first_size; k++) {
-                const size_t idx = i * share_size + L * d * w + k;
-                parity[j] ^= shares[idx];
-                fmpz_add(sums[j], sums[j], shares_p[idx]);
-                fmpz_mod(sums[j], sums[j], Int_Modulus);
-            }
-        }
-
-        num_bytes += send_bool_batch(serverfd, parity, valid_batch_size);
-        num_bytes += send_fmpz_batch(serverfd, sums, valid_batch_size);
-        clear_fmpz_array(sums, valid_batch_size);
-        delete[] parity;
-        delete[] shares;
-
-        bool all_valid;
-        recv_bool(serverfd, all_valid);
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            std::cout << "Batch not valid. Individual check currently not implemented" << std::endl;
-            memset(valid, false, num_inputs);
-        }
-
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
-
-        fmpz_t* b; new_fmpz_array(&b, share_size);
-        accumulate(num_inputs, share_size, shares_p, valid, b);
-        send_fmpz_batch(serverfd, b, share_size);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-
-        delete[] valid;
-        clear_fmpz_array(shares_p, num_inputs * share_size);
-        clear_fmpz_array(b, share_size);
-
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
+        send_uint64_batch(serverfd, share, width);
         return RET_NO_ANS;
-    } else {
-        size_t num_inputs;
-        recv_size(serverfd, num_inputs);
-        bool* const shares = new bool[num_inputs * share_size];
-        bool* const valid = new bool[num_inputs];
-
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            const std::string pk = get_pk(serverfd);
-            valid[i] = (share_map.find(pk) != share_map.end());
-
-            if (valid[i]) {
-                memcpy(&shares[i * share_size], share_map[pk], share_size);
-                delete[] share_map[pk];
-            } else {
-                memset(&shares[i * share_size], 0, share_size);
-            }
-        }
+    }
 
-        std::cout << "PK time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    uint64_t* const sums = new uint64_t[width];
+    recv_uint64_batch(serverfd, sums, width);
+    for (unsigned int j = 0; j < width; j++)
+        sums[j] = addmod(sums[j], share[j], log.info().mod);
 
-        fmpz_t* shares_p;
-        shares_p = correlated_store->b2a_daBit_single(num_inputs * share_size, shares);
+    std::cout << "Valid count: " << num_valid << " / " << num_inputs << std::endl;
+    if (num_valid < num_inputs * (1 - INVALID_THRESHOLD)) {
+        std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
+        delete[] sums;
+        return RET_INVALID;
+    }
 
-        std::cout << "convert time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    // messageType, then the op's parameters, as the op logged them
+    const std::vector<uint64_t>& config = log.info().config;
+    fmpz_t* a; new_fmpz_array(&a, width);
+    for (unsigned int j = 0; j < width; j++)
+        fmpz_set_ui(a[j], sums[j]);
+    flint_rand_t hash_seed; flint_randinit(hash_seed);
+    double t = 0;
+    if (config[0] == COUNTMIN_OP or config[0] == HEAVY_OP) {
+        const size_t at = (config[0] == COUNTMIN_OP ? 4 : 5);
+        memcpy(&t, &config[at], sizeof(double));
+        memcpy(&hash_seed[0], &config[at + 1], sizeof(hash_seed[0]));
+    }
 
-        // Batch validity check
-        const size_t valid_batch_size = L * d + 1;  // L layers size d + freq
-        bool* const parity = new bool[valid_batch_size];
-        memset(parity, false, valid_batch_size);
-        fmpz_t* sums; new_fmpz_array(&sums, valid_batch_size);
-        for (unsigned int i = 0; i < num_inputs; i++) {
-            for (unsigned int j = 0; j < L * d; j++) {
-                for (unsigned int k = 0; k < w; k++) {
-                    const size_t idx = i * share_size + j * w + k;
-                    parity[j] ^= shares[idx];
-                    fmpz_add(sums[j], sums[j], shares_p[idx]);
-                    fmpz_mod(sums[j], sums[j], Int_Modulus);
-                }
-            }
-            // freq layer
-            const size_t j = L * d;
-            for (unsigned int k = 0; k < first_size; k++) {
-                const size_t idx = i * share_size + L * d * w + k;
-                parity[j] ^= shares[idx];
-                fmpz_add(sums[j], sums[j], shares_p[idx]);
-                fmpz_mod(sums[j], sums[j], Int_Modulus);
-            }
-        }
+    if (config[0] == BIT_SUM) {
+        std::cout << "Ans: " << sums[0] << std::endl;
+    } else if (config[0] == INT_SUM) {
+        std::cout << "Ans:";
+        for (unsigned int j = 0; j < width; j++)
+            std::cout << " " << sums[j];
+        std::cout << std::endl;
+    } else if (config[0] == VAR_OP) {
+        var_answer(VAR_OP, sums[0], sums[1], num_valid);
+        var_answer(STDDEV_OP, sums[0], sums[1], num_valid);
+    } else if (config[0] == LINREG_OP) {
+        print_linreg(config[1], sums, num_valid);
+    } else if (config[0] == FREQ_OP) {
+        print_freq(a, width);
+    } else if (config[0] == COUNTMIN_OP) {
+        HashStore hash_store(config[2], config[1], config[3], hash_seed);
+        find_countmin_heavy(a, hash_store, config[1], config[2], config[3], num_valid, t);
+    } else if (config[0] == HEAVY_OP) {
+        find_heavy(a, hash_seed, config[1], config[2], config[3], config[4], num_valid, t);
+    }
 
-        bool* parity_other = new bool[valid_batch_size];
-        fmpz_t* sums_other; new_fmpz_array(&sums_other, valid_batch_size);
-        recv_bool_batch(serverfd, parity_other, valid_batch_size);
-        recv_fmpz_batch(serverfd, sums_other, valid_batch_size);
-        
-        bool all_valid = false;
-        for (unsigned int j = 0; j < valid_batch_size; j++) {
-            all_valid = (parity[j] ^ parity_other[j]) == (total_inputs % 2);
-            if (!all_valid)
-                continue;
-        }
-        if (all_valid) {
-            for (unsigned int j = 0; j < valid_batch_size; j++) {
-                fmpz_add(sums[j], sums[j], sums_other[j]);
-                fmpz_mod(sums[j], sums[j], Int_Modulus);
-                all_valid = fmpz_equal_ui(sums[j], total_inputs);
-                if (!all_valid)
-                    continue;
-            }
-        }
-        num_bytes += send_bool(serverfd, all_valid);
-        clear_fmpz_array(sums, valid_batch_size);
-        clear_fmpz_array(sums_other, valid_batch_size);
-        delete[] parity;
-        delete[] parity_other;
-        delete[] shares;
+    clear_fmpz_array(a, width);
+    delete[] sums;
+    return RET_ANS;
+}
 
-        if (all_valid) {
-            memset(valid, true, num_inputs);
-        } else {
-            std::cout << "Batch not valid. Individual check currently not implemented" << std::endl;
-            memset(valid, false, num_inputs);
-        }
-        std::cout << "validate time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+// Answer a logged task over epochs [first, last], by merging and revealing each
+// server's logged shares. The client sends the task name, first and last.
+returnType epoch_query(const int clientfd, const int serverfd, const int server_num) {
+    auto start = clock_start();
 
-        fmpz_t* a; new_fmpz_array(&a, share_size);
-        size_t num_valid = accumulate(num_inputs, share_size, shares_p, valid, a);
-        delete[] valid;
-        clear_fmpz_array(shares_p, num_inputs * share_size);
-        std::cout << "accumulate time: " << sec_from(start2) << std::endl;
-        std::cout << "total compute time: " << sec_from(start) << std::endl;
-        start2 = clock_start();
+    const std::string name = recv_task_name(clientfd);
+    uint64_t first = 0, last = 0;
+    recv_uint64(clientfd, first);
+    recv_uint64(clientfd, last);
+    std::cout << "Task " << name << ", epochs " << first << " to " << last << std::endl;
 
-        fmpz_t* b; new_fmpz_array(&b, share_size);
-        recv_fmpz_batch(serverfd, b, share_size);
+    EpochLog log(EPOCH_DIR, name);
+    const bool header_ok = (log.ok() and !log.info().config.empty()
+                            and first <= last and last < log.size());
+    if (!admit_batch(serverfd, "QUERY", header_ok, 0, 0))
+        return RET_INVALID;
 
-        std::cout << "Final valid count: " << num_valid << " / " << total_inputs << std::endl;
-        std::cout << "sent server bytes: " << num_bytes << std::endl;
-        if (num_valid < total_inputs * (1 - INVALID_THRESHOLD)) {
-            std::cout << "Failing, This is less than the invalid threshold of " << INVALID_THRESHOLD << std::endl;
-            clear_fmpz_array(b, share_size);
-            clear_fmpz_array(a, share_size);
-            return RET_INVALID;
-        }
+    uint64_t* const sums = new uint64_t[log.width()];
+    uint64_t num_valid, num_inputs;
+    log.merge(first, last, sums, num_valid, num_inputs);
+    std::cout << "merge time: " << sec_from(start) << std::endl;
 
-        // Sum accumulates
-        for (unsigned int j = 0; j < share_size; j++) {
-            fmpz_add(a[j], a[j], b[j]);
-            fmpz_mod(a[j], a[j], Int_Modulus);
-        }
-        clear_fmpz_array(b, share_size);
-
-        // Query
-        std::cout << "Finding heavy..." << std::endl;
-        const double target_freq = num_inputs * t;
-        std::cout << "Heavy of " << t << " is freq >= " << target_freq << std::endl;
-
-        HashStore** hash_stores = new HashStore*[L];
-        for (unsigned int i = 0; i < L; i++)
-            hash_stores[i] = new HashStore(d, msg.num_bits - i, w, hash_seed);
-
-        // Check freq layer
-        vector<uint64_t> this_values;
-        vector<uint64_t> next_candidates;
-        std::cout << "Checking initial freq..." << std::endl;
-        for (uint64_t x = 0; x < first_size; x++) {
-            // std::cout << "freq(" << x << ") at " << (L * d * w + x) << " = ";
-            // fmpz_print(a[L * d * w + x]); std::cout << std::endl;
-            if (fmpz_get_ui(a[L * d * w + x]) >= target_freq) {
-                // std::cout << "inital heavy prefix: " << x << std::endl;
-                this_values.push_back(x);
-            }
-        }
-        // Iterate down tree
-        fmpz_t hashed; fmpz_init(hashed);
-        unsigned int h, est, min0, min1;
-        for (unsigned int i = 0; i < L; i++) {
-            // std::cout << "Layer: " << i << std::endl;
-            for (const uint64_t x : this_values) {
-                min0 = num_inputs;
-                min1 = num_inputs;
-                // std::cout << "checking: " << x << std::endl;
-                for (unsigned int j = 0; j < d; j++) {
-                    hash_stores[i]->eval(j, 2 * x, hashed);
-                    h = fmpz_get_ui(hashed);
-                    est = fmpz_get_ui(a[i * d * w + j * w + h]);
-                    min0 = est < min0 ? est : min0;
-                    // std::cout << "hash_" << j << "(" << 2*x << ") = " << h << ", est at " << i * d * w + j * w + h << " = " << est << std::endl;
-
-                    hash_stores[i]->eval(j, 2 * x + 1, hashed);
-                    h = fmpz_get_ui(hashed);
-                    est = fmpz_get_ui(a[i * d * w + j * w + h]);
-                    min1 = est < min1 ? est : min1;
-                    // std::cout << "hash_" << j << "(" << 2*x+1 << ") = " << h << ", est at " << i * d * w + j * w + h << " = " << est << std::endl;
-                }
+    const returnType ret = reveal_epochs(serverfd, server_num, log, sums, num_valid, num_inputs);
+    delete[] sums;
+    return ret;
+}
 
-                if (min0 >= target_freq) {
-                    next_candidates.push_back(2 * x);
-                    // std::cout << "heavy 2x   prefix: " << 2 * x << std::endl;
-                }
-                if (min1 >= target_freq) {
-                    next_candidates.push_back(2 * x + 1);
-                    // std::cout << "heavy 2x+1 prefix: " << 2 * x + 1 << std::endl;
-                }
-            }
-            this_values = next_candidates;
-            next_candidates.clear();
-        }
+// Answer a logged task over its last length epochs. The window is kept between
+// queries, so a refresh only reads the epochs logged since, and as many expired.
+// The client sends the task name and length.
+returnType window_query(const int clientfd, const int serverfd, const int server_num) {
+    auto start = clock_start();
 
-        for (const uint64_t x : this_values) {
-            std::cout << x << " is heavy!" << std::endl;
-        }
+    const std::string name = recv_task_name(clientfd);
+    uint64_t length = 0;
+    recv_uint64(clientfd, length);
+    std::cout << "Task " << name << ", window of " << length << " epochs" << std::endl;
 
-        fmpz_clear(hashed);
-        clear_fmpz_array(a, share_size);
-        for (unsigned int i = 0; i < L; i++)
-            delete hash_stores[i];
-        delete[] hash_stores;
+    EpochLog log(EPOCH_DIR, name);
+    const bool header_ok = (log.ok() and !log.info().config.empty()
+                            and length > 0 and log.size() > 0);
+    if (!admit_batch(serverfd, "WINDOW", header_ok, 0, 0))
+        return RET_INVALID;
 
-        std::cout << "eval time: " << sec_from(start2) << std::endl;
-        start2 = clock_start();
+    EpochWindow window(log, EPOCH_DIR, length);
+    const uint64_t num_read = window.advance(serverfd);
+    std::cout << "Window: epochs " << window.first() << " to " << window.end() - 1
+              << ", " << num_read << " records read" << std::endl;
+    std::cout << "advance time: " << sec_from(start) << std::endl;
 
-        return RET_ANS;
-    }
+    return reveal_epochs(serverfd, server_num, log, window.sums(),
+                         window.num_valid(), window.num_inputs());
 }
 
 int main(int argc, char** argv) {
@@ -2078,6 +2409,10 @@ int main(int argc, char** argv) {
 
     init_constants();
 
+    IngestArena::spill_budget = SPILL_BUDGET_BYTES;
+    IngestArena::spill_segment = SPILL_SEGMENT_BYTES;
+    IngestArena::spill_dir = SPILL_DIR;
+
     // Set serverfd
     // Server 0 listens, via newsockfd_server
     // Server 1 connects, via sockfd_server
@@ -2102,10 +2437,22 @@ int main(int argc, char** argv) {
 
     correlated_store = new CorrelatedStore(serverfd, server_num, ot0, ot1, CACHE_SIZE, LAZY_PRECOMPUTE, true);
 
+    if (PERSIST_DABITS) {
+        const std::string dabit_path = DABIT_FILE + std::to_string(server_num);
+        dabit_file = new PersistentStore(dabit_path, 2, DABIT_FILE_CAPACITY);
+        correlated_store->attachDaBitFile(dabit_file);
+    }
+
     int sockfd, newsockfd;
     sockaddr_in addr;
 
     bind_and_listen(addr, sockfd, client_port, 1);
+    // Accepted connections inherit it
+    const int rcvbuf = CLIENT_RCVBUF_BYTES;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)))
+        error_exit("Sockopt failed");
+
+    FmpzArena* const fmpz_batch = USE_FMPZ_ARENA ? new FmpzArena(FMPZ_SLAB_LEN, FMPZ_ARENA_STATS) : nullptr;
 
     while(1) {
         // Refresh randomX if used too much
@@ -2129,7 +2476,14 @@ int main(int argc, char** argv) {
 
         // Get an initMsg
         initMsg msg;
-        recv_in(newsockfd, &msg, sizeof(initMsg));
+        if (recv_in(newsockfd, &msg, sizeof(initMsg)) != sizeof(initMsg)) {
+            std::cout << "No initMsg from client" << std::endl;
+            close(newsockfd);
+            continue;
+        }
+
+        FmpzArenaScope fmpz_scope(fmpz_batch);
+        fmpz_arena_phase("receive");
 
         if (msg.type == BIT_SUM) {
             std::cout << "BIT_SUM" << std::endl;
@@ -2145,10 +2499,16 @@ int main(int argc, char** argv) {
             std::cout << "INT_SUM" << std::endl;
             auto start = clock_start();
 
-            uint64_t ans;
+            // int_sum rejects more values than this
+            uint64_t* const ans = new uint64_t[std::min((size_t) msg.max_inp, (size_t) MAX_ROW_WORDS)];
             returnType ret = int_sum(msg, newsockfd, serverfd, server_num, ans);
-            if (ret == RET_ANS)
-                std::cout << "Ans: " << ans << std::endl;
+            if (ret == RET_ANS) {
+                std::cout << "Ans:";
+                for (unsigned int j = 0; j < msg.max_inp; j++)
+                    std::cout << " " << ans[j];
+                std::cout << std::endl;
+            }
+            delete[] ans;
 
             std::cout << "Total time  : " << sec_from(start) << std::endl;
         } else if (msg.type == AND_OP) {
@@ -2246,16 +2606,41 @@ int main(int argc, char** argv) {
             if (ret == RET_ANS)
                 ; // Answer output by heavy_op
 
+            std::cout << "Total time  : " << sec_from(start) << std::endl;
+        } else if (msg.type == EPOCH_QUERY) {
+            std::cout << "EPOCH_QUERY" << std::endl;
+            auto start = clock_start();
+
+            returnType ret = epoch_query(newsockfd, serverfd, server_num);
+            if (ret == RET_ANS)
+                ; // Answer output by epoch_query
+
+            std::cout << "Total time  : " << sec_from(start) << std::endl;
+        } else if (msg.type == EPOCH_WINDOW) {
+            std::cout << "EPOCH_WINDOW" << std::endl;
+            auto start = clock_start();
+
+            returnType ret = window_query(newsockfd, serverfd, server_num);
+            if (ret == RET_ANS)
+                ; // Answer output by window_query
+
             std::cout << "Total time  : " << sec_from(start) << std::endl;
         } else if (msg.type == NONE_OP) {
             std::cout << "Empty client message" << std::endl;
         } else {
             std::cout << "Unrecognized message type: " << msg.type << std::endl;
         }
+        if (fmpz_batch) {
+            fmpz_batch->report();
+            fmpz_batch->reset();
+        }
         close(newsockfd);
     }
 
+    delete fmpz_batch;
     delete correlated_store;
+    if (dabit_file)
+        delete dabit_file;
     for (const auto& precomp : precomp_store)
         delete precomp.second;
 
@@ -151,8 +151,12 @@ void syncSnipSeeds(const int serverfd, const int server_num) {
 
 struct Checker {
     const int server_num;     // id of this server
-    const ClientPacket* const req;  // Client packet
+    const ClientPacket req;   // View of the client packet, no copy
     Circuit* const ckt;      // Validation circuit
+    // Triple for the final check. The client's, unless the server made its own
+    const fmpz* const tripleA;
+    const fmpz* const tripleB;
+    const fmpz* const tripleC;
 
     const size_t n;  // number of mult gates
     const size_t N;  // NextPowerOfTwo(n)
@@ -171,10 +175,14 @@ struct Checker {
 
     Checker(Circuit* const c, const int idx, const ClientPacket* const req,
             const CheckerPreComp* const pre, const fmpz_t* const InputShares,
-            const bool same_runtime = false)
+            const bool same_runtime = false,
+            const BeaverTripleShare* const server_triple = nullptr)
     : server_num(idx)
-    , req(req)
+    , req(*req)
     , ckt(c)
+    , tripleA(server_triple ? server_triple->shareA : req->triple_a)
+    , tripleB(server_triple ? server_triple->shareB : req->triple_b)
+    , tripleC(server_triple ? server_triple->shareC : req->triple_c)
     , n(c->NumMulGates())
     , N(NextPowerOfTwo(n))
     , same_runtime(same_runtime)
@@ -210,9 +218,9 @@ struct Checker {
         // std::cout << "evalPoly" << std::endl;
         std::vector<Gate*> mulgates = ckt->mul_gates;
         // Get constant terms from packet
-        fmpz_set(pointsF[0], req->f0_s);
-        fmpz_set(pointsG[0], req->g0_s);
-        fmpz_set(pointsH[0], req->h0_s);
+        fmpz_set(pointsF[0], req.f0_s);
+        fmpz_set(pointsG[0], req.g0_s);
+        fmpz_set(pointsH[0], req.h0_s);
 
         // For all multiplication triples a_i * b_i = c_i
         //    polynomial [f(x)] has [f(i)] = [a_i]
@@ -226,7 +234,7 @@ struct Checker {
 
         // Grab odd values of h from the packet.
         for (unsigned int j = 0; j < N; j++) {
-            fmpz_set(pointsH[2 * j + 1], req->h_points[j]);
+            fmpz_set(pointsH[2 * j + 1], req.h_points[j]);
         }
 
         // set evals
@@ -243,10 +251,10 @@ struct Checker {
         // std::cout << "CorShareFn" << std::endl;
         CorShare* out = new CorShare();
 
-        fmpz_sub(out->shareD, evalF, req->triple_share->shareA);
+        fmpz_sub(out->shareD, evalF, tripleA);
         fmpz_mod(out->shareD, out->shareD, Int_Modulus);
 
-        fmpz_sub(out->shareE, evalG, req->triple_share->shareB);
+        fmpz_sub(out->shareE, evalG, tripleB);
         fmpz_mod(out->shareE, out->shareE, Int_Modulus);
 
         return out;
@@ -264,17 +272,17 @@ struct Checker {
             fmpz_mod(mulCheck, mulCheck, Int_Modulus);
         }
 
-        fmpz_mul(term, corIn->D, req->triple_share->shareB);
+        fmpz_mul(term, corIn->D, tripleB);
         fmpz_mod(term, term, Int_Modulus);
         fmpz_add(mulCheck, mulCheck, term);
         fmpz_mod(mulCheck, mulCheck, Int_Modulus);
 
-        fmpz_mul(term, corIn->E, req->triple_share->shareA);
+        fmpz_mul(term, corIn->E, tripleA);
         fmpz_mod(term, term, Int_Modulus);
         fmpz_add(mulCheck, mulCheck, term);
         fmpz_mod(mulCheck, mulCheck, Int_Modulus);
 
-        fmpz_add(mulCheck, mulCheck, req->triple_share->shareC);
+        fmpz_add(mulCheck, mulCheck, tripleC);
         fmpz_mod(mulCheck, mulCheck, Int_Modulus);
 
         fmpz_sub(mulCheck, mulCheck, evalH);
@@ -99,34 +99,44 @@ unsigned int NextPowerOfTwo(const unsigned int n);
 
    h_points is evaluated on 2N-th roots of unity, excluding points
    that are also N-th roots of unity. So all odd points.
+
+   Fields point into one block of words(NMul) fmpz, in the order sent:
+   MulShares, f0_s, g0_s, h0_s, h_points, triple a, b, c.
+   A packet owns its block, or is a view into a ClientPacketBatch.
+   Copies are always views.
 */
 struct ClientPacket {
     const size_t NMul;    // # mul gates = num wire shares
     const size_t N;       // N = length of h_points = # mult gates.
-    fmpz_t* MulShares;   // share of mulgate (output) wires, aka h(even)
-    fmpz_t f0_s;          // share of f(0) = pointsF[0] = u_0
-    fmpz_t g0_s;          // share of g(0) = pointsG[0] = v_0
-    fmpz_t h0_s;          // share of h(0)
-    fmpz_t* h_points;     // h evaluated on odd 2N-th roots of unity
-    BeaverTripleShare* triple_share;
+    fmpz_t* const data;
+    const bool owned;
+
+    fmpz_t* const MulShares;  // share of mulgate (output) wires, aka h(even)
+    fmpz* const f0_s;         // share of f(0) = pointsF[0] = u_0
+    fmpz* const g0_s;         // share of g(0) = pointsG[0] = v_0
+    fmpz* const h0_s;         // share of h(0)
+    fmpz_t* const h_points;   // h evaluated on odd 2N-th roots of unity
+    fmpz* const triple_a;     // Beaver triple share, for the final check
+    fmpz* const triple_b;
+    fmpz* const triple_c;
+
+    static size_t words(const size_t NMul) {
+        return NMul + NextPowerOfTwo(NMul) + 6;
+    }
 
     ClientPacket(const size_t NMul)
-    : NMul(NMul), N(NextPowerOfTwo(NMul)) {
-        new_fmpz_array(&MulShares, NMul);
-        fmpz_init(f0_s);
-        fmpz_init(g0_s);
-        fmpz_init(h0_s);
-        new_fmpz_array(&h_points, N);
-        triple_share = new BeaverTripleShare();
-    }
+    : ClientPacket(NMul, new_packet_block(NMul), true) {}
+
+    // View of someone else's block
+    ClientPacket(const size_t NMul, fmpz_t* const data)
+    : ClientPacket(NMul, data, false) {}
+
+    ClientPacket(const ClientPacket& o)
+    : ClientPacket(o.NMul, o.data, false) {}
 
     ~ClientPacket() {
-        clear_fmpz_array(MulShares, NMul);
-        fmpz_clear(f0_s);
-        fmpz_clear(g0_s);
-        fmpz_clear(h0_s);
-        clear_fmpz_array(h_points, N);
-        delete triple_share;
+        if (owned)
+            clear_fmpz_array(data, words(NMul));
     }
 
     void print() const {
@@ -150,6 +160,57 @@ struct ClientPacket {
         }
         std::cout << "}" << std::endl;
     }
+
+private:
+    static fmpz_t* new_packet_block(const size_t NMul) {
+        fmpz_t* out; new_fmpz_array(&out, words(NMul));
+        return out;
+    }
+
+    ClientPacket(const size_t NMul, fmpz_t* const data, const bool owned)
+    : NMul(NMul)
+    , N(NextPowerOfTwo(NMul))
+    , data(data)
+    , owned(owned)
+    , MulShares(data)
+    , f0_s(data[NMul])
+    , g0_s(data[NMul + 1])
+    , h0_s(data[NMul + 2])
+    , h_points(&data[NMul + 3])
+    , triple_a(data[NMul + 3 + N])
+    , triple_b(data[NMul + 4 + N])
+    , triple_c(data[NMul + 5 + N])
+    {}
+};
+
+// All of a batch's packets, as one fmpz array. Slot i is packet(i).
+// Like IngestArena, there's a spare slot for a last dropped packet,
+// then one that stays zero, as a stand in for missing clients.
+struct ClientPacketBatch {
+    const size_t NMul;
+    const size_t len;       // fmpz per packet
+    const size_t capacity;  // slots, without the extra two
+    fmpz_t* data;
+
+    ClientPacketBatch(const size_t NMul, const size_t capacity)
+    : NMul(NMul)
+    , len(ClientPacket::words(NMul))
+    , capacity(capacity)
+    {
+        new_fmpz_array(&data, (capacity + 2) * len);
+    }
+
+    ~ClientPacketBatch() {
+        clear_fmpz_array(data, (capacity + 2) * len);
+    }
+
+    ClientPacket packet(const size_t i) const {
+        return ClientPacket(NMul, &data[i * len]);
+    }
+
+    size_t zero_slot() const {
+        return capacity + 1;
+    }
 };
 
 // Unused?
@@ -0,0 +1,248 @@
+#ifndef SUBMIT_QUEUE_H
+#define SUBMIT_QUEUE_H
+
+/*
+Bounded multi producer, single consumer ring of parsed submissions,
+between network threads and an op's compute thread.
+
+Each slot has a pk, a payload of row_words words, and whether the parse
+kept it. Producers claim a slot with a CAS on the tail, fill it, and
+publish it by storing its sequence number (Vyukov's bounded queue).
+No locks; producers only contend on the tail. The consumer takes published
+slots in ticket order, a batch at a time, and frees them by bumping their
+sequence a lap ahead.
+
+When the ring is full, a claim fails. claim_wait() then backs off, so
+the connection stops being read and TCP flow control slows its client down.
+stalls() counts those waits.
+*/
+
+#include <poll.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "ingest.h"
+#include "types.h"
+
+class SubmitQueue {
+  // Own cache line each, so producers on nearby slots don't false share.
+  // Padded rather than alignas, since new doesn't over align before C++17.
+  struct Seq {
+    std::atomic<uint64_t> v;
+    char pad[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  const size_t mask;
+  const size_t row_words;
+  Seq* const seq;
+  char* const pks;
+  uint64_t* const rows;
+  bool* const keeps;
+
+  char pad0[64];
+  std::atomic<uint64_t> tail;
+  char pad1[64];
+  uint64_t head = 0;  // Consumer only
+  std::atomic<uint64_t> num_stalls;
+
+public:
+  // slots is rounded up to a power of 2
+  SubmitQueue(const size_t slots, const size_t row_words)
+  : mask(round_pow2(slots) - 1)
+  , row_words(row_words)
+  , seq(new Seq[mask + 1])
+  , pks(new char[(mask + 1) * PK_LENGTH])
+  , rows(new uint64_t[(mask + 1) * row_words])
+  , keeps(new bool[mask + 1])
+  , tail(0)
+  , num_stalls(0)
+  {
+    for (size_t i = 0; i <= mask; i++)
+      seq[i].v.store(i, std::memory_order_relaxed);
+  }
+
+  ~SubmitQueue() {
+    delete[] seq;
+    delete[] pks;
+    delete[] rows;
+    delete[] keeps;
+  }
+
+  static size_t round_pow2(const size_t n) {
+    size_t p = 1;
+    while (p < n)
+      p <<= 1;
+    return p;
+  }
+
+  // Spin, then yield, then sleep. Sleeping matters when threads share a core,
+  // where a yield often just comes straight back.
+  static void backoff(unsigned int& spins) {
+    if (spins < 1024)
+      spins++;
+    if (spins < 64)
+      return;
+    if (spins < 1024)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+
+  size_t width() const { return row_words; }
+  uint64_t stalls() const { return num_stalls.load(std::memory_order_relaxed); }
+
+  // Claim the next slot as ticket. False if the ring is full.
+  bool claim(uint64_t& ticket) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      const uint64_t s = seq[pos & mask].v.load(std::memory_order_acquire);
+      const int64_t dif = (int64_t) (s - pos);
+      if (dif == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+    ticket = pos;
+    return true;
+  }
+
+  // Claim, backing off while the ring is full
+  uint64_t claim_wait() {
+    uint64_t ticket;
+    if (claim(ticket))
+      return ticket;
+    num_stalls.fetch_add(1, std::memory_order_relaxed);
+    unsigned int spins = 0;
+    while (!claim(ticket))
+      SubmitQueue::backoff(spins);
+    return ticket;
+  }
+
+  char* pk(const uint64_t ticket) { return &pks[(ticket & mask) * PK_LENGTH]; }
+  uint64_t* row(const uint64_t ticket) { return &rows[(ticket & mask) * row_words]; }
+
+  // Hand a filled slot to the consumer
+  void publish(const uint64_t ticket, const bool keep) {
+    keeps[ticket & mask] = keep;
+    seq[ticket & mask].v.store(ticket + 1, std::memory_order_release);
+  }
+
+  // Up to max published submissions, in ticket order, to f(pk, row, keep).
+  // Stops at the first slot not published yet. Returns how many.
+  template <typename F>
+  size_t pop_batch(const size_t max, F f) {
+    size_t n = 0;
+    while (n < max) {
+      const uint64_t pos = head + n;
+      if (seq[pos & mask].v.load(std::memory_order_acquire) != pos + 1)
+        break;
+      n++;
+    }
+    for (size_t k = 0; k < n; k++) {
+      const size_t i = (head + k) & mask;
+      f(&pks[i * PK_LENGTH], &rows[i * row_words], keeps[i]);
+    }
+    // Only free them once all are read
+    for (size_t k = 0; k < n; k++)
+      seq[(head + k) & mask].v.store(head + k + mask + 1, std::memory_order_release);
+    head += n;
+    return n;
+  }
+};
+
+/*
+Receive n submissions into arena, over num_fds connections, with a network
+thread per connection feeding a SubmitQueue. Connection c sends n / num_fds
+of them, plus one if c < n % num_fds.
+parse(fd, pk, row, keep) reads one submission into pk and row[arena.width()],
+may clear keep, and returns its bytes. This thread does the dedup and commit.
+A submission is frame_bytes on the wire. A parse that gets anything else
+means the connection failed or is out of step, so its thread drops that
+submission and stops reading the connection. The rest still count.
+With one connection there's nothing to merge, so it parses straight into
+the arena's next row and skips the queue.
+Otherwise each network thread waits until its connection has data, then
+claims a slot and parses into it. The consumer goes in ticket order, so
+a slot claimed on an idle connection would hold up all the others.
+Returns the bytes read over all connections.
+*/
+template <typename Parse>
+int ingest_submissions(const int* const fds, const size_t num_fds, const size_t n,
+                       const size_t frame_bytes, IngestArena& arena,
+                       SubmitQueue& queue, Parse parse) {
+  if (num_fds == 1) {
+    int total = 0;
+    for (size_t i = 0; i < n; i++) {
+      bool keep = true;
+      const int got = parse(fds[0], arena.next_pk(), arena.next_row(), keep);
+      if (got != (int) frame_bytes)
+        break;
+      total += got;
+      arena.commit(keep);
+    }
+    return total;
+  }
+
+  std::vector<int> bytes(num_fds, 0);
+  std::atomic<size_t> expected(n);  // Less what dropped connections won't send
+  std::vector<std::thread> threads;
+  for (size_t c = 0; c < num_fds; c++) {
+    const size_t count = n / num_fds + (c < n % num_fds);
+    threads.emplace_back([&, c, count]() {
+      pollfd pfd = {fds[c], POLLIN, 0};
+      for (size_t i = 0; i < count; i++) {
+        while (poll(&pfd, 1, -1) < 0 and errno == EINTR) {}
+        const uint64_t ticket = queue.claim_wait();
+        bool keep = true;
+        const int got = parse(fds[c], queue.pk(ticket), queue.row(ticket), keep);
+        if (got != (int) frame_bytes) {
+          // The slot still goes to the consumer, just not kept
+          expected.fetch_sub(count - i - 1, std::memory_order_release);
+          queue.publish(ticket, false);
+          break;
+        }
+        bytes[c] += got;
+        queue.publish(ticket, keep);
+      }
+    });
+  }
+
+  const size_t row_bytes = arena.width() * sizeof(uint64_t);
+  size_t done = 0;
+  unsigned int idle = 0;
+  while (done < expected.load(std::memory_order_acquire)) {
+    const size_t got = queue.pop_batch(n - done,
+        [&](const char* const pk, const uint64_t* const row, const bool keep) {
+      if (!keep)
+        return;
+      memcpy(arena.next_pk(), pk, PK_LENGTH);
+      memcpy(arena.next_row(), row, row_bytes);
+      arena.commit(keep);
+    });
+    done += got;
+    if (got == 0)
+      SubmitQueue::backoff(idle);
+    else
+      idle = 0;
+  }
+
+  int total = 0;
+  for (size_t c = 0; c < num_fds; c++) {
+    threads[c].join();
+    total += bytes[c];
+  }
+  return total;
+}
+
+#endif
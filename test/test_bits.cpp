@@ -1,3 +1,6 @@
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <iostream>
 
 #include "utils_test_connect.h"
@@ -5,6 +8,7 @@
 #include "../correlated.h"
 #include "../fmpz_utils.h"
 #include "../net_share.h"
+#include "../persist.h"
 
 const size_t batch_size = 10000; // flexible
 const size_t N = 20;           // Must be >= 2
@@ -16,6 +20,8 @@ const bool lazy = false;
 void test_multiplyBoolShares(const size_t N, const int server_num, const int serverfd, CorrelatedStore* store) {
   bool* x = new bool[N];
   bool* y = new bool[N];
+  memset(x, 0, N);
+  memset(y, 0, N);
   if (server_num == 0) {
     x[0] = true; x[1] = false;
     y[0] = false; y[1] = true;
@@ -49,11 +55,9 @@ void test_addBinaryShares(const size_t N, const size_t* const nbits, const int s
     x[i] = new bool[nbits[i]];
     y[i] = new bool[nbits[i]];
     z[i] = new bool[nbits[i]];
+    memset(x[i], 0, nbits[i]);
+    memset(y[i], 0, nbits[i]);
   }
-  memset(x[0], 0, nbits[0]);
-  memset(x[1], 0, nbits[1]);
-  memset(y[0], 0, nbits[0]);
-  memset(y[1], 0, nbits[1]);
 
   if (server_num == 0) {
     x[0][0] = 1; x[0][1] = 0; x[0][2] = 1;  // 3
@@ -158,7 +162,7 @@ void test_b2a_daBit_single(const size_t N, const int server_num, const int serve
   clear_fmpz_array(xp, N);
 }
 
-void test_b2a_multi(const size_t N, const size_t* const nbits, const int server_num, const int serverfd, CorrelatedStore* store) {
+void test_b2a_multi(const size_t N, const size_t* const nbits, const int server_num, const int serverfd, CorrelatedStore* store, const bool edabit = false) {
   fmpz_t* x; new_fmpz_array(&x, N);
 
   if (server_num == 0) {
@@ -170,7 +174,10 @@ void test_b2a_multi(const size_t N, const size_t* const nbits, const int server_
   }
 
   fmpz_t* xp;
-  xp = store->b2a_daBit_multi(N, nbits, x);
+  if (edabit)
+    xp = store->b2a_edaBit(N, nbits, x);
+  else
+    xp = store->b2a_daBit_multi(N, nbits, x);
 
   if (server_num == 0) {
     fmpz_t tmp; fmpz_init(tmp);
@@ -232,6 +239,32 @@ void test_b2a_ot(const size_t N, const size_t* const nbits, const int server_num
   clear_fmpz_array(xp, N);
 }
 
+void test_arith_triples(const size_t N, const int server_num, const int serverfd, CorrelatedStore* store) {
+  const uint64_t mod = fmpz_get_ui(Int_Modulus);
+  const TripleView triple = store->getArithTriples(N);
+
+  if (server_num == 0) {
+    uint64_t* const other = new uint64_t[3 * N];
+    recv_uint64_batch(serverfd, other, 3 * N);
+    for (unsigned int i = 0; i < N; i++) {
+      const uint64_t a = addmod(triple.a[i], other[3 * i], mod);
+      const uint64_t b = addmod(triple.b[i], other[3 * i + 1], mod);
+      const uint64_t c = addmod(triple.c[i], other[3 * i + 2], mod);
+      assert(c == mulmod(a, b, mod));
+    }
+    delete[] other;
+  } else {
+    uint64_t* const mine = new uint64_t[3 * N];
+    for (unsigned int i = 0; i < N; i++) {
+      mine[3 * i] = triple.a[i];
+      mine[3 * i + 1] = triple.b[i];
+      mine[3 * i + 2] = triple.c[i];
+    }
+    send_uint64_batch(serverfd, mine, 3 * N);
+    delete[] mine;
+  }
+}
+
 void runServerTest(const int server_num, const int serverfd) {
   OT_Wrapper* ot0 = new OT_Wrapper(server_num == 0 ? nullptr : "127.0.0.1", 60051);
   OT_Wrapper* ot1 = new OT_Wrapper(server_num == 1 ? nullptr : "127.0.0.1", 60052);
@@ -252,13 +285,11 @@ void runServerTest(const int server_num, const int serverfd) {
     std::cout << "iteration: " << i << std::endl;
     start = clock_start();
 
-    /* Unused
     test_multiplyBoolShares(N, server_num, serverfd, store);
     std::cout << "mul bool timing : " << sec_from(start) << std::endl; start = clock_start();
 
     test_addBinaryShares(N, bits_arr, server_num, serverfd, store);
     std::cout << "add bin timing : " << sec_from(start) << std::endl; start = clock_start();
-    */
 
     test_b2a_daBit_single(N, server_num, serverfd, store);
     std::cout << "b2a da single timing : " << sec_from(start) << std::endl; start = clock_start();
@@ -266,16 +297,60 @@ void runServerTest(const int server_num, const int serverfd) {
     test_b2a_multi(N, bits_arr, server_num, serverfd, store);
     std::cout << "b2a da multi timing : " << sec_from(start) << std::endl; start = clock_start();
 
+    test_b2a_multi(N, bits_arr, server_num, serverfd, store, true);
+    std::cout << "b2a edabit timing : " << sec_from(start) << std::endl; start = clock_start();
+
     test_b2a_ot(N, bits_arr, server_num, serverfd, store);
     std::cout << "b2a ot timing : " << sec_from(start) << std::endl; start = clock_start();
+
+    test_arith_triples(N, server_num, serverfd, store);
+    std::cout << "arith triple timing : " << sec_from(start) << std::endl; start = clock_start();
   }
 
   store->printSizes();
+  delete store;
+
+  // Again, with daBits made into and read back from disk
+  PersistentStore* file = new PersistentStore("test_dabits_" + std::to_string(server_num), 2, 4 * N);
+  store = new CorrelatedStore(serverfd, server_num, ot0, ot1, batch_size, lazy, do_fork);
+  store->attachDaBitFile(file);
+  start = clock_start();
+  test_b2a_daBit_single(N, server_num, serverfd, store);
+  std::cout << "b2a da single from disk timing : " << sec_from(start) << std::endl;
+  assert(file->available() == 0);
+  store->printSizes();
+  delete store;
+  delete file;
+
+  // Records damaged on server 0 only, after they were written, reset both stores
+  const std::string path = "test_dabits_" + std::to_string(server_num);
+  file = new PersistentStore(path, 2, 4 * N);
+  assert(file->sync(serverfd, server_num));
+  uint64_t* const records = new uint64_t[2 * N];
+  for (unsigned int i = 0; i < 2 * N; i++)
+    records[i] = i;
+  file->append(N, records);
+  delete file;
+  if (server_num == 0) {
+    const int fd = open(path.c_str(), O_RDWR);
+    const size_t len = 4 * N * 2 * sizeof(uint64_t);
+    char* const body = new char[len];
+    assert(pread(fd, body, len, PERSIST_HEADER_BYTES) == (ssize_t) len);
+    for (size_t i = 0; i < len; i += sizeof(uint64_t))
+      body[i] ^= 1;
+    assert(pwrite(fd, body, len, PERSIST_HEADER_BYTES) == (ssize_t) len);
+    close(fd);
+    delete[] body;
+  }
+  file = new PersistentStore(path, 2, 4 * N);
+  assert(!file->sync(serverfd, server_num));
+  assert(file->available() == 0);
+  delete file;
+  delete[] records;
 
   delete ot0;
   delete ot1;
   delete[] bits_arr;
-  delete store;
 }
 
 void serverTest() {
@@ -0,0 +1,50 @@
+#include <iostream>
+
+#include "../dpf.h"
+#include "../utils.h"
+
+// Small, large, and mod 2^64
+const uint64_t mods[] = {101, 0x8000000000080001ULL, 0};
+
+// Shares should add to beta at alpha, and 0 everywhere else
+bool run_dpf(const size_t n, const uint64_t alpha, const uint64_t beta, const uint64_t mod) {
+  const size_t depth = dpf_depth(n);
+  uint64_t* const key0 = new uint64_t[dpf_key_words(depth)];
+  uint64_t* const key1 = new uint64_t[dpf_key_words(depth)];
+  uint64_t* const out0 = new uint64_t[n];
+  uint64_t* const out1 = new uint64_t[n];
+
+  dpf_gen(depth, alpha, beta, mod, key0, key1);
+  dpf_eval_all(0, depth, key0, n, mod, out0);
+  dpf_eval_all(1, depth, key1, n, mod, out1);
+
+  bool ok = true;
+  for (unsigned int i = 0; i < n; i++) {
+    const uint64_t y = addmod(out0[i], out1[i], mod);
+    if (y != (i == alpha ? beta : 0)) {
+      std::cout << "  n = " << n << ", alpha = " << alpha << ": f(" << i << ") = " << y << std::endl;
+      ok = false;
+    }
+  }
+
+  delete[] key0;
+  delete[] key1;
+  delete[] out0;
+  delete[] out1;
+  return ok;
+}
+
+void test_dpf() {
+  const size_t sizes[] = {1, 2, 3, 5, 8, 13, 64, 100};
+  for (const uint64_t mod : mods) {
+    unsigned int num_bad = 0;
+    for (const size_t n : sizes)
+      for (unsigned int alpha = 0; alpha < n; alpha++)
+        num_bad += !run_dpf(n, alpha, (mod == 101 ? 7 : 123456789), mod);
+    std::cout << "mod " << mod << ": " << num_bad << " bad" << std::endl;
+  }
+}
+
+int main(int argc, char** argv){
+  test_dpf();
+}
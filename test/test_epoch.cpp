@@ -0,0 +1,142 @@
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "../epoch.h"
+#include "../net_share.h"
+#include "../utils.h"
+
+const uint64_t mod = 0x8000000000080001ULL;
+const size_t width = 5;
+
+// Epoch e's share on server s. Shares of e add to e * (j + 1).
+uint64_t share(const uint64_t e, const size_t j, const int s) {
+  const uint64_t mask = (e * 0x9e3779b97f4a7c15ULL + j) % mod;
+  return s == 0 ? addmod(e * (j + 1), mask, mod) : submod(0, mask, mod);
+}
+
+void append_epochs(EpochLog& log, const int fd, const int s, const uint64_t first, const uint64_t last) {
+  uint64_t row[width];
+  for (uint64_t e = first; e <= last; e++) {
+    for (size_t j = 0; j < width; j++)
+      row[j] = share(e, j, s);
+    log.append(fd, row, e, e + 1);
+  }
+}
+
+// Merged shares should reveal sum over [first, last] of e * (j + 1)
+size_t check_range(EpochLog& log0, EpochLog& log1, const uint64_t first, const uint64_t last) {
+  uint64_t a[width], b[width], num_valid, num_inputs, v1, n1;
+  log0.merge(first, last, a, num_valid, num_inputs);
+  log1.merge(first, last, b, v1, n1);
+  const uint64_t sum_e = (first + last) * (last - first + 1) / 2;
+  size_t num_bad = (num_valid != sum_e or num_inputs != sum_e + last - first + 1);
+  for (size_t j = 0; j < width; j++)
+    num_bad += (addmod(a[j], b[j], mod) != sum_e * (j + 1));
+  return num_bad;
+}
+
+// Windows moved in step should match merging their range, reading two records per epoch
+size_t check_window(EpochLog& log0, EpochLog& log1, const std::string& dir0,
+                    const std::string& dir1, const int* const sv, const size_t length,
+                    const uint64_t expect_read) {
+  EpochWindow w0(log0, dir0, length), w1(log1, dir1, length);
+  uint64_t read1 = 0;
+  std::thread t([&]() { read1 = w1.advance(sv[1]); });
+  const uint64_t read0 = w0.advance(sv[0]);
+  t.join();
+
+  const uint64_t first = w0.first(), last = w0.end() - 1;
+  const uint64_t sum_e = (first + last) * (last - first + 1) / 2;
+  size_t num_bad = (read0 != expect_read or read1 != expect_read or w1.end() != w0.end());
+  num_bad += (last - first + 1 != std::min<uint64_t>(length, log0.size()));
+  num_bad += (w0.num_valid() != sum_e or w0.num_inputs() != sum_e + last - first + 1);
+  for (size_t j = 0; j < width; j++)
+    num_bad += (addmod(w0.sums()[j], w1.sums()[j], mod) != sum_e * (j + 1));
+  return num_bad;
+}
+
+int main(int argc, char** argv) {
+  char dir[] = "/tmp/epoch_testXXXXXX";
+  if (!mkdtemp(dir))
+    error_exit("mkdtemp");
+  const std::string dir0 = std::string(dir) + "/0", dir1 = std::string(dir) + "/1";
+  mkdir(dir0.c_str(), 0700);
+  mkdir(dir1.c_str(), 0700);
+  const EpochTask task = {"test_5", {0, 5}, mod};
+
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  size_t num_bad = 0;
+  {
+    EpochLog log0(dir0, task, width), log1(dir1, task, width);
+    std::thread t1([&]() { append_epochs(log1, sv[1], 1, 0, 9); });
+    append_epochs(log0, sv[0], 0, 0, 9);
+    t1.join();
+    num_bad += (log0.size() != 10 or log1.size() != 10);
+    num_bad += check_range(log0, log1, 0, 9) + check_range(log0, log1, 3, 3)
+             + check_range(log0, log1, 2, 7);
+
+    // Server 0 appends epoch 10, then server 1 crashes before it does.
+    std::thread t2([&]() { uint64_t c; recv_uint64(sv[1], c); send_uint64(sv[1], log1.size()); });
+    append_epochs(log0, sv[0], 0, 99, 99);
+    t2.join();
+    num_bad += (log0.size() != 11);
+  }
+
+  // Reopened, the next append drops server 0's extra record
+  EpochLog log0(dir0, task, width), log1(dir1, "test_5");
+  num_bad += (!log1.ok() or log1.width() != width or log1.info().config != task.config);
+  std::thread t3([&]() { append_epochs(log1, sv[1], 1, 10, 11); });
+  append_epochs(log0, sv[0], 0, 10, 11);
+  t3.join();
+  num_bad += (log0.size() != 12 or log1.size() != 12);
+  num_bad += check_range(log0, log1, 0, 11) + check_range(log0, log1, 10, 10);
+
+  // Windows of 4 epochs: first from scratch, then one and two epochs on,
+  // then after server 1 loses its window, from scratch again
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 4);
+  std::thread t4([&]() { append_epochs(log1, sv[1], 1, 12, 12); });
+  append_epochs(log0, sv[0], 0, 12, 12);
+  t4.join();
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 2);
+  std::thread t5([&]() { append_epochs(log1, sv[1], 1, 13, 14); });
+  append_epochs(log0, sv[0], 0, 13, 14);
+  t5.join();
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 4);
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 0);
+  unlink((dir1 + "/test_5.window").c_str());
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 4);
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 100, 15);
+  // One window file per task, so going back to 4 starts over
+  num_bad += check_window(log0, log1, dir0, dir1, sv, 4, 4);
+
+  // Server 0's counts decide: a batch it finds below threshold isn't logged on either
+  uint64_t row[width] = {0};
+  bool logged1 = true;
+  std::thread t6([&]() { logged1 = log1.append_passed(sv[1], 1, 0.5, row, 10, 10); });
+  const bool logged0 = log0.append_passed(sv[0], 0, 0.5, row, 4, 10);
+  t6.join();
+  num_bad += (logged0 or logged1 or log0.size() != 15 or log1.size() != 15);
+  std::thread t7([&]() { logged1 = log1.append_passed(sv[1], 1, 0.5, row, 0, 10); });
+  const bool passed0 = log0.append_passed(sv[0], 0, 0.5, row, 5, 10);
+  t7.join();
+  num_bad += (!passed0 or !logged1 or log0.size() != 16 or log1.size() != 16);
+
+  EpochLog missing(dir0, "nothing_here"), bad_name(dir0, "../0/test_5");
+  num_bad += missing.ok() + bad_name.ok();
+
+  std::cout << "Epoch log: " << num_bad << " bad" << std::endl;
+
+  close(sv[0]);
+  close(sv[1]);
+  const std::string cleanup = std::string("rm -r ") + dir;
+  if (system(cleanup.c_str()) != 0)
+    std::cout << "Couldn't remove " << dir << std::endl;
+  return num_bad != 0;
+}
@@ -0,0 +1,137 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../constants.h"
+#include "../fmpz_utils.h"
+#include "../group_by.h"
+#include "../net_share.h"
+#include "../utils.h"
+
+const size_t n = 20;
+const size_t num_values = 2;
+
+// First seen order is 7, 3, 9, 5, 11, 2
+const uint64_t labels[n] = {7, 3, 9, 7, 7, 5, 9, 7, 9, 11, 7, 9, 5, 7, 11, 9, 2, 7, 9, 11};
+
+uint64_t value(const size_t i, const size_t j) {
+  return i * 10 + j + 1;
+}
+
+// Shares of each value split across servers, so only the reveal adds them up
+void make_shares(fmpz_t* const shares0, fmpz_t* const shares1, const uint64_t mod) {
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 0; j < num_values; j++) {
+      const uint64_t mask = (i * 0x9e3779b97f4a7c15ULL + j) % mod;
+      fmpz_set_ui(shares0[i * num_values + j], mask);
+      fmpz_set_ui(shares1[i * num_values + j], submod(value(i, j), mask, mod));
+    }
+  }
+}
+
+// Accumulate on both servers, reveal, and check against the expected slots
+size_t check_sums(const int* const sv, const fmpz_t* const shares0, const fmpz_t* const shares1,
+                  const bool* const valid, const size_t min_count, const size_t max_labels,
+                  const std::vector<uint64_t>& expect_labels,
+                  const size_t expect_suppressed, const size_t expect_left_out) {
+  LabelSums ans0(min_count, max_labels), ans1(min_count, max_labels);
+  const size_t num_valid0 = accumulate(n, num_values, shares0, valid, labels, ans0);
+  const size_t num_valid1 = accumulate(n, num_values, shares1, valid, labels, ans1);
+
+  std::thread t([&]() { reveal_label_sums(sv[1], 1, ans1); });
+  uint64_t* const sums = reveal_label_sums(sv[0], 0, ans0);
+  t.join();
+
+  size_t num_valid = 0;
+  for (unsigned int i = 0; i < n; i++)
+    num_valid += valid[i];
+  size_t num_bad = (num_valid0 != num_valid or num_valid1 != num_valid);
+  num_bad += (ans0.labels != expect_labels or ans1.labels != expect_labels);
+  num_bad += (ans0.num_suppressed != expect_suppressed or ans0.num_left_out != expect_left_out);
+  num_bad += (ans1.num_suppressed != expect_suppressed or ans1.num_left_out != expect_left_out);
+  num_bad += (ans0.index.size() != expect_labels.size());
+
+  for (unsigned int g = 0; g < expect_labels.size() and g < ans0.size(); g++) {
+    num_bad += (ans0.index[expect_labels[g]] != g);
+    size_t count = 0;
+    uint64_t sum[num_values] = {0};
+    for (unsigned int i = 0; i < n; i++) {
+      if (!valid[i] or labels[i] != expect_labels[g])
+        continue;
+      count++;
+      for (unsigned int j = 0; j < num_values; j++)
+        sum[j] += value(i, j);
+    }
+    num_bad += (ans0.counts[g] != count or ans1.counts[g] != count or count < min_count);
+    for (unsigned int j = 0; j < num_values; j++)
+      num_bad += (sums[g * num_values + j] != sum[j]);
+  }
+  delete[] sums;
+  return num_bad;
+}
+
+int main(int argc, char** argv) {
+  init_constants();
+  const uint64_t mod = fmpz_get_ui(Int_Modulus);
+
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  size_t num_bad = 0;
+
+  // Rows are values then the label
+  uint64_t rows[n * (num_values + 1)];
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 0; j < num_values; j++)
+      rows[i * (num_values + 1) + j] = value(i, j);
+    rows[i * (num_values + 1) + num_values] = labels[i];
+  }
+  uint64_t values[n * num_values], labels0[n], labels1[n];
+  split_labels(n, num_values, rows, values, labels0);
+  for (unsigned int i = 0; i < n; i++) {
+    num_bad += (labels0[i] != labels[i]);
+    for (unsigned int j = 0; j < num_values; j++)
+      num_bad += (values[i * num_values + j] != value(i, j));
+  }
+
+  // Client 13 sent server 1 a different label, so server 0 drops it
+  bool valid[n];
+  memcpy(labels1, labels0, sizeof(labels0));
+  labels1[13] = 8;
+  for (unsigned int i = 0; i < n; i++)
+    valid[i] = (i != 4 and i != 10);
+  std::thread t([&]() { check_labels(sv[1], 1, n, labels1, valid); });
+  check_labels(sv[0], 0, n, labels0, valid);
+  t.join();
+  for (unsigned int i = 0; i < n; i++)
+    num_bad += (valid[i] != (i != 4 and i != 10 and i != 13));
+
+  fmpz_t *shares0, *shares1;
+  new_fmpz_array(&shares0, n * num_values);
+  new_fmpz_array(&shares1, n * num_values);
+  make_shares(shares0, shares1, mod);
+
+  // Valid counts: 7 has 4, 3 has 1, 9 has 6, 5 has 2, 11 has 3, 2 has 1.
+  // Everything revealed, in first seen order
+  num_bad += check_sums(sv, shares0, shares1, valid, 0, 100, {7, 3, 9, 5, 11, 2}, 0, 0);
+  // 3, 5 and 2 are under 3, and the rest keep their order
+  num_bad += check_sums(sv, shares0, shares1, valid, 3, 100, {7, 9, 11}, 3, 4);
+  // Only 7, 3, 9, 5 get slots, so 11 is left out even with enough clients
+  num_bad += check_sums(sv, shares0, shares1, valid, 3, 4, {7, 9}, 2, 7);
+  num_bad += check_sums(sv, shares0, shares1, valid, 1, 1, {7}, 0, 13);
+  // Nothing revealed, and server 1 sends nothing
+  num_bad += check_sums(sv, shares0, shares1, valid, 7, 100, {}, 6, 17);
+
+  clear_fmpz_array(shares0, n * num_values);
+  clear_fmpz_array(shares1, n * num_values);
+
+  std::cout << "Group by: " << num_bad << " bad" << std::endl;
+
+  close(sv[0]);
+  close(sv[1]);
+  clear_constants();
+  return num_bad != 0;
+}
@@ -47,6 +47,72 @@ void test_hash() {
     store.print_hash(i);
 }
 
+// Old fmpz evaluation, from the coefficients as printed
+uint64_t fmpz_hash(const uint64_t* const c, const size_t degree, const size_t l_bits,
+                   const size_t w_bits, const size_t w, const uint64_t x) {
+  fmpz_t out, l, tmp; fmpz_init(out); fmpz_init(l); fmpz_init(tmp);
+  fmpz_set_ui(l, 1ULL << l_bits);
+  for (unsigned int j = degree; j > 0; j--) {
+    fmpz_set_ui(tmp, c[j]);
+    fmpz_add(out, out, tmp);
+    fmpz_mul_ui(out, out, x);
+    fmpz_mod(out, out, l);
+  }
+  fmpz_fdiv_q_2exp(out, out, l_bits - w_bits);
+  fmpz_add_ui(out, out, c[0]);
+  fmpz_set_ui(tmp, w);
+  fmpz_mod(out, out, tmp);
+  const uint64_t ans = fmpz_get_ui(out);
+  fmpz_clear(out); fmpz_clear(l); fmpz_clear(tmp);
+  return ans;
+}
+
+// Native and batch evals should match fmpz, for all degrees and widths
+void test_native() {
+  flint_rand_t hash_seed;
+  flint_randinit(hash_seed);
+  const size_t big_l = 40, big_w = 1000, big_d = 4;
+
+  unsigned int num_bad = 0;
+  for (size_t independence = 2; independence <= 4; independence++) {
+    HashStore store(big_d, big_l, big_w, hash_seed, independence);
+    size_t w_bits = 1;
+    for (size_t tmp = big_w - 1; tmp >>= 1;)
+      w_bits++;
+
+    uint64_t c[big_d][5];
+    fmpz_t coeff; fmpz_init(coeff);
+    // Stores copy the seed, so redrawing from it gives the same coefficients
+    flint_rand_t seed_copy;
+    flint_randinit(seed_copy);
+    seed_copy[0] = hash_seed[0];
+    fmpz_t l, w; fmpz_init(l); fmpz_init(w);
+    fmpz_set_ui(l, 1ULL << big_l); fmpz_set_ui(w, big_w);
+    for (unsigned int i = 0; i < big_d; i++) {
+      for (unsigned int j = 0; j < independence; j++) {
+        fmpz_randm(coeff, seed_copy, j == 0 ? w : l);
+        c[i][j] = fmpz_get_ui(coeff);
+      }
+    }
+
+    uint64_t out[big_d];
+    for (unsigned int x = 0; x < 100000; x += 7) {
+      const unsigned int in = x * 2654435761U;
+      store.eval_all(in, out);
+      for (unsigned int i = 0; i < big_d; i++) {
+        const uint64_t expect = fmpz_hash(c[i], independence - 1, big_l, w_bits, big_w, in);
+        if (out[i] != expect or store.eval(i, in) != expect)
+          num_bad++;
+      }
+    }
+    fmpz_clear(coeff); fmpz_clear(l); fmpz_clear(w);
+    flint_randclear(seed_copy);
+  }
+  std::cout << "Native hash mismatches: " << num_bad << std::endl;
+  flint_randclear(hash_seed);
+}
+
 int main(int argc, char** argv){
   test_hash();
+  test_native();
 }
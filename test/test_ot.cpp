@@ -51,6 +51,20 @@ void run_server0(const size_t m) {
   delete[] int_a[0];
   delete[] int_a;
 
+  // Fused intsum OT, with share 1 invalid
+
+  std::cout << "Testing fused int OT sum" << std::endl;
+  const uint64_t sum_shares[6] = {m ^ 9, 5, m ^ 2, 3, 1, m % 8};
+  const bool sum_valid[3] = {true, false, true};
+  const size_t sum_sizes[2] = {4, 3};
+  uint64_t sum_a[2], sum_b[2];
+  intsum_ot_sender_sum(ot0, sum_shares, sum_valid, sum_sizes, 3, 2, MOD, sum_a);
+  recv_uint64_batch(cli_sockfd, sum_b, 2);
+  for (unsigned int j = 0; j < 2; j++)
+    std::cout << "sum[" << j << "] ans: " << (sum_a[j] + sum_b[j]) % MOD << std::endl;
+  // (m ^ 9) ^ 9 + 1 ^ 0, and 5 ^ 0 + (m % 8) ^ 7
+  std::cout << "sum expected: " << (m + 1) % MOD << ", " << (5 + ((m % 8) ^ 7)) % MOD << std::endl;
+
   // cleanup
 
   delete ot0;
@@ -84,6 +98,13 @@ void run_server1(const size_t m) {
   delete[] int_b[0];
   delete[] int_b;
 
+  const uint64_t sum_shares[6] = {9, 0, 2, 4, 0, 7};
+  const bool sum_valid[3] = {true, false, true};
+  const size_t sum_sizes[2] = {4, 3};
+  uint64_t sum_b[2];
+  intsum_ot_receiver_sum(ot0, sum_shares, sum_valid, sum_sizes, 3, 2, MOD, sum_b);
+  send_uint64_batch(newsockfd, sum_b, 2);
+
   delete ot0;
   delete ot1;
   close(sockfd);
@@ -0,0 +1,122 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "../net_share.h"
+#include "../utils.h"
+#include "../submit_queue.h"
+
+// Each producer's items should come out once each, in its own order
+void test_queue(const size_t num_producers, const size_t per_producer, const size_t slots) {
+  SubmitQueue queue(slots, 2);
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < num_producers; p++) {
+    producers.emplace_back([&queue, p, per_producer]() {
+      for (size_t i = 0; i < per_producer; i++) {
+        const uint64_t ticket = queue.claim_wait();
+        memcpy(queue.pk(ticket), &p, sizeof(p));
+        queue.row(ticket)[0] = p;
+        queue.row(ticket)[1] = i;
+        queue.publish(ticket, i % 3 != 0);
+      }
+    });
+  }
+
+  auto start = clock_start();
+  uint64_t* const next = new uint64_t[num_producers]();
+  size_t got = 0, num_bad = 0;
+  unsigned int idle = 0;
+  while (got < num_producers * per_producer) {
+    const size_t n = queue.pop_batch(SIZE_MAX,
+        [&](const char* const pk, const uint64_t* const row, const bool keep) {
+      size_t p;
+      memcpy(&p, pk, sizeof(p));
+      num_bad += (p != row[0] or row[1] != next[p] or keep != (row[1] % 3 != 0));
+      next[row[0] % num_producers]++;
+    });
+    got += n;
+    if (n == 0)
+      SubmitQueue::backoff(idle);
+    else
+      idle = 0;
+  }
+  for (auto& t : producers)
+    t.join();
+  for (size_t p = 0; p < num_producers; p++)
+    num_bad += (next[p] != per_producer);
+  delete[] next;
+
+  std::cout << num_producers << " producers, " << slots << " slots: " << num_bad << " bad, "
+            << got / sec_from(start) / 1e6 << " M/s, " << queue.stalls() << " stalls" << std::endl;
+}
+
+// Submissions over several connections, some duplicate or rejected.
+// Connection 0 sends cut of them, then half a frame, and closes.
+void test_ingest(const size_t num_fds, const size_t n, const size_t cut = SIZE_MAX) {
+  const size_t frame_bytes = PK_LENGTH + sizeof(uint64_t);
+  int* const fds = new int[num_fds];
+  int* const peers = new int[num_fds];
+  for (size_t c = 0; c < num_fds; c++) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    fds[c] = sv[0];
+    peers[c] = sv[1];
+  }
+
+  size_t expected = 0, expected_bytes = 0;
+  for (size_t c = 0; c < num_fds; c++) {
+    for (size_t i = 0; i < n / num_fds + (c < n % num_fds) and (c > 0 or i < cut); i++) {
+      expected += (i != 5 and i % 10 != 9);
+      expected_bytes += frame_bytes;
+    }
+  }
+
+  std::thread clients([&]() {
+    for (size_t c = 0; c < num_fds; c++) {
+      for (size_t i = 0; i < n / num_fds + (c < n % num_fds); i++) {
+        char pk[PK_LENGTH] = {0};
+        if (c == 0 and i == cut) {
+          send(peers[c], pk, PK_LENGTH, 0);
+          shutdown(peers[c], SHUT_WR);
+          break;
+        }
+        // Repeat the first pk once
+        const uint64_t id = (i == 5) ? 0 : (c << 32) + i;
+        memcpy(pk, &id, sizeof(id));
+        send(peers[c], pk, PK_LENGTH, 0);
+        send_uint64(peers[c], i);
+      }
+    }
+  });
+
+  IngestArena arena(1, n);
+  SubmitQueue queue(16, 1);
+  const int bytes = ingest_submissions(fds, num_fds, n, frame_bytes, arena, queue,
+      [](const int fd, char* const pk, uint64_t* const row, bool& keep) {
+    const int bytes = recv_in(fd, pk, PK_LENGTH) + recv_uint64(fd, row[0]);
+    keep = (row[0] % 10 != 9);
+    return bytes;
+  });
+  clients.join();
+
+  std::cout << num_fds << " connections: " << arena.size() << " / " << expected << " kept, "
+            << bytes << " / " << expected_bytes << " bytes" << std::endl;
+
+  for (size_t c = 0; c < num_fds; c++) {
+    close(fds[c]);
+    close(peers[c]);
+  }
+  delete[] fds;
+  delete[] peers;
+}
+
+int main(int argc, char** argv) {
+  test_queue(1, 1000000, 1024);
+  test_queue(8, 250000, 1024);
+  test_queue(8, 20000, 4);
+  test_ingest(1, 1000);
+  test_ingest(3, 3001);
+  test_ingest(3, 3001, 500);
+  test_ingest(1, 1000, 0);
+}
@@ -8,13 +8,13 @@ struct BitShare {
     bool val;
 };
 
-// For INT_SUM, AND_OP, OR_OP
+// For AND_OP, OR_OP. INT_SUM sends pk then a uint64 batch
 struct IntShare {
     char pk[PK_LENGTH];
     uint64_t val;
 };
 
-// For Max, Min
+// For Max, Min. B+1 words, or 1 + bits of B with the bit encoding
 struct MaxShare {
     char pk[PK_LENGTH];
     uint64_t* arr;
@@ -37,7 +37,7 @@ struct LinRegShare {
 
 struct FreqShare {
     char pk[PK_LENGTH];
-    bool* arr;  // Could theoretically be compacted
+    uint64_t* arr;  // Packed bits, see packed.h
 };
 
 enum messageType {
@@ -54,6 +54,8 @@ enum messageType {
     FREQ_OP,
     COUNTMIN_OP,
     HEAVY_OP,
+    EPOCH_QUERY,  // Answer over a range of logged batches, see epoch.h
+    EPOCH_WINDOW,  // Answer over the last so many logged batches
 };
 
 struct initMsg {
@@ -61,6 +63,9 @@ struct initMsg {
     unsigned int num_bits;
     unsigned int num_of_inputs;
     unsigned int max_inp;
+    bool use_dpf;  // FREQ, COUNTMIN, HEAVY: rows sent as DPF keys, not bit vectors
+    bool use_bit_encoding;  // MAX, MIN: log size bit encoding, not B+1 words
+    bool group_by;  // INT_SUM, VAR, STDDEV: each submission ends with a public label
 };
 
 struct HeavyConfig {
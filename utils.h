@@ -14,6 +14,19 @@ inline void error_exit(const char* const msg) {
   exit(EXIT_FAILURE);
 }
 
+// Word sized modular arithmetic, for mod < 2^64 and inputs already reduced
+inline uint64_t addmod(const uint64_t a, const uint64_t b, const uint64_t mod) {
+  return (a >= mod - b ? a - (mod - b) : a + b);
+}
+
+inline uint64_t submod(const uint64_t a, const uint64_t b, const uint64_t mod) {
+  return (a >= b ? a - b : a + (mod - b));
+}
+
+inline uint64_t mulmod(const uint64_t a, const uint64_t b, const uint64_t mod) {
+  return (uint64_t) (((unsigned __int128) a * b) % mod);
+}
+
 #define LOG2(X) ((unsigned) (8*sizeof (unsigned long long) - __builtin_clzll((X | 1))))
 
 // todo: possibly connection code, from utils test connect and others?
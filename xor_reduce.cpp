@@ -0,0 +1,75 @@
+#include "xor_reduce.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Output words per column tile
+#define XOR_TILE 512
+
+// out[0, len) ^= x[0, len)
+static void xor_row(uint64_t* const out, const uint64_t* const x, const size_t len) {
+  size_t j = 0;
+#if defined(__AVX512F__)
+  for (; j + 8 <= len; j += 8) {
+    const __m512i a = _mm512_loadu_si512((const void*) &out[j]);
+    const __m512i b = _mm512_loadu_si512((const void*) &x[j]);
+    _mm512_storeu_si512((void*) &out[j], _mm512_xor_si512(a, b));
+  }
+#endif
+#if defined(__AVX2__)
+  for (; j + 4 <= len; j += 4) {
+    const __m256i a = _mm256_loadu_si256((const __m256i*) &out[j]);
+    const __m256i b = _mm256_loadu_si256((const __m256i*) &x[j]);
+    _mm256_storeu_si256((__m256i*) &out[j], _mm256_xor_si256(a, b));
+  }
+#endif
+  for (; j < len; j++)
+    out[j] ^= x[j];
+}
+
+// XOR of x[i] with mask[i]
+static uint64_t xor_column(const uint64_t* const x, const bool* const mask, const size_t n) {
+  uint64_t acc = 0;
+  size_t i = 0;
+#if defined(__AVX2__)
+  // bools are 0 / 1 bytes: widen, then 0 - b is all ones or zero
+  __m256i acc4 = _mm256_setzero_si256();
+  for (; i + 4 <= n; i += 4) {
+    uint32_t m4;
+    memcpy(&m4, &mask[i], 4);
+    const __m256i b = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(m4));
+    const __m256i full = _mm256_sub_epi64(_mm256_setzero_si256(), b);
+    const __m256i v = _mm256_loadu_si256((const __m256i*) &x[i]);
+    acc4 = _mm256_xor_si256(acc4, _mm256_and_si256(v, full));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*) lanes, acc4);
+  acc = lanes[0] ^ lanes[1] ^ lanes[2] ^ lanes[3];
+#endif
+  for (; i < n; i++)
+    acc ^= x[i] & (0 - (uint64_t) mask[i]);
+  return acc;
+}
+
+void xor_reduce(const uint64_t* const shares, const bool* const mask,
+                const size_t n, const size_t m, uint64_t* const out,
+                const size_t chunk_rows) {
+  if (m == 1) {
+    out[0] = xor_column(shares, mask, n);
+    return;
+  }
+  memset(out, 0, m * sizeof(uint64_t));
+  const size_t chunk = std::max(chunk_rows, (size_t) 1);
+  for (size_t i0 = 0; i0 < n; i0 += chunk) {
+    const size_t i1 = i0 + std::min(chunk, n - i0);
+    for (size_t j0 = 0; j0 < m; j0 += XOR_TILE) {
+      const size_t len = std::min((size_t) XOR_TILE, m - j0);
+      for (size_t i = i0; i < i1; i++) {
+        if (mask[i])
+          xor_row(&out[j0], &shares[i * m + j0], len);
+      }
+    }
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef XOR_REDUCE_H
+#define XOR_REDUCE_H
+
+/*
+XOR aggregation of boolean shares, for AND/OR and MAX/MIN.
+
+Shares are a [client][slot] matrix of n rows of m words, in arrival order.
+mask[i] says whether row i counts, so duplicates and invalid clients are
+masked out rather than copied around.
+
+Wide rows are reduced in column tiles, XORing each row into a tile of the
+output that stays in L1. Each tile goes over the rows again, so over a
+spilled arena, pass chunk_rows: all tiles finish with a chunk of rows
+before the next one is read, and each row comes off disk once. Single word rows are reduced down the column,
+with the mask applied branch free.
+Uses AVX-512 or AVX2 when compiled for it, with a scalar fallback.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+// out[j] = XOR of shares[i * m + j] over rows i with mask[i]
+void xor_reduce(const uint64_t* const shares, const bool* const mask,
+                const size_t n, const size_t m, uint64_t* const out,
+                const size_t chunk_rows = SIZE_MAX);
+
+#endif